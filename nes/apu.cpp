@@ -28,7 +28,7 @@ Dmc::Dmc()
 
 }
 
-void Dmc::clock()
+void Dmc::clock(std::ostream& log)
 {
     if(!enabled)
         return;
@@ -39,7 +39,7 @@ void Dmc::clock()
         if(rateCnt == rates[frequency])
         {
             rateCnt = 0;
-            std::cout << "playedSamples:" << int(numPlayedSmaples) << "\r\n";
+            log << "playedSamples:" << int(numPlayedSmaples) << "\r\n";
             numPlayedSmaples += 1;
             if(numPlayedSmaples == sampleLength && !loop && irqEnabled)
             {
@@ -54,8 +54,9 @@ void Dmc::clock()
         cnt = 0;
 }
 
-Apu::Apu()
-: m_mode{Mode::FOUR_STEP}
+Apu::Apu(std::ostream& log)
+: m_log{log}
+, m_mode{Mode::FOUR_STEP}
 , m_divider{FOUR_STEP_DIVIDER}
 , m_counter{m_divider}
 , m_step{0}
@@ -96,7 +97,7 @@ void Apu::cpuWrite(uint16_t address, uint8_t data)
         m_dmc.irqEnabled = ((data & 0x80) > 0);
         m_dmc.loop = ((data & 0x40) > 0);
         m_dmc.frequency = data & 0xf;
-        std::cout << "0x4010 frequency:" << int(m_dmc.frequency) << " irqEnabled:" << (m_dmc.irqEnabled ? "YES" : "NO") << "   loop:" << (m_dmc.loop ? "YES" : "NO")  << "\r\n";
+        m_log << "0x4010 frequency:" << int(m_dmc.frequency) << " irqEnabled:" << (m_dmc.irqEnabled ? "YES" : "NO") << "   loop:" << (m_dmc.loop ? "YES" : "NO")  << "\r\n";
     }
     else if(address == 0x4011)
     {
@@ -105,12 +106,12 @@ void Apu::cpuWrite(uint16_t address, uint8_t data)
     else if(address == 0x4012)
     {
         m_dmc.sampleAddress = 0xc000 | (data << 6);
-        std::cout << "0x4012 Sample addr:" << std::hex << int(m_dmc.sampleAddress) << "\r\n";
+        m_log << "0x4012 Sample addr:" << std::hex << int(m_dmc.sampleAddress) << "\r\n";
     }
     else if(address == 0x4013)
     {
         m_dmc.sampleLength = (data << 4) | 0b0001;
-        std::cout << "0x4013 Sample length:" << int(m_dmc.sampleLength) << "\r\n";
+        m_log << "0x4013 Sample length:" << int(m_dmc.sampleLength) << "\r\n";
     }
     else if(address == 0x4015)
     {
@@ -127,7 +128,7 @@ bool Apu::isAddressInRange(uint16_t address) const
 
 void Apu::clock()
 {
-    //m_dmc.clock();
+    //m_dmc.clock(m_log);
 
     m_counter--;
     if(m_counter == 0)
@@ -182,9 +183,58 @@ bool Apu::dmcIrqRaised()
 {
     if(m_dmc.irqRaised)
     {
-        std::cout << "dmc IRQ raised\r\n";
+        m_log << "dmc IRQ raised\r\n";
         m_dmc.irqRaised = false;
         return true;
     }
     return false;
+}
+
+void Apu::saveState(StateWriter& state) const
+{
+    state.write(m_mode);
+    state.write(m_divider);
+    state.write(m_counter);
+    state.write(m_step);
+    state.write(m_irqEnabled);
+    state.write(m_irqRaised);
+
+    // the rate table is constant
+    state.write(m_dmc.enabled);
+    state.write(m_dmc.irqEnabled);
+    state.write(m_dmc.loop);
+    state.write(m_dmc.frequency);
+    state.write(m_dmc.loadCounter);
+    state.write(m_dmc.sampleAddress);
+    state.write(m_dmc.sampleLength);
+    state.write(m_dmc.addressOffset);
+    state.write(m_dmc.currentSample);
+    state.write(m_dmc.numPlayedSmaples);
+    state.write(m_dmc.cnt);
+    state.write(m_dmc.rateCnt);
+    state.write(m_dmc.irqRaised);
+}
+
+void Apu::loadState(StateReader& state)
+{
+    state.read(m_mode);
+    state.read(m_divider);
+    state.read(m_counter);
+    state.read(m_step);
+    state.read(m_irqEnabled);
+    state.read(m_irqRaised);
+
+    state.read(m_dmc.enabled);
+    state.read(m_dmc.irqEnabled);
+    state.read(m_dmc.loop);
+    state.read(m_dmc.frequency);
+    state.read(m_dmc.loadCounter);
+    state.read(m_dmc.sampleAddress);
+    state.read(m_dmc.sampleLength);
+    state.read(m_dmc.addressOffset);
+    state.read(m_dmc.currentSample);
+    state.read(m_dmc.numPlayedSmaples);
+    state.read(m_dmc.cnt);
+    state.read(m_dmc.rateCnt);
+    state.read(m_dmc.irqRaised);
 }
\ No newline at end of file
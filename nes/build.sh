@@ -5,17 +5,28 @@ g++ -c -fPIC mapper004.cpp -o mapper004.o
 g++ -c -fPIC mapper071.cpp -o mapper071.o
 g++ -c -fPIC mapper232.cpp -o mapper232.o
 g++ -c -fPIC utils.cpp -o utils.o
+g++ -c -fPIC memoryMap.cpp -o memoryMap.o
+g++ -c -fPIC romImage.cpp -o romImage.o
+g++ -c -fPIC rewind.cpp -o rewind.o
+g++ -c -fPIC tileCache.cpp -o tileCache.o
 g++ -c -fPIC bus.cpp -o bus.o
 g++ -c -fPIC cartridge.cpp -o cartridge.o
 g++ -c -fPIC ram.cpp -o ram.o
 g++ -c -fPIC ppu.cpp -o ppu.o
+g++ -c -fPIC videoOutput.cpp -o videoOutput.o
 g++ -c -fPIC apu.cpp -o apu.o
 g++ -c -fPIC addressModes.cpp -o addressModes.o
 g++ -c -fPIC instructions.cpp -o instructions.o
+g++ -c -fPIC decodeCache.cpp -o decodeCache.o
+g++ -c -fPIC codeBlock.cpp -o codeBlock.o
+g++ -c -fPIC jit.cpp -o jit.o
+g++ -c -fPIC precompiled.cpp -o precompiled.o
 g++ -c -fPIC cpu.cpp -o cpu.o
 g++ -c -fPIC controller.cpp -o controller.o
 g++ -c -fPIC nes.cpp -o nes.o
+g++ -c -fPIC nesBatch.cpp -o nesBatch.o
+g++ -c -fPIC lockstep.cpp -o lockstep.o
 g++ -c -fPIC libNesApi.cpp -o libNesApi.o
-g++ -shared -Wl,-soname,libNesApi.so -o libNesApi.so libNesApi.o nes.o controller.o cpu.o instructions.o addressModes.o apu.o ppu.o ram.o cartridge.o bus.o utils.o mapper000.o mapper002.o mapper071.o mapper232.o mapper001.o mapper004.o
+g++ -shared -Wl,-soname,libNesApi.so -o libNesApi.so libNesApi.o nes.o nesBatch.o lockstep.o controller.o cpu.o decodeCache.o codeBlock.o jit.o precompiled.o instructions.o addressModes.o apu.o ppu.o videoOutput.o ram.o cartridge.o bus.o memoryMap.o tileCache.o romImage.o rewind.o utils.o mapper000.o mapper002.o mapper071.o mapper232.o mapper001.o mapper004.o
 mv libNesApi.so ../../nes_emulator/src/cpu/
 rm *.o
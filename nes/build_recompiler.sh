@@ -0,0 +1,6 @@
+g++ -c -fPIC romImage.cpp -o romImage.o
+g++ -c -fPIC decodeCache.cpp -o decodeCache.o
+g++ -c -fPIC codeBlock.cpp -o codeBlock.o
+g++ -c -fPIC recompiler.cpp -o recompiler.o
+g++ nesRecompile.cpp -g recompiler.o codeBlock.o decodeCache.o romImage.o -o nesRecompile
+rm *.o
@@ -1,6 +1,7 @@
 #include "include/bus.h"
 
 #include <iostream>
+#include <array>
 
 Bus::Bus()
 : m_dmaRequest{false}
@@ -9,39 +10,132 @@ Bus::Bus()
 
 }
 
-uint8_t Bus::read(uint16_t address)
+void Bus::connect(Device& device)
 {
-    return (address != 0x4014) ?  getDeviceByAddress(address).cpuRead(address) : m_dmaHighByte;
+    m_devices.push_back(device);
+    buildMemoryMap();
 }
 
-void Bus::write(uint16_t address, uint8_t data)
+void Bus::connect(const std::vector<std::reference_wrapper<Device>>& devices, const Bus& layout)
 {
-    if(address != 0x4014)
+    if(devices.size() != layout.m_devices.size())
+        throw std::runtime_error("Bus::connect() Layout has " + std::to_string(layout.m_devices.size()) + " devices, got:" + std::to_string(devices.size()));
+
+    m_devices = devices;
+    auto counterpart = [this, &layout](const Device* device) -> Device* {
+        for(size_t i = 0; device && i < layout.m_devices.size(); ++i)
+        {
+            if(&layout.m_devices[i].get() == device)
+                return &m_devices[i].get();
+        }
+        return nullptr;
+    };
+
+    m_memoryMap.clear();
+    for(uint32_t page = 0; page < 256; ++page)
     {
-        getDeviceByAddress(address).cpuWrite(address, data);
+        const auto& other = layout.m_memoryMap.page(page << 8);
+        if(other.registers == nullptr)
+        {
+            m_memoryMap.mapDevice(page, counterpart(other.device));
+            continue;
+        }
+        for(uint32_t offset = 0; offset < 256; ++offset)
+            m_memoryMap.mapRegister((page << 8) | offset, counterpart(other.registers[offset]));
     }
-    else
+
+    for(auto& device : m_devices)
     {
-        m_dmaHighByte = data;
-        m_dmaRequest = true;
+        device.get().attach(m_memoryMap);
     }
 }
 
-void Bus::connect(Device& device)
+Device& Bus::getDeviceByAddress(uint16_t address)
 {
-    m_devices.push_back(device);
+    auto device = findDevice(address);
+    if(device == nullptr)
+    {
+        throw std::runtime_error("Device not found for address:" + std::to_string(address));
+    }
+    return *device;
 }
 
-Device& Bus::getDeviceByAddress(uint16_t address)
+uint8_t Bus::readRegister(uint16_t address)
+{
+    if(address == 0x4014)
+    {
+        return m_dmaHighByte;
+    }
+
+    auto registers = m_memoryMap.page(address).registers;
+    auto device = registers ? registers[address & 0xFF] : nullptr;
+    return device ? device->cpuRead(address) : getDeviceByAddress(address).cpuRead(address);
+}
+
+void Bus::writeRegister(uint16_t address, uint8_t data)
+{
+    if(address == 0x4014)
+    {
+        m_dmaHighByte = data;
+        m_dmaRequest = true;
+        return;
+    }
+
+    auto registers = m_memoryMap.page(address).registers;
+    auto device = registers ? registers[address & 0xFF] : nullptr;
+    if(device)
+        device->cpuWrite(address, data);
+    else
+        getDeviceByAddress(address).cpuWrite(address, data);
+}
+
+Device* Bus::findDevice(uint16_t address)
 {
     for(auto& device : m_devices)
     {
         if(device.get().isAddressInRange(address))
         {
-            return device.get();
+            return &device.get();
         }
     }
-    throw std::runtime_error("Device not found for address:" + std::to_string(address));
+    return nullptr;
+}
+
+void Bus::buildMemoryMap()
+{
+    // a page owned by a single device gets a handler, pages shared between
+    // devices (the $4000 I/O page) resolve per address; $4014 stays on the bus
+    m_memoryMap.clear();
+    for(uint32_t page = 0; page < 256; ++page)
+    {
+        std::array<Device*, 256> owners;
+        Device* owner = nullptr;
+        bool shared = (page == (0x4014 >> 8));
+        for(uint32_t offset = 0; offset < 256; ++offset)
+        {
+            owners[offset] = findDevice((page << 8) | offset);
+            if(owners[offset] && owner && owners[offset] != owner)
+                shared = true;
+            if(owners[offset])
+                owner = owners[offset];
+        }
+
+        if(!shared)
+        {
+            m_memoryMap.mapDevice(page, owner);
+            continue;
+        }
+
+        for(uint32_t offset = 0; offset < 256; ++offset)
+        {
+            m_memoryMap.mapRegister((page << 8) | offset, owners[offset]);
+        }
+    }
+
+    for(auto& device : m_devices)
+    {
+        device.get().attach(m_memoryMap);
+    }
 }
 
 bool Bus::isDmaRequested()
@@ -57,4 +151,16 @@ uint8_t Bus::getHighByte()
 void Bus::clearDmaRequest()
 {
     m_dmaRequest = false;
+}
+
+void Bus::saveState(StateWriter& state) const
+{
+    state.write(m_dmaRequest);
+    state.write(m_dmaHighByte);
+}
+
+void Bus::loadState(StateReader& state)
+{
+    state.read(m_dmaRequest);
+    state.read(m_dmaHighByte);
 }
\ No newline at end of file
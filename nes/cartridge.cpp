@@ -1,5 +1,4 @@
 #include "include/cartridge.h"
-#include "include/utils.h"
 #include "include/mapper000.h"
 #include "include/mapper001.h"
 #include "include/mapper002.h"
@@ -8,10 +7,19 @@
 #include "include/mapper232.h"
 
 #include <iostream>
+#include <stdexcept>
 
-Cartridge::Cartridge(const std::string& nesFile)
+Cartridge::Cartridge(const std::string& nesFile, std::ostream& log)
+: Cartridge{RomImage::load(nesFile), log}
 {
-    auto data = getFileConent(nesFile);
+
+}
+
+Cartridge::Cartridge(std::shared_ptr<const RomImage> image, std::ostream& log)
+: m_log{log}
+, m_image{std::move(image)}
+{
+    RomSpan data = m_image->data();
     m_nesFileHeader = getNesFileHeader(data);
 
     auto prgStart = 16;
@@ -22,18 +30,21 @@ Cartridge::Cartridge(const std::string& nesFile)
         chrStart += 512;
     }
 
-    std::vector<uint8_t> prg{data.begin() + prgStart, data.begin() + prgStart + (16384 * m_nesFileHeader.numPrgBlocks)};
-    std::vector<uint8_t> chr;
+    // PRG and CHR-ROM are used in place, the mapper allocates CHR-RAM when there is no CHR-ROM
+    RomSpan prg = data.sub(prgStart, 16384 * m_nesFileHeader.numPrgBlocks);
+    RomSpan chr = data.sub(chrStart, 8192 * m_nesFileHeader.numChrBlocks);
+
+    std::shared_ptr<TileCache> tileCache;
     if(m_nesFileHeader.numChrBlocks == 0)
     {
-        chr = std::vector<uint8_t>(8192, 0);
+        std::vector<uint8_t> blank(8192, 0);
+        tileCache = std::make_shared<TileCache>(RomSpan{blank.data(), 8192});
     }
     else
-    {
-        chr = std::vector<uint8_t>(data.begin() + chrStart, data.begin() + chrStart + (8192 * m_nesFileHeader.numChrBlocks));
-    }
-
-    m_mapper = createMapper(m_nesFileHeader, std::move(prg), std::move(chr));
+        tileCache = TileCache::shared(m_image, chr);
+    m_mapper = createMapper(m_nesFileHeader, prg, chr);
+    m_mapper->setTileCache(std::move(tileCache));
+    m_mapper->setMirroring(m_nesFileHeader.mirroring);
 }
 
 uint8_t Cartridge::cpuRead(uint16_t address)
@@ -43,6 +54,8 @@ uint8_t Cartridge::cpuRead(uint16_t address)
 
 void Cartridge::cpuWrite(uint16_t address, uint8_t data)
 {
+    if(m_cpuWriteCallback)
+        m_cpuWriteCallback();
     m_mapper->cpuWrite(address, data);
 }
 
@@ -51,9 +64,9 @@ bool Cartridge::isAddressInRange(uint16_t address) const
     return address >= 0x4020 && address <= 0xFFFF;
 }
 
-uint8_t Cartridge::ppuRead(uint16_t address)
+void Cartridge::attach(MemoryMap& memoryMap)
 {
-    return m_mapper->ppuRead(address);
+    m_mapper->attach(memoryMap);
 }
 
 void Cartridge::ppuWrite(uint16_t address, uint8_t data)
@@ -61,24 +74,29 @@ void Cartridge::ppuWrite(uint16_t address, uint8_t data)
     m_mapper->ppuWrite(address, data);
 }
 
-Cartridge::NesFileHeader Cartridge::getNesFileHeader(const std::vector<uint8_t>& data)
+Cartridge::NesFileHeader Cartridge::getNesFileHeader(RomSpan data)
 {
     NesFileHeader header;
 
+    if(data.size() < 16)
+        throw std::runtime_error("Invalid nes file, size:" + std::to_string(data.size()));
+
     header.numPrgBlocks = data[4];
     header.numChrBlocks = data[5];
     header.trainer = data[6] & 0x4;
     header.mirroring = (data[6] & 0x1) ? Cartridge::Mirroring::VERTICAL : Cartridge::Mirroring::HORIZONTAL;
+    if(data[6] & 0x8)
+        header.mirroring = Cartridge::Mirroring::FOUR_SCREEN;
     header.mapperId = ((data[7] >> 4) << 4) | (data[6] >> 4);
 
-    std::cout << std::dec << "numPRG:" << int(header.numPrgBlocks) << std::endl;
+    m_log << std::dec << "numPRG:" << int(header.numPrgBlocks) << std::endl;
 
     return header;
 }
 
-std::unique_ptr<Mapper> Cartridge::createMapper(const NesFileHeader& header, std::vector<uint8_t> prg, std::vector<uint8_t> chr)
+std::unique_ptr<Mapper> Cartridge::createMapper(const NesFileHeader& header, RomSpan prg, RomSpan chr)
 {
-    std::cout << "mapper:" << int(header.mapperId) << std::endl;
+    m_log << "mapper:" << int(header.mapperId) << std::endl;
     switch(header.mapperId)
     {
         case 0:
@@ -88,7 +106,7 @@ std::unique_ptr<Mapper> Cartridge::createMapper(const NesFileHeader& header, std
         case 2:
             return std::make_unique<Mapper002>(prg, header.numPrgBlocks, chr);
         case 4:
-            return std::make_unique<Mapper004>(prg, header.numPrgBlocks, chr, header.numChrBlocks);
+            return std::make_unique<Mapper004>(prg, header.numPrgBlocks, chr, header.numChrBlocks, m_log);
         case 71:
             return std::make_unique<Mapper071>(prg, header.numPrgBlocks, chr);
         case 232:
@@ -100,7 +118,7 @@ std::unique_ptr<Mapper> Cartridge::createMapper(const NesFileHeader& header, std
 
 Cartridge::Mirroring Cartridge::getMirroring()
 {
-    return m_nesFileHeader.mirroring;
+    return m_mapper->getMirroring();
 }
 
 void Cartridge::scanline()
@@ -116,4 +134,44 @@ bool Cartridge::isIrqActive()
 void Cartridge::clearIrq()
 {
     m_mapper->clearIrq();
+}
+
+bool Cartridge::hasScanlineCounter()
+{
+    return m_mapper->hasScanlineCounter();
+}
+
+void Cartridge::setCpuWriteCallback(std::function<void()> callback)
+{
+    m_cpuWriteCallback = callback;
+}
+
+void Cartridge::setMirroringCallback(std::function<void(Mirroring)> callback)
+{
+    m_mapper->setMirroringCallback(std::move(callback));
+}
+
+uint64_t Cartridge::getRomHash() const
+{
+    return m_image->hash();
+}
+
+uint8_t Cartridge::getMapperId() const
+{
+    return m_nesFileHeader.mapperId;
+}
+
+std::shared_ptr<const RomImage> Cartridge::getRomImage() const
+{
+    return m_image;
+}
+
+void Cartridge::saveState(StateWriter& state) const
+{
+    m_mapper->saveState(state);
+}
+
+void Cartridge::loadState(StateReader& state)
+{
+    m_mapper->loadState(state);
 }
\ No newline at end of file
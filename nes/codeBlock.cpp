@@ -0,0 +1,260 @@
+#include "include/codeBlock.h"
+
+namespace
+{
+    // Relative::getAddress worked out ahead
+    void resolveBranch(CodeBlock::Op& op)
+    {
+        uint16_t at = op.pc + 1;
+        uint16_t addr = op.operand;
+        uint16_t from = at + 1;
+        if(addr & 0x80)
+        {
+            addr = ~addr & 0xff;
+            addr = at - addr;
+            from = at;
+        }
+        else
+            addr += from;
+        op.target = addr;
+        op.takenCycles = 2 + (((addr & 0xff00) != (from & 0xff00)) ? 2 : 1);
+    }
+}
+
+CodeBlock::CodeBlock(uint16_t pc, const uint8_t* page, DecodeCache& decodeCache)
+: m_pc{pc}
+, m_maxStart{0}
+{
+    for(uint16_t at = pc; m_ops.size() < MAX_INSTRUCTIONS && (at >> 8) == (pc >> 8); )
+    {
+        const auto& decoded = decodeCache.find(at, page);
+        Info info = describe(decoded.opcode);
+        if(!decoded.isLocal || info.kind == Kind::NONE)
+            break;
+
+        Op op{at, info, 0, 0, 0};
+        uint8_t offset = at & 0xFF;
+        if(decoded.length > 1)
+            op.operand = page[offset + 1];
+        if(decoded.length > 2)
+            op.operand |= page[offset + 2] << 8;
+        if(info.kind == Kind::BRANCH)
+            resolveBranch(op);
+
+        if(!m_ops.empty())
+        {
+            const auto& previous = m_ops.back();
+            m_maxStart += (previous.info.kind == Kind::BRANCH) ? previous.takenCycles : previous.info.cycles + previous.info.extraCycle;
+        }
+        m_ops.push_back(op);
+        at += decoded.length;
+        if(isExit(info.kind))
+            break;
+    }
+}
+
+// what core::execute does for the opcodes that are translated, with the same cycles
+CodeBlock::Info CodeBlock::describe(uint8_t opcode)
+{
+    switch(opcode)
+    {
+        case 0xA9: return {Kind::LOAD, Mode::IMMEDIATE, 2, false, A};
+        case 0xA5: return {Kind::LOAD, Mode::ZERO_PAGE, 3, false, A};
+        case 0xB5: return {Kind::LOAD, Mode::ZERO_PAGE_X, 4, false, A};
+        case 0xAD: return {Kind::LOAD, Mode::ABSOLUTE, 4, false, A};
+        case 0xBD: return {Kind::LOAD, Mode::ABSOLUTE_X, 4, true, A};
+        case 0xB9: return {Kind::LOAD, Mode::ABSOLUTE_Y, 4, true, A};
+        case 0xA2: return {Kind::LOAD, Mode::IMMEDIATE, 2, false, X};
+        case 0xA6: return {Kind::LOAD, Mode::ZERO_PAGE, 3, false, X};
+        case 0xB6: return {Kind::LOAD, Mode::ZERO_PAGE_Y, 4, false, X};
+        case 0xAE: return {Kind::LOAD, Mode::ABSOLUTE, 4, false, X};
+        case 0xBE: return {Kind::LOAD, Mode::ABSOLUTE_Y, 4, true, X};
+        case 0xA0: return {Kind::LOAD, Mode::IMMEDIATE, 2, false, Y};
+        case 0xA4: return {Kind::LOAD, Mode::ZERO_PAGE, 3, false, Y};
+        case 0xB4: return {Kind::LOAD, Mode::ZERO_PAGE_X, 4, false, Y};
+        case 0xAC: return {Kind::LOAD, Mode::ABSOLUTE, 4, false, Y};
+        case 0xBC: return {Kind::LOAD, Mode::ABSOLUTE_X, 4, true, Y};
+
+        case 0x85: return {Kind::STORE, Mode::ZERO_PAGE, 3, false, A};
+        case 0x95: return {Kind::STORE, Mode::ZERO_PAGE_X, 4, false, A};
+        case 0x8D: return {Kind::STORE, Mode::ABSOLUTE, 4, false, A};
+        case 0x9D: return {Kind::STORE, Mode::ABSOLUTE_X, 5, false, A};
+        case 0x99: return {Kind::STORE, Mode::ABSOLUTE_Y, 5, false, A};
+        case 0x86: return {Kind::STORE, Mode::ZERO_PAGE, 3, false, X};
+        case 0x96: return {Kind::STORE, Mode::ZERO_PAGE_Y, 4, false, X};
+        case 0x8E: return {Kind::STORE, Mode::ABSOLUTE, 4, false, X};
+        case 0x84: return {Kind::STORE, Mode::ZERO_PAGE, 3, false, Y};
+        case 0x94: return {Kind::STORE, Mode::ZERO_PAGE_X, 4, false, Y};
+        case 0x8C: return {Kind::STORE, Mode::ABSOLUTE, 4, false, Y};
+
+        case 0x29: return {Kind::AND, Mode::IMMEDIATE, 2};
+        case 0x25: return {Kind::AND, Mode::ZERO_PAGE, 3};
+        case 0x35: return {Kind::AND, Mode::ZERO_PAGE_X, 4};
+        case 0x2D: return {Kind::AND, Mode::ABSOLUTE, 4};
+        case 0x3D: return {Kind::AND, Mode::ABSOLUTE_X, 4, true};
+        case 0x39: return {Kind::AND, Mode::ABSOLUTE_Y, 4, true};
+        case 0x09: return {Kind::ORA, Mode::IMMEDIATE, 2};
+        case 0x05: return {Kind::ORA, Mode::ZERO_PAGE, 3};
+        case 0x15: return {Kind::ORA, Mode::ZERO_PAGE_X, 4};
+        case 0x0D: return {Kind::ORA, Mode::ABSOLUTE, 4};
+        case 0x1D: return {Kind::ORA, Mode::ABSOLUTE_X, 4, true};
+        case 0x19: return {Kind::ORA, Mode::ABSOLUTE_Y, 4, true};
+        case 0x49: return {Kind::EOR, Mode::IMMEDIATE, 2};
+        case 0x45: return {Kind::EOR, Mode::ZERO_PAGE, 3};
+        case 0x55: return {Kind::EOR, Mode::ZERO_PAGE_X, 4};
+        case 0x4D: return {Kind::EOR, Mode::ABSOLUTE, 4};
+        case 0x5D: return {Kind::EOR, Mode::ABSOLUTE_X, 4, true};
+        case 0x59: return {Kind::EOR, Mode::ABSOLUTE_Y, 4, true};
+        case 0x69: return {Kind::ADC, Mode::IMMEDIATE, 2};
+        case 0x65: return {Kind::ADC, Mode::ZERO_PAGE, 3};
+        case 0x75: return {Kind::ADC, Mode::ZERO_PAGE_X, 4};
+        case 0x6D: return {Kind::ADC, Mode::ABSOLUTE, 4};
+        case 0x7D: return {Kind::ADC, Mode::ABSOLUTE_X, 4, true};
+        case 0x79: return {Kind::ADC, Mode::ABSOLUTE_Y, 4, true};
+        case 0xE9: return {Kind::SBC, Mode::IMMEDIATE, 2};
+        case 0xEB: return {Kind::SBC, Mode::IMMEDIATE, 2};
+        case 0xE5: return {Kind::SBC, Mode::ZERO_PAGE, 3};
+        case 0xF5: return {Kind::SBC, Mode::ZERO_PAGE_X, 4};
+        case 0xED: return {Kind::SBC, Mode::ABSOLUTE, 4};
+        case 0xFD: return {Kind::SBC, Mode::ABSOLUTE_X, 4, true};
+        case 0xF9: return {Kind::SBC, Mode::ABSOLUTE_Y, 4, true};
+
+        case 0xC9: return {Kind::CMP, Mode::IMMEDIATE, 2, false, A};
+        case 0xC5: return {Kind::CMP, Mode::ZERO_PAGE, 3, false, A};
+        case 0xD5: return {Kind::CMP, Mode::ZERO_PAGE_X, 4, false, A};
+        case 0xCD: return {Kind::CMP, Mode::ABSOLUTE, 4, false, A};
+        case 0xDD: return {Kind::CMP, Mode::ABSOLUTE_X, 4, true, A};
+        case 0xD9: return {Kind::CMP, Mode::ABSOLUTE_Y, 4, true, A};
+        case 0xE0: return {Kind::CMP, Mode::IMMEDIATE, 2, false, X};
+        case 0xE4: return {Kind::CMP, Mode::ZERO_PAGE, 3, false, X};
+        case 0xEC: return {Kind::CMP, Mode::ABSOLUTE, 4, false, X};
+        case 0xC0: return {Kind::CMP, Mode::IMMEDIATE, 2, false, Y};
+        case 0xC4: return {Kind::CMP, Mode::ZERO_PAGE, 3, false, Y};
+        case 0xCC: return {Kind::CMP, Mode::ABSOLUTE, 4, false, Y};
+
+        case 0xE6: return {Kind::INC, Mode::ZERO_PAGE, 5};
+        case 0xF6: return {Kind::INC, Mode::ZERO_PAGE_X, 6};
+        case 0xEE: return {Kind::INC, Mode::ABSOLUTE, 6};
+        case 0xFE: return {Kind::INC, Mode::ABSOLUTE_X, 7, true};
+        case 0xC6: return {Kind::DEC, Mode::ZERO_PAGE, 5};
+        case 0xD6: return {Kind::DEC, Mode::ZERO_PAGE_X, 6};
+        case 0xCE: return {Kind::DEC, Mode::ABSOLUTE, 6};
+        case 0xDE: return {Kind::DEC, Mode::ABSOLUTE_X, 7, true};
+        case 0x0A: return {Kind::ASL, Mode::ACCUMULATOR, 2};
+        case 0x06: return {Kind::ASL, Mode::ZERO_PAGE, 5};
+        case 0x16: return {Kind::ASL, Mode::ZERO_PAGE_X, 6};
+        case 0x0E: return {Kind::ASL, Mode::ABSOLUTE, 6};
+        case 0x1E: return {Kind::ASL, Mode::ABSOLUTE_X, 7, true};
+        case 0x4A: return {Kind::LSR, Mode::ACCUMULATOR, 2};
+        case 0x46: return {Kind::LSR, Mode::ZERO_PAGE, 5};
+        case 0x56: return {Kind::LSR, Mode::ZERO_PAGE_X, 6};
+        case 0x4E: return {Kind::LSR, Mode::ABSOLUTE, 6};
+        case 0x5E: return {Kind::LSR, Mode::ABSOLUTE_X, 7, true};
+        case 0x2A: return {Kind::ROL, Mode::ACCUMULATOR, 2};
+        case 0x26: return {Kind::ROL, Mode::ZERO_PAGE, 5};
+        case 0x36: return {Kind::ROL, Mode::ZERO_PAGE_X, 6};
+        case 0x2E: return {Kind::ROL, Mode::ABSOLUTE, 6};
+        case 0x3E: return {Kind::ROL, Mode::ABSOLUTE_X, 7, true};
+        case 0x6A: return {Kind::ROR, Mode::ACCUMULATOR, 2};
+        case 0x66: return {Kind::ROR, Mode::ZERO_PAGE, 5};
+        case 0x76: return {Kind::ROR, Mode::ZERO_PAGE_X, 6};
+        case 0x6E: return {Kind::ROR, Mode::ABSOLUTE, 6};
+        case 0x7E: return {Kind::ROR, Mode::ABSOLUTE_X, 7, true};
+
+        case 0xE8: return {Kind::STEP, Mode::IMPLIED, 2, false, X, 1};
+        case 0xCA: return {Kind::STEP, Mode::IMPLIED, 2, false, X, -1};
+        case 0xC8: return {Kind::STEP, Mode::IMPLIED, 2, false, Y, 1};
+        case 0x88: return {Kind::STEP, Mode::IMPLIED, 2, false, Y, -1};
+        case 0xAA: return {Kind::TRANSFER, Mode::IMPLIED, 2, false, X, A};
+        case 0xA8: return {Kind::TRANSFER, Mode::IMPLIED, 2, false, Y, A};
+        case 0x8A: return {Kind::TRANSFER, Mode::IMPLIED, 2, false, A, X};
+        case 0x98: return {Kind::TRANSFER, Mode::IMPLIED, 2, false, A, Y};
+        case 0xBA: return {Kind::TSX, Mode::IMPLIED, 2};
+        case 0x9A: return {Kind::TXS, Mode::IMPLIED, 2};
+
+        case 0x18: return {Kind::FLAG, Mode::IMPLIED, 2, false, FLAG_C, 0};
+        case 0x38: return {Kind::FLAG, Mode::IMPLIED, 2, false, FLAG_C, 1};
+        case 0x58: return {Kind::FLAG, Mode::IMPLIED, 2, false, FLAG_I, 0};
+        case 0x78: return {Kind::FLAG, Mode::IMPLIED, 2, false, FLAG_I, 1};
+        case 0xB8: return {Kind::FLAG, Mode::IMPLIED, 2, false, FLAG_V, 0};
+        case 0xD8: return {Kind::FLAG, Mode::IMPLIED, 2, false, FLAG_D, 0};
+        case 0xF8: return {Kind::FLAG, Mode::IMPLIED, 2, false, FLAG_D, 1};
+        case 0xEA:
+        case 0x1A:
+        case 0x3A:
+        case 0x5A:
+        case 0x7A:
+        case 0xDA:
+        case 0xFA: return {Kind::NOP, Mode::IMPLIED, 2};
+
+        case 0x10: return {Kind::BRANCH, Mode::RELATIVE, 2, false, FLAG_N, 0};
+        case 0x30: return {Kind::BRANCH, Mode::RELATIVE, 2, false, FLAG_N, 1};
+        case 0x50: return {Kind::BRANCH, Mode::RELATIVE, 2, false, FLAG_V, 0};
+        case 0x70: return {Kind::BRANCH, Mode::RELATIVE, 2, false, FLAG_V, 1};
+        case 0x90: return {Kind::BRANCH, Mode::RELATIVE, 2, false, FLAG_C, 0};
+        case 0xB0: return {Kind::BRANCH, Mode::RELATIVE, 2, false, FLAG_C, 1};
+        case 0xD0: return {Kind::BRANCH, Mode::RELATIVE, 2, false, FLAG_Z, 0};
+        case 0xF0: return {Kind::BRANCH, Mode::RELATIVE, 2, false, FLAG_Z, 1};
+        case 0x4C: return {Kind::JMP, Mode::ABSOLUTE, 3};
+        case 0x20: return {Kind::JSR, Mode::ABSOLUTE, 6};
+        case 0x60: return {Kind::RTS, Mode::IMPLIED, 6};
+        case 0x48: return {Kind::PHA, Mode::IMPLIED, 3};
+        case 0x68: return {Kind::PLA, Mode::IMPLIED, 4};
+        default:   return {Kind::NONE, Mode::IMPLIED, 0};
+    }
+}
+
+uint8_t CodeBlock::length(Mode mode)
+{
+    switch(mode)
+    {
+        case Mode::IMPLIED:
+        case Mode::ACCUMULATOR:
+            return 1;
+        case Mode::ABSOLUTE:
+        case Mode::ABSOLUTE_X:
+        case Mode::ABSOLUTE_Y:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
+bool CodeBlock::isExit(Kind kind)
+{
+    return kind == Kind::BRANCH || kind == Kind::JMP || kind == Kind::JSR || kind == Kind::RTS;
+}
+
+bool CodeBlock::empty() const
+{
+    return m_ops.empty();
+}
+
+uint16_t CodeBlock::getPc() const
+{
+    return m_pc;
+}
+
+const std::vector<CodeBlock::Op>& CodeBlock::getOps() const
+{
+    return m_ops;
+}
+
+uint32_t CodeBlock::getMaxStart() const
+{
+    return m_maxStart;
+}
+
+uint16_t CodeBlock::getEnd() const
+{
+    const auto& last = m_ops.back();
+    return last.pc + length(last.info.mode);
+}
+
+bool CodeBlock::canLoop() const
+{
+    for(const auto& op : m_ops)
+        if(op.info.kind == Kind::PHA || op.info.kind == Kind::PLA)
+            return false;
+    return true;
+}
\ No newline at end of file
@@ -125,4 +125,20 @@ void Controller::cpuWrite(uint16_t address, uint8_t data)
 bool Controller::isAddressInRange(uint16_t address) const
 {
     return address == 0x4016 || address == 0x4017;
+}
+
+void Controller::saveState(StateWriter& state) const
+{
+    for(bool pressed : {m_upPressed, m_downPressed, m_leftPressed, m_rightPressed, m_startPressed, m_selectPressed, m_bPressed, m_aPressed})
+        state.write(pressed);
+    state.write(m_counter);
+    state.write(m_readButton);
+}
+
+void Controller::loadState(StateReader& state)
+{
+    for(bool* pressed : {&m_upPressed, &m_downPressed, &m_leftPressed, &m_rightPressed, &m_startPressed, &m_selectPressed, &m_bPressed, &m_aPressed})
+        state.read(*pressed);
+    state.read(m_counter);
+    state.read(m_readButton);
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "include/cpu.h"
+#include "include/cpuCore.h"
 #include "include/instructions.h"
 #include "include/utils.h"
 
@@ -6,6 +7,41 @@
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <utility>
+
+namespace
+{
+    using Fused = uint8_t (*)(Cpu& cpu, uint32_t limit, uint32_t& cycles, uint32_t& lastStart);
+
+    // The opcodes are constants, once flattened the switch of core::execute folds away to the
+    // handlers of the sequence. Returns the number of instructions run.
+    template<size_t Index, uint8_t Step = 0>
+    __attribute__((flatten)) uint8_t runSequence(Cpu& cpu, uint32_t limit, uint32_t& cycles, uint32_t& lastStart)
+    {
+        constexpr const fusion::Sequence& sequence = fusion::SEQUENCES[Index];
+        if constexpr(Step == sequence.length)
+            return Step;
+        else
+        {
+            if(Step == 0)
+                cycles = 0;
+            else if(cycles > limit)
+                return Step;
+            lastStart = cycles;
+            cpu.getState().pc += 1;
+            cycles += core::execute(cpu, sequence.opcodes[Step]);
+            return runSequence<Index, Step + 1>(cpu, limit, cycles, lastStart);
+        }
+    }
+
+    template<size_t... Indexes>
+    constexpr std::array<Fused, sizeof...(Indexes)> makeFused(std::index_sequence<Indexes...>)
+    {
+        return {&runSequence<Indexes>...};
+    }
+
+    constexpr auto FUSED = makeFused(std::make_index_sequence<fusion::COUNT>());
+}
 
 StatusRegister::StatusRegister()
 : n{0}
@@ -37,8 +73,10 @@ void StatusRegister::fromByte(uint8_t data)
     n = (data >> 7) & 0x1;   
 }
 
-Cpu::Cpu(Bus& bus, Controller& c, Ppu& p)
+Cpu::Cpu(Bus& bus, Controller& c, Ppu& p, std::ostream& log)
 : m_bus{bus}
+, m_log{log}
+, m_tracePath{"log.txt"}
 , m_clockTicks{7}
 , m_execBitIns{false}
 , m_logMsg{""}
@@ -47,6 +85,8 @@ Cpu::Cpu(Bus& bus, Controller& c, Ppu& p)
 , m_newInstruction{false}
 , m_enablePrint{false}
 , m_clk{0}
+, m_jit{bus, m_decodeCache}
+, m_isFusionProfiled{false}
 , m_c{c}
 , m_ppu{p}
 {
@@ -388,21 +428,26 @@ std::string Cpu::instAsBytes(uint16_t pc, uint8_t instructionSize)
     return s + std::string(12 - s.size(), ' ');
 }
 
+uint8_t Cpu::execute(uint8_t opcode)
+{
+    return core::execute(*this, opcode);
+}
+
 void Cpu::clock()
 {
     if(m_cyclesLeftToPerformCurrentInstruction == 1 && m_execBitIns == true)
     {
         m_execBitIns = false;
-        m_instructions[0x2c]->execute();
-        if(m_enablePrint)
+        if(!m_enablePrint)
+            execute(0x2c);
+        else
         {
+            m_instructions[0x2c]->execute();
             std::string logMsg = m_logMsg;
             logMsg += m_instructions[0x2c]->str();
             logMsg += m_cpuMsg;
 
-            std::ofstream fh("log.txt", std::ios::app);
-            fh << logMsg;
-            fh.close();
+            trace(logMsg);
             m_logMsg = "";
             m_cpuMsg = "";
         }
@@ -416,11 +461,11 @@ void Cpu::clock()
 
         auto instruction = read(m_cpuState.pc);
 
-        if(m_instructions[instruction] == nullptr)
-            throw std::runtime_error("Unknown instruction :" + toHexString(instruction, 2));
-
         if(m_enablePrint)
         {
+            if(m_instructions[instruction] == nullptr)
+                throw std::runtime_error("Unknown instruction :" + toHexString(instruction, 2));
+
             logMsg += toHex(m_cpuState.pc, 4) + " ";
             logMsg += instAsBytes(m_cpuState.pc, m_instructions[instruction]->size());
             cpuStateBefore = m_cpuState.str();
@@ -468,16 +513,15 @@ void Cpu::clock()
             }
             */ 
 
-            m_cyclesLeftToPerformCurrentInstruction = m_instructions[instruction]->execute();
+            // the object graph stays as the reference implementation for traces
+            m_cyclesLeftToPerformCurrentInstruction = m_enablePrint ? m_instructions[instruction]->execute() : execute(instruction);
         }
 
         if(m_enablePrint && m_execBitIns == false)
         {
             logMsg += m_instructions[instruction]->str();
             logMsg += cpuStateBefore;
-            std::ofstream fh("log.txt", std::ios::app);
-            fh << logMsg;
-            fh.close();
+            trace(logMsg);
         }
         if(m_enablePrint && m_execBitIns == true)
         {
@@ -494,6 +538,22 @@ void Cpu::clock()
     m_clk += 1;
 }
 
+uint8_t Cpu::cyclesToNextAction()
+{
+    // number of clock() calls that only count down before the next one touches the bus
+    return m_execBitIns ? m_cyclesLeftToPerformCurrentInstruction - 1 : m_cyclesLeftToPerformCurrentInstruction;
+}
+
+void Cpu::idle(uint8_t cycles)
+{
+    if(cycles == 0)
+        return;
+
+    m_newInstruction = false;
+    m_cyclesLeftToPerformCurrentInstruction -= cycles;
+    m_clk += cycles;
+}
+
 void Cpu::reset()
 {
     m_clockTicks = 8;
@@ -504,7 +564,7 @@ void Cpu::reset()
     uint8_t hh = read(m_cpuState.pc + 1);
 
     m_cpuState.pc = (hh << 8) | ll;
-    std::cout << "Reset set PC:" << std::hex << m_cpuState.pc << std::endl;
+    m_log << "Reset set PC:" << std::hex << m_cpuState.pc << std::endl;
 
     m_cpuState.a = 0x00;
     m_cpuState.x = 0x08;
@@ -570,11 +630,208 @@ uint8_t Cpu::cyclesLeft()
     return m_cyclesLeftToPerformCurrentInstruction;
 }
 
+bool Cpu::isNextLocal()
+{
+    if(m_execBitIns || m_enablePrint)
+        return false;
+    const uint8_t* page = m_bus.romPage(m_cpuState.pc);
+    return page && m_decodeCache.find(m_cpuState.pc, page).isLocal;
+}
+
+bool Cpu::runCompiled(uint32_t limit, uint32_t& lastStart)
+{
+    if(m_jit.getMode() == Jit::Mode::OFF || m_execBitIns || m_enablePrint || m_cpuState.sp < 0 || m_cpuState.sp > 0xFF)
+        return false;
+    const uint8_t* page = m_bus.romPage(m_cpuState.pc);
+    if(!page)
+        return false;
+    const Jit::Block* block = m_jit.find(m_cpuState.pc, page);
+    if(!block || block->maxStart > limit)
+        return false;
+
+    idle(cyclesToNextAction());
+    uint32_t cycles = (m_jit.getMode() == Jit::Mode::CHECKED) ? runChecked(*block, limit, lastStart) : m_jit.run(*block, m_cpuState, limit, lastStart);
+
+    // as if the instructions had gone through clock() one by one
+    m_clockTicks += cycles;
+    m_clk += lastStart + 1;
+    m_cyclesLeftToPerformCurrentInstruction = cycles - lastStart - 1;
+    m_newInstruction = true;
+    return true;
+}
+
+bool Cpu::runFused(uint32_t limit, uint32_t& lastStart)
+{
+    if(m_execBitIns || m_enablePrint)
+        return false;
+    const uint8_t* page = m_bus.romPage(m_cpuState.pc);
+    if(!page)
+        return false;
+    uint8_t fusion = m_decodeCache.find(m_cpuState.pc, page).fusion;
+    if(fusion == 0)
+        return false;
+
+    idle(cyclesToNextAction());
+    uint32_t cycles;
+    uint8_t count = FUSED[fusion - 1](*this, limit, cycles, lastStart);
+    if(m_isFusionProfiled)
+    {
+        m_fusionCounts[fusion - 1].runs += 1;
+        m_fusionCounts[fusion - 1].instructions += count;
+    }
+
+    m_clockTicks += cycles;
+    m_clk += lastStart + 1;
+    m_cyclesLeftToPerformCurrentInstruction = cycles - lastStart - 1;
+    m_newInstruction = true;
+    return true;
+}
+
+bool Cpu::isNextIdleLoop(bool& isStatusRead)
+{
+    if(m_execBitIns || m_enablePrint)
+        return false;
+    const uint8_t* page = m_bus.romPage(m_cpuState.pc);
+    if(!page)
+        return false;
+    const auto& decoded = m_decodeCache.find(m_cpuState.pc, page);
+    isStatusRead = decoded.isIdleStatus;
+    return decoded.idleLength != 0;
+}
+
+bool Cpu::runIdleLoop(uint32_t limit, uint32_t& lastStart)
+{
+    if(m_execBitIns || m_enablePrint)
+        return false;
+    const uint8_t* page = m_bus.romPage(m_cpuState.pc);
+    if(!page)
+        return false;
+    uint8_t length = m_decodeCache.find(m_cpuState.pc, page).idleLength;
+    if(length == 0 || uint32_t{length} * DecodeCache::IDLE_CYCLES > limit)
+        return false;
+
+    idle(cyclesToNextAction());
+    uint16_t head = m_cpuState.pc;
+    CpuState before = m_cpuState;
+    uint32_t cycles = 0;
+    uint16_t pc = head;
+    for(uint8_t i = 0; i < length && m_cpuState.pc == pc; ++i)
+    {
+        const auto& decoded = m_decodeCache.find(pc, page);
+        pc += decoded.length;
+        lastStart = cycles;
+        m_cpuState.pc += 1;
+        cycles += execute(decoded.opcode);
+    }
+
+    // nothing but the registers changes, so the same registers mean the same round again
+    if(m_cpuState.pc == head && m_cpuState.a == before.a && m_cpuState.x == before.x && m_cpuState.y == before.y
+        && m_cpuState.sp == before.sp && m_cpuState.sr.toByte() == before.sr.toByte())
+    {
+        uint32_t rounds = (limit - lastStart) / cycles;
+        lastStart += rounds * cycles;
+        cycles += rounds * cycles;
+    }
+
+    m_clockTicks += cycles;
+    m_clk += lastStart + 1;
+    m_cyclesLeftToPerformCurrentInstruction = cycles - lastStart - 1;
+    m_newInstruction = true;
+    return true;
+}
+
+uint32_t Cpu::runChecked(const Jit::Block& block, uint32_t limit, uint32_t& lastStart)
+{
+    // the block runs first, then RAM and registers go back and the interpreter has to end
+    // up in the same place after the same cycles
+    CpuState before = m_cpuState;
+    std::array<uint8_t, 0x800> ram;
+    for(uint16_t address = 0; address < ram.size(); ++address)
+        ram[address] = read(address);
+
+    uint32_t cycles = m_jit.run(block, m_cpuState, limit, lastStart);
+    CpuState compiled = m_cpuState;
+    std::array<uint8_t, 0x800> compiledRam;
+    for(uint16_t address = 0; address < ram.size(); ++address)
+    {
+        compiledRam[address] = read(address);
+        if(compiledRam[address] != ram[address])
+            write(address, ram[address]);
+    }
+    m_cpuState = before;
+
+    uint32_t interpreted = 0;
+    uint32_t start = 0;
+    while(interpreted < cycles)
+    {
+        start = interpreted;
+        uint8_t opcode = read(m_cpuState.pc);
+        m_cpuState.pc += 1;
+        interpreted += execute(opcode);
+    }
+
+    std::string diff;
+    if(interpreted != cycles || start != lastStart)
+        diff += " cycles " + std::to_string(cycles) + "/" + std::to_string(lastStart) + " instead of " + std::to_string(interpreted) + "/" + std::to_string(start);
+    if(compiled.pc != m_cpuState.pc)
+        diff += " PC:" + toHex(compiled.pc, 4) + " instead of " + toHex(m_cpuState.pc, 4);
+    if(compiled.str() != m_cpuState.str())
+        diff += " " + compiled.str() + " instead of " + m_cpuState.str();
+    for(uint16_t address = 0; address < ram.size(); ++address)
+        if(compiledRam[address] != read(address))
+            diff += " $" + toHex(address, 4) + ":" + toHex(compiledRam[address], 2) + " instead of " + toHex(read(address), 2);
+    if(!diff.empty())
+        throw std::runtime_error("JIT block at $" + toHex(block.pc, 4) + " differs from the interpreter:" + diff);
+
+    lastStart = start;
+    return interpreted;
+}
+
+void Cpu::setJitMode(Jit::Mode mode)
+{
+    m_jit.setMode(mode);
+}
+
+Jit::Mode Cpu::getJitMode() const
+{
+    return m_jit.getMode();
+}
+
+void Cpu::setFusionProfile(bool enabled)
+{
+    m_isFusionProfiled = enabled;
+    for(size_t i = 0; i < fusion::COUNT; ++i)
+        m_fusionCounts[i] = {fusion::SEQUENCES[i].name, 0, 0};
+}
+
+std::vector<fusion::Count> Cpu::getFusionProfile() const
+{
+    if(!m_isFusionProfiled)
+        return {};
+    return {m_fusionCounts.begin(), m_fusionCounts.end()};
+}
+
+void Cpu::setPrecompiled(RomSpan image, const PrecompiledRom* rom)
+{
+    m_jit.setPrecompiled(image, rom);
+}
+
 bool Cpu::isPrintEnbled()
 {
     return m_enablePrint;
 }
 
+void Cpu::setTraceFile(const std::string& path)
+{
+    m_tracePath = path;
+}
+
+void Cpu::trace(const std::string& message)
+{
+    std::ofstream fh(m_tracePath, std::ios::app);
+    fh << message;
+}
+
 
 std::string CpuState::str()
 {
@@ -583,4 +840,27 @@ std::string CpuState::str()
           " Y:"  + toHex(y,2) + 
           " P:"  + toHex(sr.toByte(), 2) +
           " SP:" + toHex(sp, 2);
+}
+
+void Cpu::saveState(StateWriter& state) const
+{
+    // the trace messages are not part of the machine
+    state.write(m_cpuState);
+    state.write(m_clockTicks);
+    state.write(m_operand);
+    state.write(m_execBitIns);
+    state.write(m_cyclesLeftToPerformCurrentInstruction);
+    state.write(m_newInstruction);
+    state.write(m_clk);
+}
+
+void Cpu::loadState(StateReader& state)
+{
+    state.read(m_cpuState);
+    state.read(m_clockTicks);
+    state.read(m_operand);
+    state.read(m_execBitIns);
+    state.read(m_cyclesLeftToPerformCurrentInstruction);
+    state.read(m_newInstruction);
+    state.read(m_clk);
 }
\ No newline at end of file
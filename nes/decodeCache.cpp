@@ -0,0 +1,218 @@
+#include "include/decodeCache.h"
+#include "include/fusion.h"
+
+namespace
+{
+    // Address mode of each opcode as in core::execute, rows by high nibble:
+    // i implied or accumulator, # immediate, r relative, z zero page (indexed or not),
+    // a absolute, x absolute indexed, n indirect, p indexed indirect, - unknown
+    constexpr const char* MODES[16] = {
+        "ip-pzzzzi#i-aaaa",     // 00
+        "rp-pzzzzixixxxxx",     // 10
+        "ap-pzzzzi#i-aaaa",     // 20
+        "rp-pzzzzixixxxxx",     // 30
+        "ip-pzzzzi#i-aaaa",     // 40
+        "rp-pzzzzixixxxxx",     // 50
+        "ip-pzzzzi#i-naaa",     // 60
+        "rp-pzzzzixixxxxx",     // 70
+        "#p-pzzzzi-i-aaaa",     // 80
+        "rp--zzzzixi--x--",     // 90
+        "#p#pzzzzi#i-aaaa",     // A0
+        "rp-pzzzzixi-xxxx",     // B0
+        "#p-pzzzzi#i#aaaa",     // C0
+        "rp-pzzzzixixxxxx",     // D0
+        "#p-pzzzzi#i#aaaa",     // E0
+        "rp-pzzzzixixxxxx"      // F0
+    };
+
+    // What the operation does at its address: r read, w write, m read and write, . nothing
+    constexpr const char* ACCESS[16] = {
+        ".r-m.rmm.rm-.rmm",     // 00
+        ".r-m.rmm.r.m.rmm",     // 10
+        ".r-mrrmm.rm-rrmm",     // 20
+        ".r-m.rmm.r.m.rmm",     // 30
+        ".r-m.rmm.rm-.rmm",     // 40
+        ".r-m.rmm.r.m.rmm",     // 50
+        ".r-m.rmm.rm-rrmm",     // 60
+        ".r-m.rmm.r.m.rmm",     // 70
+        ".w-wwwww.-.-wwww",     // 80
+        ".w--wwww.w.--w--",     // 90
+        "rrrrrrrr.r.-rrrr",     // A0
+        ".r-rrrrr.r.-rrrr",     // B0
+        "rr-mrrmm.r.wrrmm",     // C0
+        ".r-m.rmm.r.m.rmm",     // D0
+        "rr-mrrmm.r.rrrmm",     // E0
+        ".r-m.rmm.r.m.rmm"      // F0
+    };
+
+    uint8_t length(char mode)
+    {
+        switch(mode)
+        {
+            case 'a':
+            case 'x':
+            case 'n':
+                return 3;
+            case '#':
+            case 'r':
+            case 'z':
+            case 'p':
+                return 2;
+            default:
+                return 1;
+        }
+    }
+
+    // RAM for writes, RAM, PRG-RAM and PRG-ROM for reads
+    bool isLocal(char access, uint32_t first, uint32_t last)
+    {
+        if(access == '.')
+            return true;
+        if(last < 0x2000)
+            return true;
+        return access == 'r' && first >= 0x6000 && last <= 0xFFFF;
+    }
+}
+
+DecodeCache::DecodeCache()
+{
+    m_slots.fill({nullptr, nullptr});
+}
+
+void DecodeCache::bind(Slot& slot, const uint8_t* page)
+{
+    auto& ops = m_pages[page];
+    if(!ops)
+    {
+        ops = std::make_unique<Page>();
+        ops->fill({0, 0, false, 0, 0, false});
+    }
+    slot.page = page;
+    slot.ops = ops.get();
+}
+
+DecodeCache::Op DecodeCache::decode(uint16_t pc, const uint8_t* page)
+{
+    Op op = decodeInstruction(pc, page);
+    findIdleLoop(op, pc, page);
+    if(!op.isLocal)
+        return op;
+
+    // the instructions that follow in this page, as far as they are local
+    uint8_t opcodes[fusion::MAX_LENGTH] = {op.opcode};
+    size_t count = 1;
+    for(uint16_t next = pc + op.length; count < fusion::MAX_LENGTH && (next >> 8) == (pc >> 8); )
+    {
+        Op following = decodeInstruction(next, page);
+        if(!following.isLocal)
+            break;
+        opcodes[count++] = following.opcode;
+        next += following.length;
+    }
+    op.fusion = fusion::find(opcodes, count);
+    return op;
+}
+
+DecodeCache::Op DecodeCache::decodeInstruction(uint16_t pc, const uint8_t* page)
+{
+    uint8_t offset = pc & 0xFF;
+    uint8_t opcode = page[offset];
+    char mode = MODES[opcode >> 4][opcode & 0xF];
+    char access = ACCESS[opcode >> 4][opcode & 0xF];
+    Op op{opcode, length(mode), false, 0, 0, false};
+
+    // operands in the next page may belong to another bank, BIT abs runs on its last cycle
+    if(mode == '-' || opcode == 0x2C || offset + op.length > 256)
+        return op;
+
+    uint16_t operand = (op.length == 3) ? (page[offset + 2] << 8) | page[offset + 1] : page[offset + 1];
+    switch(mode)
+    {
+        case 'i':
+        case 'r':
+            op.isLocal = true;  // the stack is in RAM
+            break;
+        case 'z':
+            op.isLocal = isLocal(access, 0x00, 0xFF);
+            break;
+        case '#':
+            op.isLocal = isLocal(access, pc + 1, pc + 1);
+            break;
+        case 'a':
+            op.isLocal = isLocal(access, operand, operand);
+            break;
+        case 'x':
+            op.isLocal = isLocal(access, operand, operand + 0xFF);
+            break;
+        case 'n':
+            op.isLocal = isLocal(access, operand & 0xFF00, operand | 0xFF);
+            break;
+        default:
+            break;  // a pointer in RAM can reach anything
+    }
+    return op;
+}
+
+void DecodeCache::findIdleLoop(Op& op, uint16_t head, const uint8_t* page)
+{
+    // the instructions from head on as long as no jump is taken, up to one jumping back
+    bool isStatus = false;
+    uint16_t pc = head;
+    for(uint8_t count = 1; count <= MAX_IDLE_LENGTH; ++count)
+    {
+        uint8_t offset = pc & 0xFF;
+        uint8_t opcode = page[offset];
+        char mode = MODES[opcode >> 4][opcode & 0xF];
+        char access = ACCESS[opcode >> 4][opcode & 0xF];
+        uint8_t size = length(mode);
+        if((pc >> 8) != (head >> 8) || offset + size > 256 || (access != 'r' && access != '.'))
+            return;
+
+        uint16_t operand = (size == 3) ? (page[offset + 2] << 8) | page[offset + 1] : page[offset + 1];
+        uint16_t target = pc + size;
+        switch(mode)
+        {
+            case 'i':
+                // the stack, interrupts and returns
+                if(opcode == 0x00 || opcode == 0x08 || opcode == 0x28 || opcode == 0x40 || opcode == 0x48 || opcode == 0x60 || opcode == 0x68)
+                    return;
+                break;
+            case 'r':
+                target = pc + 2 + int8_t(operand);
+                break;
+            case 'a':
+                if(opcode == 0x20)
+                    return;
+                if(opcode == 0x4C)
+                {
+                    if(operand != head)
+                        return;
+                    target = operand;
+                }
+                else if(access == 'r' && operand >= 0x2000 && operand < 0x6000)
+                {
+                    if(operand >= 0x4000 || (operand & 0x7) != 0x2)
+                        return;
+                    isStatus = true;
+                }
+                break;
+            case 'x':
+                if(access == 'r' && operand + 0xFF >= 0x2000 && operand < 0x6000)
+                    return;
+                break;
+            case 'z':
+            case '#':
+                break;
+            default:
+                return;     // a pointer in RAM can reach anything
+        }
+
+        if(target == head)
+        {
+            op.idleLength = count;
+            op.isIdleStatus = isStatus;
+            return;
+        }
+        pc += size;
+    }
+}
\ No newline at end of file
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "device.h"
+#include "state.h"
 #include <vector>
+#include <ostream>
 
 enum class Mode
 {
@@ -30,14 +32,14 @@ struct Dmc
     uint16_t rateCnt;
     bool irqRaised;
 
-    void clock();
+    void clock(std::ostream& log);
 
 };
 
 class Apu : public Device
 {
     public:
-        Apu();
+        Apu(std::ostream& log);
         uint8_t cpuRead(uint16_t address) override;
         void cpuWrite(uint16_t address, uint8_t data) override;
         bool isAddressInRange(uint16_t address) const override;
@@ -45,8 +47,11 @@ class Apu : public Device
         void clock();
         bool irqRaised();
         bool dmcIrqRaised();
+        void saveState(StateWriter& state) const;
+        void loadState(StateReader& state);
 
     private:
+        std::ostream& m_log;
         Mode m_mode;
         int32_t m_divider;
         int32_t m_counter;
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "device.h"
+#include "memoryMap.h"
+#include "state.h"
 
 #include <cstdint>
 #include <vector>
@@ -10,17 +12,63 @@ class Bus
 {
     public:
         Bus();
-        uint8_t read(uint16_t address);
-        void write(uint16_t address, uint8_t data);
+
+        uint8_t read(uint16_t address)
+        {
+            const auto& page = m_memoryMap.page(address);
+            if(page.read)
+                return page.read[address & 0xFF];
+            if(page.device)
+                return page.device->cpuRead(address);
+            return readRegister(address);
+        }
+
+        void write(uint16_t address, uint8_t data)
+        {
+            const auto& page = m_memoryMap.page(address);
+            if(page.write)
+            {
+                page.write[address & 0xFF] = data;
+                *page.dirty = 1;
+            }
+            else if(page.device)
+                page.device->cpuWrite(address, data);
+            else
+                writeRegister(address, data);
+        }
+
+        // host memory of the page of address when it is read-only, which is PRG-ROM
+        const uint8_t* romPage(uint16_t address) const
+        {
+            const auto& page = m_memoryMap.page(address);
+            return page.write ? nullptr : page.read;
+        }
+
+        const MemoryMap::Page* pages() const
+        {
+            return m_memoryMap.pages();
+        }
+
         void connect(Device& device);
+        // device i takes the addresses of device i on the other bus, which has to have the
+        // same kinds of devices, so they are not asked about every address again
+        void connect(const std::vector<std::reference_wrapper<Device>>& devices, const Bus& layout);
         bool isDmaRequested();
         uint8_t getHighByte();
         void clearDmaRequest();
+        void saveState(StateWriter& state) const;
+        void loadState(StateReader& state);
 
         Device& getDeviceByAddress(uint16_t address); // TODO: move to private
 
     private:
         std::vector<std::reference_wrapper<Device>> m_devices;
+        MemoryMap m_memoryMap;
         bool m_dmaRequest;
         uint8_t m_dmaHighByte;
+
+        uint8_t readRegister(uint16_t address);
+        void writeRegister(uint16_t address, uint8_t data);
+        Device* findDevice(uint16_t address);
+        void buildMemoryMap();
 };
\ No newline at end of file
@@ -2,19 +2,18 @@
 
 #include "device.h"
 #include "mapper.h"
+#include "romImage.h"
 
 #include <string>
 #include <memory>
 #include <vector>
+#include <functional>
+#include <ostream>
 
 class Cartridge : public Device
 {
     public:
-        enum class Mirroring
-        {
-            HORIZONTAL = 0,
-            VERTICAL = 1
-        };
+        using Mirroring = ::Mirroring;
 
         struct NesFileHeader
         {
@@ -25,25 +24,48 @@ class Cartridge : public Device
             bool trainer;
         };
 
-        Cartridge(const std::string& nesFile);
+        Cartridge(const std::string& nesFile, std::ostream& log);
+        Cartridge(std::shared_ptr<const RomImage> image, std::ostream& log);
 
         uint8_t cpuRead(uint16_t address) override;
         void cpuWrite(uint16_t address, uint8_t data) override;
         bool isAddressInRange(uint16_t address) const override;
+        void attach(MemoryMap& memoryMap) override;
+
+        uint8_t ppuRead(uint16_t address)
+        {
+            const uint8_t* bank = m_mapper->chrBank(address);
+            return bank ? bank[address & 0x3FF] : m_mapper->ppuRead(address);
+        }
 
-        uint8_t ppuRead(uint16_t address);
         void ppuWrite(uint16_t address, uint8_t data);
 
+        const uint16_t* tileRows(uint16_t address) const
+        {
+            return m_mapper->tileRows(address);
+        }
+
         Mirroring getMirroring();
 
         void scanline();
         bool isIrqActive();
         void clearIrq();
+        bool hasScanlineCounter();
+        void setCpuWriteCallback(std::function<void()> callback);
+        void setMirroringCallback(std::function<void(Mirroring)> callback);
+        uint64_t getRomHash() const;
+        uint8_t getMapperId() const;
+        std::shared_ptr<const RomImage> getRomImage() const;
+        void saveState(StateWriter& state) const;
+        void loadState(StateReader& state);
 
     private:
+        std::ostream& m_log;
+        std::shared_ptr<const RomImage> m_image;
         std::unique_ptr<Mapper> m_mapper;
         NesFileHeader m_nesFileHeader;
+        std::function<void()> m_cpuWriteCallback;
 
-        NesFileHeader getNesFileHeader(const std::vector<uint8_t>& data);
-        std::unique_ptr<Mapper> createMapper(const NesFileHeader& nesFileHeader, std::vector<uint8_t> prg, std::vector<uint8_t> chr);
+        NesFileHeader getNesFileHeader(RomSpan data);
+        std::unique_ptr<Mapper> createMapper(const NesFileHeader& nesFileHeader, RomSpan prg, RomSpan chr);
 };
\ No newline at end of file
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "decodeCache.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// A run of local PRG-ROM code (see DecodeCache) the way the JIT and the recompiler translate
+// it. It ends before the first instruction they do not cover and after the first one that
+// changes the flow. Cycles are the ones core::execute returns.
+class CodeBlock
+{
+    public:
+        enum class Kind
+        {
+            NONE,
+            LOAD,
+            STORE,
+            AND,
+            ORA,
+            EOR,
+            ADC,
+            SBC,
+            CMP,
+            INC,
+            DEC,
+            ASL,
+            LSR,
+            ROL,
+            ROR,
+            STEP,       // INX and friends, value is the step
+            TRANSFER,   // value is the source register
+            TSX,
+            TXS,
+            FLAG,
+            NOP,
+            BRANCH,
+            JMP,
+            JSR,
+            RTS,
+            PHA,
+            PLA
+        };
+
+        enum class Mode
+        {
+            IMPLIED,
+            ACCUMULATOR,
+            IMMEDIATE,
+            ZERO_PAGE,
+            ZERO_PAGE_X,
+            ZERO_PAGE_Y,
+            ABSOLUTE,
+            ABSOLUTE_X,
+            ABSOLUTE_Y,
+            RELATIVE
+        };
+
+        enum Register
+        {
+            A,
+            X,
+            Y
+        };
+
+        enum Flag
+        {
+            FLAG_C,
+            FLAG_V,
+            FLAG_I,
+            FLAG_D,
+            FLAG_N,
+            FLAG_Z
+        };
+
+        struct Info
+        {
+            Kind kind;
+            Mode mode;
+            uint8_t cycles;
+            bool extraCycle;    // one more when indexing crosses a page
+            int reg;            // register or flag the instruction works on
+            int value;          // source register, step or flag value
+        };
+
+        struct Op
+        {
+            uint16_t pc;
+            Info info;
+            uint16_t operand;
+            uint16_t target;        // of a branch when taken
+            uint8_t takenCycles;
+        };
+
+        static constexpr size_t MAX_INSTRUCTIONS = 32;
+
+        // page is the read-only host memory mapped at the page of pc, the block stays in it
+        CodeBlock(uint16_t pc, const uint8_t* page, DecodeCache& decodeCache);
+
+        static Info describe(uint8_t opcode);
+        static uint8_t length(Mode mode);
+        static bool isExit(Kind kind);
+
+        bool empty() const;
+        uint16_t getPc() const;
+        const std::vector<Op>& getOps() const;
+        // latest start of the last instruction, in cycles after the first
+        uint32_t getMaxStart() const;
+        // pc after the block when its last instruction does not change the flow
+        uint16_t getEnd() const;
+        // a jump back to the start may go round again without leaving the translated code,
+        // only without stack operations so SP stays in RAM whatever the number of rounds
+        bool canLoop() const;
+
+    private:
+        uint16_t m_pc;
+        std::vector<Op> m_ops;
+        uint32_t m_maxStart;
+};
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "device.h"
+#include "state.h"
 
 #include <functional>
 
@@ -11,6 +12,8 @@ class Controller : public Device
         uint8_t cpuRead(uint16_t address) override;
         void cpuWrite(uint16_t address, uint8_t data) override;
         bool isAddressInRange(uint16_t address) const override;
+        void saveState(StateWriter& state) const;
+        void loadState(StateReader& state);
 
         bool m_startPressed;
         bool m_selectPressed;
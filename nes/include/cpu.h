@@ -2,12 +2,18 @@
 
 #include "bus.h"
 #include "instruction.h"
+#include "decodeCache.h"
+#include "fusion.h"
+#include "jit.h"
 #include "controller.h" //remove it
 #include "ppu.h" // remove it
 
 #include <cstdint>
 #include <array>
 #include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
 
 struct StatusRegister
 {
@@ -40,7 +46,7 @@ struct CpuState
 class Cpu
 {
     public:
-        Cpu(Bus& bus, Controller& c, Ppu& p);
+        Cpu(Bus& bus, Controller& c, Ppu& p, std::ostream& log);
         CpuState& getState();
         uint8_t read(uint16_t address);
         void write(uint16_t address, uint8_t data);
@@ -48,18 +54,45 @@ class Cpu
         uint8_t pop();
 
         void clock();
+        uint8_t cyclesToNextAction();
+        void idle(uint8_t cycles);
         void reset();
         void nmi();
         void irq();
         uint64_t getClockTicks();
         void increaseClockTicks(uint16_t value);
         uint8_t cyclesLeft();
+        // the next instruction is in PRG-ROM and only touches RAM and ROM
+        bool isNextLocal();
+        // runs the compiled block at pc when there is one whose instructions all start within
+        // limit cycles, lastStart is when its last instruction started
+        bool runCompiled(uint32_t limit, uint32_t& lastStart);
+        // the same for a fused sequence at pc, it stops before an instruction that would start
+        // later than limit
+        bool runFused(uint32_t limit, uint32_t& lastStart);
+        // an idle loop (see DecodeCache) starts at pc
+        bool isNextIdleLoop(bool& isStatusRead);
+        // runs one round of it when that fits in limit cycles. A round that comes back to the
+        // registers it started with would be followed by the same rounds, as many of them as
+        // start within limit are only counted. PPUSTATUS has to read the same up to limit.
+        bool runIdleLoop(uint32_t limit, uint32_t& lastStart);
+        void setFusionProfile(bool enabled);
+        std::vector<fusion::Count> getFusionProfile() const;
+        void setJitMode(Jit::Mode mode);
+        Jit::Mode getJitMode() const;
+        void setPrecompiled(RomSpan image, const PrecompiledRom* rom);
         bool isPrintEnbled();
+        void setTraceFile(const std::string& path);
+        void trace(const std::string& message);
+        void saveState(StateWriter& state) const;
+        void loadState(StateReader& state);
         Controller& m_c;
         Ppu& m_ppu;
 
     private:
         Bus& m_bus;
+        std::ostream& m_log;
+        std::string m_tracePath;    // instruction trace, appended to while printing is enabled
         CpuState m_cpuState;
         bool m_enablePrint;
         uint64_t m_clockTicks;
@@ -71,6 +104,12 @@ class Cpu
         uint8_t m_cyclesLeftToPerformCurrentInstruction;
         bool m_newInstruction;
         uint64_t m_clk;
+        DecodeCache m_decodeCache;
+        Jit m_jit;
+        bool m_isFusionProfiled;
+        std::array<fusion::Count, fusion::COUNT> m_fusionCounts;
 
+        uint8_t execute(uint8_t opcode);
+        uint32_t runChecked(const Jit::Block& block, uint32_t limit, uint32_t& lastStart);
         std::string instAsBytes(uint16_t pc, uint8_t instructionSize);
 };
\ No newline at end of file
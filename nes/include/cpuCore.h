@@ -0,0 +1,1045 @@
+#pragma once
+
+#include "cpu.h"
+#include "utils.h"
+
+#include <cstdint>
+
+// Inlined counterparts of the AddressMode and Instruction classes.
+// Every (operation, address mode) pair is instantiated from execute() for the
+// CPU type, so there is no virtual call and no per-opcode heap object on the hot path.
+// Semantics and returned cycle counts follow addressModes.cpp and
+// instructions.cpp one to one; the object graph is still used for tracing.
+namespace core
+{
+    constexpr uint32_t ACCUMULATOR = 0xA0000;
+
+    // ------------------------------ address modes ------------------------------
+
+    struct Accumulator
+    {
+        template<typename C>
+        static uint32_t getAddress(C&, uint8_t& cycles)
+        {
+            cycles = 2;
+            return ACCUMULATOR;
+        }
+    };
+
+    template<uint8_t Cycles = 4>
+    struct Absolute
+    {
+        template<typename C>
+        static uint32_t getAddress(C& cpu, uint8_t& cycles)
+        {
+            auto& state = cpu.getState();
+            uint8_t ll = cpu.read(state.pc);
+            uint8_t hh = cpu.read(state.pc + 1);
+            state.pc += 2;
+            cycles = Cycles;
+            return (hh << 8) | ll;
+        }
+    };
+
+    template<uint8_t Cycles, bool ExtraCycle = true>
+    struct AbsoluteXIndexed
+    {
+        template<typename C>
+        static uint32_t getAddress(C& cpu, uint8_t& cycles)
+        {
+            auto& state = cpu.getState();
+            cycles = Cycles;
+            uint8_t ll = cpu.read(state.pc);
+            state.pc += 1;
+            uint8_t hh = cpu.read(state.pc);
+            state.pc += 1;
+
+            uint16_t addr = ((hh << 8) | ll) + state.x;
+
+            if(ExtraCycle && (addr & 0xFF00) != (hh << 8))
+                cycles += 1;
+            return addr;
+        }
+    };
+
+    template<uint8_t Cycles, bool ExtraCycle = true>
+    struct AbsoluteYIndexed
+    {
+        template<typename C>
+        static uint32_t getAddress(C& cpu, uint8_t& cycles)
+        {
+            auto& state = cpu.getState();
+            cycles = Cycles;
+            uint8_t ll = cpu.read(state.pc);
+            state.pc += 1;
+            uint8_t hh = cpu.read(state.pc);
+            state.pc += 1;
+
+            uint16_t addr = ((hh << 8) | ll) + state.y;
+
+            if(ExtraCycle && (addr & 0xFF00) != (hh << 8))
+                cycles += 1;
+            return addr;
+        }
+    };
+
+    struct Immediate
+    {
+        template<typename C>
+        static uint32_t getAddress(C& cpu, uint8_t& cycles)
+        {
+            auto& state = cpu.getState();
+            uint16_t addr = state.pc;
+            state.pc += 1;
+            cycles = 2;
+            return addr;
+        }
+    };
+
+    template<uint8_t Cycles = 2>
+    struct Implied
+    {
+        template<typename C>
+        static uint32_t getAddress(C&, uint8_t& cycles)
+        {
+            cycles = Cycles;
+            return 0x0000;
+        }
+    };
+
+    template<uint8_t Cycles = 5>
+    struct Indirect
+    {
+        template<typename C>
+        static uint32_t getAddress(C& cpu, uint8_t& cycles)
+        {
+            auto& state = cpu.getState();
+            uint8_t ll = cpu.read(state.pc);
+            state.pc += 1;
+            uint8_t hh = cpu.read(state.pc);
+            state.pc += 1;
+
+            uint16_t ptr = (hh << 8) | ll;
+            cycles = Cycles;
+
+            if(ll == 0xFF) // emulate bug
+                return (cpu.read(ptr & 0xFF00) << 8) | cpu.read(ptr + 0);
+            return (cpu.read(ptr + 1) << 8) | cpu.read(ptr);
+        }
+    };
+
+    // AddressModeIndirectX::cycles() reports 6 whatever it was constructed with,
+    // so the illegal read-modify-write opcodes registered with 8 cost 6 as well.
+    struct IndirectX
+    {
+        template<typename C>
+        static uint32_t getAddress(C& cpu, uint8_t& cycles)
+        {
+            auto& state = cpu.getState();
+            uint8_t ll = cpu.read(state.pc);
+            state.pc += 1;
+            cycles = 6;
+            return (cpu.read((ll + state.x + 1) & 0xff) << 8) | cpu.read((ll + state.x) & 0xff);
+        }
+    };
+
+    template<uint8_t Cycles = 5, bool ExtraCycle = true>
+    struct IndirectY
+    {
+        template<typename C>
+        static uint32_t getAddress(C& cpu, uint8_t& cycles)
+        {
+            auto& state = cpu.getState();
+            cycles = Cycles;
+            uint8_t ptr = cpu.read(state.pc);
+            state.pc += 1;
+
+            uint8_t ll = cpu.read(ptr);
+            uint8_t hh = cpu.read((ptr + 1) & 0xff);
+
+            uint16_t addr = ((hh << 8) | ll) + state.y;
+
+            if(ExtraCycle && (addr & 0xff00) != (hh << 8))
+                cycles += 1;
+            return addr;
+        }
+    };
+
+    struct Relative
+    {
+        template<typename C>
+        static uint32_t getAddress(C& cpu, uint8_t& cycles)
+        {
+            auto& state = cpu.getState();
+            cycles = 2;
+            uint16_t addr = cpu.read(state.pc);
+            if(addr & 0x80)
+            {
+                // negative number, which we must extend to 16bit value
+                addr = ~addr & 0xff;
+                addr = state.pc - addr;
+                cycles += ((addr & 0xff00) != (state.pc & 0xff00)) ? 2 : 1;
+                state.pc += 1;
+                return addr;
+            }
+
+            state.pc += 1;
+            addr += state.pc;
+            cycles += ((addr & 0xff00) != (state.pc & 0xff00)) ? 2 : 1;
+            return addr;
+        }
+    };
+
+    template<uint8_t Cycles = 3>
+    struct ZeroPage
+    {
+        template<typename C>
+        static uint32_t getAddress(C& cpu, uint8_t& cycles)
+        {
+            auto& state = cpu.getState();
+            uint16_t addr = cpu.read(state.pc);
+            state.pc += 1;
+            cycles = Cycles;
+            return addr & 0x00FF;
+        }
+    };
+
+    template<uint8_t Cycles = 4>
+    struct ZeroPageXIndexed
+    {
+        template<typename C>
+        static uint32_t getAddress(C& cpu, uint8_t& cycles)
+        {
+            auto& state = cpu.getState();
+            uint8_t ll = cpu.read(state.pc);
+            state.pc += 1;
+            cycles = Cycles;
+            return (ll + state.x) & 0x00FF;
+        }
+    };
+
+    struct ZeroPageYIndexed
+    {
+        template<typename C>
+        static uint32_t getAddress(C& cpu, uint8_t& cycles)
+        {
+            auto& state = cpu.getState();
+            uint8_t ll = cpu.read(state.pc);
+            state.pc += 1;
+            cycles = 4;
+            return (ll + state.y) & 0x00FF;
+        }
+    };
+
+    // ------------------------------ helpers ------------------------------
+
+    inline void setZn(CpuState& state, uint8_t value)
+    {
+        state.sr.z = (value == 0) ? 1 : 0;
+        state.sr.n = (value & 0x80) >> 7;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t branch(C& cpu, bool taken)
+    {
+        uint8_t cycles;
+        uint16_t addr = Mode::getAddress(cpu, cycles);
+        if(taken)
+        {
+            cpu.getState().pc = addr;
+            return cycles;
+        }
+        return 2;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t compare(C& cpu, uint8_t reg)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint16_t operand = cpu.read(Mode::getAddress(cpu, cycles));
+        uint16_t result = (uint16_t)reg - operand;
+
+        state.sr.n = ((result & 0x80) > 0) ? 1 : 0;
+        state.sr.z = (reg == operand) ? 1 : 0;
+        state.sr.c = (reg >= operand) ? 1 : 0;
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t load(C& cpu, uint8_t& reg)
+    {
+        uint8_t cycles;
+        reg = cpu.read(Mode::getAddress(cpu, cycles));
+        setZn(cpu.getState(), reg);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t store(C& cpu, uint8_t value)
+    {
+        uint8_t cycles;
+        cpu.write(Mode::getAddress(cpu, cycles), value);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t setFlag(C& cpu, uint8_t& flag, uint8_t value)
+    {
+        uint8_t cycles;
+        Mode::getAddress(cpu, cycles);
+        flag = value;
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t transfer(C& cpu, uint8_t& dst, uint8_t value)
+    {
+        uint8_t cycles;
+        Mode::getAddress(cpu, cycles);
+        dst = value;
+        setZn(cpu.getState(), dst);
+        return cycles;
+    }
+
+    // ------------------------------ operations ------------------------------
+
+    template<typename Mode, typename C>
+    uint8_t adc(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint16_t operand = cpu.read(Mode::getAddress(cpu, cycles));
+
+        uint16_t result = (uint16_t)state.a + operand + (uint16_t)state.sr.c;
+
+        state.sr.n = (result & 0x80) >> 7;
+        state.sr.z = ((result & 0x00FF) == 0) ? 1 : 0;
+        state.sr.c = (result > 255) ? 1 : 0;
+
+        state.sr.v = 0;
+        if((state.a & 0x80) == 0 && (operand & 0x80) == 0 && (result & 0x80) > 0)
+            state.sr.v = 1;
+        if((state.a & 0x80) > 0 && (operand & 0x80) > 0 && (result & 0x80) == 0)
+            state.sr.v = 1;
+
+        state.a = result & 0xFF;
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t and_(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        state.a = state.a & cpu.read(Mode::getAddress(cpu, cycles));
+        setZn(state, state.a);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t asl(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint32_t address = Mode::getAddress(cpu, cycles);
+        uint8_t operand = (address == ACCUMULATOR) ? state.a : cpu.read(address);
+
+        uint16_t tmp = (operand << 1);
+        state.sr.n = (tmp & 0x80) >> 7;
+        state.sr.c = (tmp > 255) ? 1 : 0;
+        tmp = tmp & 0xff;
+
+        if(address == ACCUMULATOR)
+            state.a = tmp;
+        else
+            cpu.write(address, tmp);
+
+        state.sr.z = (tmp == 0x00) ? 1 : 0;
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t bit(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint8_t operand = cpu.read(Mode::getAddress(cpu, cycles));
+        state.sr.n = (operand >> 7) & 0x1;
+        state.sr.v = (operand >> 6) & 0x1;
+        state.sr.z = ((operand & state.a) == 0) ? 1 : 0;
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t brk(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        Mode::getAddress(cpu, cycles);
+        state.sr.i = 1;
+
+        uint8_t hh = (state.pc & 0xFF00) >> 8;
+        uint8_t ll = state.pc & 0xFF;
+        cpu.write(state.sp, hh);
+        state.sp -= 1;
+        cpu.write(state.sp, ll);
+        state.sp -= 1;
+        cpu.write(state.sp, state.sr.toByte());
+        state.sp -= 1;
+
+        ll = cpu.read(0xFFFE);
+        hh = cpu.read(0xFFFF);
+        state.pc = (hh << 8) | ll;
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t dcp(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint16_t addr = Mode::getAddress(cpu, cycles);
+        uint8_t operand = cpu.read(addr);
+
+        state.sr.z = (operand == 0) ? 1 : 0;
+        state.sr.n = (operand & 0x80) >> 7;
+
+        operand -= 1;
+        uint8_t r = state.a - operand;
+        state.sr.n = r & 0x01;   // Dcp::execute tests (r & 0x80 > 0)
+
+        cpu.write(addr, operand);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t dec(C& cpu)
+    {
+        uint8_t cycles;
+        uint16_t address = Mode::getAddress(cpu, cycles);
+        uint8_t operand = cpu.read(address) - 1;
+        setZn(cpu.getState(), operand);
+        cpu.write(address, operand);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t eor(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        state.a = cpu.read(Mode::getAddress(cpu, cycles)) ^ state.a;
+        setZn(state, state.a);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t inc(C& cpu)
+    {
+        uint8_t cycles;
+        uint16_t address = Mode::getAddress(cpu, cycles);
+        uint8_t operand = cpu.read(address) + 1;
+        setZn(cpu.getState(), operand);
+        cpu.write(address, operand);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t isb(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint16_t address = Mode::getAddress(cpu, cycles);
+        uint8_t operand = cpu.read(address);
+        int o = hexToSignedInt(cpu.read(address));
+        o += 1;
+        uint8_t old_c = state.sr.c;
+
+        state.sr.z = (operand == 0) ? 1 : 0;
+
+        operand += 1;
+        cpu.write(address, operand);
+
+        state.sr.v = 0;
+        int signedVal = hexToSignedInt(state.a) - hexToSignedInt(o) - (1 - old_c);
+        state.sr.n = (signedVal < 0) ? 1 : 0;
+        if(signedVal < -128 || signedVal > 127)
+            state.sr.v = 1;
+
+        state.a = signedIntToHex(signedVal);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t jmp(C& cpu)
+    {
+        uint8_t cycles;
+        cpu.getState().pc = Mode::getAddress(cpu, cycles);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t jsr(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint16_t addr = Mode::getAddress(cpu, cycles);
+        cpu.push(((state.pc - 1) & 0xFF00) >> 8);  // -1 because address mode will move pc to the next instruction
+        cpu.push((state.pc - 1) & 0xFF);
+        state.pc = addr;
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t lax(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint8_t operand = cpu.read(Mode::getAddress(cpu, cycles));
+        state.a = operand;
+        state.x = operand;
+        setZn(state, state.a);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t lsr(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint32_t address = Mode::getAddress(cpu, cycles);
+        uint8_t operand = (address == ACCUMULATOR) ? state.a : cpu.read(address);
+
+        state.sr.c = operand & 0x01;
+        uint8_t tmp = operand >> 1;
+
+        if(address == ACCUMULATOR)
+            state.a = tmp;
+        else
+            cpu.write(address, tmp);
+
+        state.sr.n = 0;
+        state.sr.z = (tmp == 0x00) ? 1 : 0;
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t nop(C& cpu)
+    {
+        uint8_t cycles;
+        Mode::getAddress(cpu, cycles);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t ora(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        state.a = state.a | cpu.read(Mode::getAddress(cpu, cycles));
+        setZn(state, state.a);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t pha(C& cpu)
+    {
+        uint8_t cycles;
+        Mode::getAddress(cpu, cycles);
+        cpu.push(cpu.getState().a);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t php(C& cpu)
+    {
+        uint8_t cycles;
+        Mode::getAddress(cpu, cycles);
+        cpu.push(cpu.getState().sr.toByte() | (1 << 5) | (1 << 4));
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t pla(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        Mode::getAddress(cpu, cycles);
+        state.a = cpu.pop();
+        setZn(state, state.a);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t plp(C& cpu)
+    {
+        uint8_t cycles;
+        Mode::getAddress(cpu, cycles);
+        cpu.getState().sr.fromByte(cpu.pop() & 0xcf);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t rla(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint16_t address = Mode::getAddress(cpu, cycles);
+        uint8_t operand = cpu.read(address);
+
+        uint8_t old_c = state.sr.c;
+        state.sr.c = (operand & 0x80) >> 7;
+        operand = ((operand << 1) + old_c) & 0xff;
+        cpu.write(address, operand);
+
+        state.a = state.a & operand;
+        if(state.a == 0)
+            state.sr.z = 1;
+        state.sr.n = (state.a & 0x80) >> 7;
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t rol(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint32_t address = Mode::getAddress(cpu, cycles);
+        uint8_t operand = (address == ACCUMULATOR) ? state.a : cpu.read(address);
+
+        uint8_t old_c = state.sr.c;
+        state.sr.c = (operand & 0x80) >> 7;
+        operand = ((operand << 1) + old_c) & 0xff;
+
+        if(address == ACCUMULATOR)
+            state.a = operand;
+        else
+            cpu.write(address, operand);
+
+        setZn(state, operand);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t ror(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint32_t address = Mode::getAddress(cpu, cycles);
+        uint8_t operand = (address == ACCUMULATOR) ? state.a : cpu.read(address);
+
+        uint8_t old_c = state.sr.c;
+        state.sr.c = operand & 0x01;
+        operand = (operand >> 1) | (old_c << 7);
+
+        if(address == ACCUMULATOR)
+            state.a = operand;
+        else
+            cpu.write(address, operand);
+
+        setZn(state, operand);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t rra(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint16_t address = Mode::getAddress(cpu, cycles);
+        uint8_t operand = cpu.read(address);
+
+        uint8_t old_c = state.sr.c;
+        uint8_t tmp = (operand >> 1) | (old_c << 7);
+        if(old_c == 1 && ((operand & 0x01) == 1))
+            old_c = 0;
+
+        cpu.write(address, tmp);
+
+        // Rra::execute keeps the carry and works on an unsigned result,
+        // so n and z always end up cleared and v tracks bit 7
+        uint8_t result = hexToSignedInt(state.a) + hexToSignedInt(tmp) + (1 - old_c);
+        state.sr.n = 0;
+        state.sr.z = 0;
+        state.sr.v = (result > 127) ? 1 : 0;
+
+        state.a = result;
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t rti(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        Mode::getAddress(cpu, cycles);
+        uint8_t val = cpu.pop();
+
+        if((val & 0x10) == 0x10)
+            val = val & 0xef;
+        else
+            val = val | (1 << 5);
+
+        if((val & 0x20) == 0x20)
+            val = val & 0xdf;
+        else
+            val = val | (1 << 6);
+
+        state.sr.fromByte(val);
+
+        uint8_t ll = cpu.pop();
+        uint8_t hh = cpu.pop();
+        state.pc = (hh << 8) | ll;
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t rts(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        Mode::getAddress(cpu, cycles);
+        uint8_t ll = cpu.pop();
+        uint8_t hh = cpu.pop();
+        state.pc = ((hh << 8) | ll) + 1;
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t sax(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint16_t addr = Mode::getAddress(cpu, cycles);
+        cpu.read(addr);
+        cpu.write(addr, state.a & state.x);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t sbc(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        // A - M - (1 - C)
+        uint8_t operand = cpu.read(Mode::getAddress(cpu, cycles));
+        uint8_t res = signedIntToHex((int)state.a - (int)operand - (1 - (int)state.sr.c));
+        uint8_t tmp = res;
+
+        if(((state.a & 0x80) == 0) && ((operand & 0x80) > 0))
+            tmp -= 1;
+
+        state.sr.z = (res == 0) ? 1 : 0;
+        state.sr.n = (tmp & 0x80) >> 7;
+        state.sr.v = 0;
+
+        int sig_a = hexToSignedInt(state.a);
+        int sig_o = hexToSignedInt(operand);
+
+        if((state.a > operand) || (state.a == operand && state.sr.c == 1))
+            state.sr.c = 1;
+        else
+            state.sr.c = 0;
+
+        int u = sig_a - sig_o;
+        if(u > 127 || u < -128)
+            state.sr.v = 1;
+
+        state.a = res;
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t slo(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint16_t address = Mode::getAddress(cpu, cycles);
+        uint8_t operand = cpu.read(address);
+
+        state.sr.c = (operand & 0x80) >> 7;
+        operand = (operand << 1) & 0xff;
+        cpu.write(address, operand);
+
+        state.a = state.a | operand;
+        setZn(state, state.a);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t sre(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        uint16_t address = Mode::getAddress(cpu, cycles);
+        uint8_t operand = cpu.read(address);
+
+        state.sr.c = operand & 0x01;
+        operand = operand >> 1;
+        cpu.write(address, operand);
+
+        state.a = operand ^ state.a;
+        setZn(state, state.a);
+        return cycles;
+    }
+
+    template<typename Mode, typename C>
+    uint8_t tsx(C& cpu)
+    {
+        auto& state = cpu.getState();
+        return transfer<Mode>(cpu, state.x, state.sp);
+    }
+
+    template<typename Mode, typename C>
+    uint8_t txs(C& cpu)
+    {
+        auto& state = cpu.getState();
+        uint8_t cycles;
+        Mode::getAddress(cpu, cycles);
+        state.sp = state.x;
+        return cycles;
+    }
+
+    // ------------------------------ dispatch ------------------------------
+
+    template<typename C>
+    uint8_t execute(C& cpu, uint8_t opcode)
+    {
+        auto& state = cpu.getState();
+
+        switch(opcode)
+        {
+            case 0x00: return brk<Implied<7>>(cpu);
+            case 0x01: return ora<IndirectX>(cpu);
+            case 0x03: return slo<IndirectX>(cpu);
+            case 0x04: return nop<ZeroPage<>>(cpu);
+            case 0x05: return ora<ZeroPage<>>(cpu);
+            case 0x06: return asl<ZeroPage<5>>(cpu);
+            case 0x07: return slo<ZeroPage<5>>(cpu);
+            case 0x08: return php<Implied<3>>(cpu);
+            case 0x09: return ora<Immediate>(cpu);
+            case 0x0A: return asl<Accumulator>(cpu);
+            case 0x0C: return nop<Absolute<>>(cpu);
+            case 0x0D: return ora<Absolute<>>(cpu);
+            case 0x0E: return asl<Absolute<6>>(cpu);
+            case 0x0F: return slo<Absolute<6>>(cpu);
+            case 0x10: return branch<Relative>(cpu, state.sr.n == 0);
+            case 0x11: return ora<IndirectY<>>(cpu);
+            case 0x13: return slo<IndirectY<8, false>>(cpu);
+            case 0x14: return nop<ZeroPageXIndexed<>>(cpu);
+            case 0x15: return ora<ZeroPageXIndexed<>>(cpu);
+            case 0x16: return asl<ZeroPageXIndexed<6>>(cpu);
+            case 0x17: return slo<ZeroPageXIndexed<6>>(cpu);
+            case 0x18: return setFlag<Implied<>>(cpu, state.sr.c, 0);
+            case 0x19: return ora<AbsoluteYIndexed<4>>(cpu);
+            case 0x1A: return nop<Implied<>>(cpu);
+            case 0x1B: return slo<AbsoluteYIndexed<7, false>>(cpu);
+            case 0x1C: return nop<AbsoluteXIndexed<4>>(cpu);
+            case 0x1D: return ora<AbsoluteXIndexed<4>>(cpu);
+            case 0x1E: return asl<AbsoluteXIndexed<7>>(cpu);
+            case 0x1F: return slo<AbsoluteXIndexed<7, false>>(cpu);
+            case 0x20: return jsr<Absolute<6>>(cpu);
+            case 0x21: return and_<IndirectX>(cpu);
+            case 0x23: return rla<IndirectX>(cpu);
+            case 0x24: return bit<ZeroPage<>>(cpu);
+            case 0x25: return and_<ZeroPage<>>(cpu);
+            case 0x26: return rol<ZeroPage<5>>(cpu);
+            case 0x27: return rla<ZeroPage<5>>(cpu);
+            case 0x28: return plp<Implied<4>>(cpu);
+            case 0x29: return and_<Immediate>(cpu);
+            case 0x2A: return rol<Accumulator>(cpu);
+            case 0x2C: return bit<Absolute<>>(cpu);
+            case 0x2D: return and_<Absolute<>>(cpu);
+            case 0x2E: return rol<Absolute<6>>(cpu);
+            case 0x2F: return rla<Absolute<6>>(cpu);
+            case 0x30: return branch<Relative>(cpu, state.sr.n == 1);
+            case 0x31: return and_<IndirectY<>>(cpu);
+            case 0x33: return rla<IndirectY<8, false>>(cpu);
+            case 0x34: return nop<ZeroPageXIndexed<>>(cpu);
+            case 0x35: return and_<ZeroPageXIndexed<>>(cpu);
+            case 0x36: return rol<ZeroPageXIndexed<6>>(cpu);
+            case 0x37: return rla<ZeroPageXIndexed<6>>(cpu);
+            case 0x38: return setFlag<Implied<>>(cpu, state.sr.c, 1);
+            case 0x39: return and_<AbsoluteYIndexed<4>>(cpu);
+            case 0x3A: return nop<Implied<>>(cpu);
+            case 0x3B: return rla<AbsoluteYIndexed<7, false>>(cpu);
+            case 0x3C: return nop<AbsoluteXIndexed<4>>(cpu);
+            case 0x3D: return and_<AbsoluteXIndexed<4>>(cpu);
+            case 0x3E: return rol<AbsoluteXIndexed<7>>(cpu);
+            case 0x3F: return rla<AbsoluteXIndexed<7, false>>(cpu);
+            case 0x40: return rti<Implied<6>>(cpu);
+            case 0x41: return eor<IndirectX>(cpu);
+            case 0x43: return sre<IndirectX>(cpu);
+            case 0x44: return nop<ZeroPage<>>(cpu);
+            case 0x45: return eor<ZeroPage<>>(cpu);
+            case 0x46: return lsr<ZeroPage<5>>(cpu);
+            case 0x47: return sre<ZeroPage<5>>(cpu);
+            case 0x48: return pha<Implied<3>>(cpu);
+            case 0x49: return eor<Immediate>(cpu);
+            case 0x4A: return lsr<Accumulator>(cpu);
+            case 0x4C: return jmp<Absolute<3>>(cpu);
+            case 0x4D: return eor<Absolute<>>(cpu);
+            case 0x4E: return lsr<Absolute<6>>(cpu);
+            case 0x4F: return sre<Absolute<6>>(cpu);
+            case 0x50: return branch<Relative>(cpu, state.sr.v == 0);
+            case 0x51: return eor<IndirectY<>>(cpu);
+            case 0x53: return sre<IndirectY<8, false>>(cpu);
+            case 0x54: return nop<ZeroPageXIndexed<>>(cpu);
+            case 0x55: return eor<ZeroPageXIndexed<>>(cpu);
+            case 0x56: return lsr<ZeroPageXIndexed<6>>(cpu);
+            case 0x57: return sre<ZeroPageXIndexed<6>>(cpu);
+            case 0x58: return setFlag<Implied<>>(cpu, state.sr.i, 0);
+            case 0x59: return eor<AbsoluteYIndexed<4>>(cpu);
+            case 0x5A: return nop<Implied<>>(cpu);
+            case 0x5B: return sre<AbsoluteYIndexed<7, false>>(cpu);
+            case 0x5C: return nop<AbsoluteXIndexed<4>>(cpu);
+            case 0x5D: return eor<AbsoluteXIndexed<4>>(cpu);
+            case 0x5E: return lsr<AbsoluteXIndexed<7>>(cpu);
+            case 0x5F: return sre<AbsoluteXIndexed<7, false>>(cpu);
+            case 0x60: return rts<Implied<6>>(cpu);
+            case 0x61: return adc<IndirectX>(cpu);
+            case 0x63: return rra<IndirectX>(cpu);
+            case 0x64: return nop<ZeroPage<>>(cpu);
+            case 0x65: return adc<ZeroPage<>>(cpu);
+            case 0x66: return ror<ZeroPage<5>>(cpu);
+            case 0x67: return rra<ZeroPage<5>>(cpu);
+            case 0x68: return pla<Implied<4>>(cpu);
+            case 0x69: return adc<Immediate>(cpu);
+            case 0x6A: return ror<Accumulator>(cpu);
+            case 0x6C: return jmp<Indirect<5>>(cpu);
+            case 0x6D: return adc<Absolute<>>(cpu);
+            case 0x6E: return ror<Absolute<6>>(cpu);
+            case 0x6F: return rra<Absolute<6>>(cpu);
+            case 0x70: return branch<Relative>(cpu, state.sr.v == 1);
+            case 0x71: return adc<IndirectY<>>(cpu);
+            case 0x73: return rra<IndirectY<8, false>>(cpu);
+            case 0x74: return nop<ZeroPageXIndexed<>>(cpu);
+            case 0x75: return adc<ZeroPageXIndexed<>>(cpu);
+            case 0x76: return ror<ZeroPageXIndexed<6>>(cpu);
+            case 0x77: return rra<ZeroPageXIndexed<6>>(cpu);
+            case 0x78: return setFlag<Implied<>>(cpu, state.sr.i, 1);
+            case 0x79: return adc<AbsoluteYIndexed<4>>(cpu);
+            case 0x7A: return nop<Implied<>>(cpu);
+            case 0x7B: return rra<AbsoluteYIndexed<7, false>>(cpu);
+            case 0x7C: return nop<AbsoluteXIndexed<4>>(cpu);
+            case 0x7D: return adc<AbsoluteXIndexed<4>>(cpu);
+            case 0x7E: return ror<AbsoluteXIndexed<7>>(cpu);
+            case 0x7F: return rra<AbsoluteXIndexed<7, false>>(cpu);
+            case 0x80: return nop<Immediate>(cpu);
+            case 0x81: return store<IndirectX>(cpu, state.a);
+            case 0x83: return sax<IndirectX>(cpu);
+            case 0x84: return store<ZeroPage<>>(cpu, state.y);
+            case 0x85: return store<ZeroPage<>>(cpu, state.a);
+            case 0x86: return store<ZeroPage<>>(cpu, state.x);
+            case 0x87: return sax<ZeroPage<>>(cpu);
+            case 0x88: return transfer<Implied<>>(cpu, state.y, state.y - 1);
+            case 0x8A: return transfer<Implied<>>(cpu, state.a, state.x);
+            case 0x8C: return store<Absolute<>>(cpu, state.y);
+            case 0x8D: return store<Absolute<>>(cpu, state.a);
+            case 0x8E: return store<Absolute<>>(cpu, state.x);
+            case 0x8F: return sax<Absolute<>>(cpu);
+            case 0x90: return branch<Relative>(cpu, state.sr.c == 0);
+            case 0x91: return store<IndirectY<6, false>>(cpu, state.a);
+            case 0x94: return store<ZeroPageXIndexed<>>(cpu, state.y);
+            case 0x95: return store<ZeroPageXIndexed<4>>(cpu, state.a);
+            case 0x96: return store<ZeroPageYIndexed>(cpu, state.x);
+            case 0x97: return sax<ZeroPageYIndexed>(cpu);
+            case 0x98: return transfer<Implied<>>(cpu, state.a, state.y);
+            case 0x99: return store<AbsoluteYIndexed<5, false>>(cpu, state.a);
+            case 0x9A: return txs<Implied<>>(cpu);
+            case 0x9D: return store<AbsoluteXIndexed<5, false>>(cpu, state.a);
+            case 0xA0: return load<Immediate>(cpu, state.y);
+            case 0xA1: return load<IndirectX>(cpu, state.a);
+            case 0xA2: return load<Immediate>(cpu, state.x);
+            case 0xA3: return lax<IndirectX>(cpu);
+            case 0xA4: return load<ZeroPage<>>(cpu, state.y);
+            case 0xA5: return load<ZeroPage<>>(cpu, state.a);
+            case 0xA6: return load<ZeroPage<>>(cpu, state.x);
+            case 0xA7: return lax<ZeroPage<>>(cpu);
+            case 0xA8: return transfer<Implied<>>(cpu, state.y, state.a);
+            case 0xA9: return load<Immediate>(cpu, state.a);
+            case 0xAA: return transfer<Implied<>>(cpu, state.x, state.a);
+            case 0xAC: return load<Absolute<>>(cpu, state.y);
+            case 0xAD: return load<Absolute<>>(cpu, state.a);
+            case 0xAE: return load<Absolute<>>(cpu, state.x);
+            case 0xAF: return lax<Absolute<>>(cpu);
+            case 0xB0: return branch<Relative>(cpu, state.sr.c == 1);
+            case 0xB1: return load<IndirectY<>>(cpu, state.a);
+            case 0xB3: return lax<IndirectY<>>(cpu);
+            case 0xB4: return load<ZeroPageXIndexed<>>(cpu, state.y);
+            case 0xB5: return load<ZeroPageXIndexed<>>(cpu, state.a);
+            case 0xB6: return load<ZeroPageYIndexed>(cpu, state.x);
+            case 0xB7: return lax<ZeroPageYIndexed>(cpu);
+            case 0xB8: return setFlag<Implied<>>(cpu, state.sr.v, 0);
+            case 0xB9: return load<AbsoluteYIndexed<4>>(cpu, state.a);
+            case 0xBA: return tsx<Implied<>>(cpu);
+            case 0xBC: return load<AbsoluteXIndexed<4>>(cpu, state.y);
+            case 0xBD: return load<AbsoluteXIndexed<4>>(cpu, state.a);
+            case 0xBE: return load<AbsoluteYIndexed<4>>(cpu, state.x);
+            case 0xBF: return lax<AbsoluteYIndexed<4>>(cpu);
+            case 0xC0: return compare<Immediate>(cpu, state.y);
+            case 0xC1: return compare<IndirectX>(cpu, state.a);
+            case 0xC3: return dcp<IndirectX>(cpu);
+            case 0xC4: return compare<ZeroPage<>>(cpu, state.y);
+            case 0xC5: return compare<ZeroPage<>>(cpu, state.a);
+            case 0xC6: return dec<ZeroPage<5>>(cpu);
+            case 0xC7: return dcp<ZeroPage<5>>(cpu);
+            case 0xC8: return transfer<Implied<>>(cpu, state.y, state.y + 1);
+            case 0xC9: return compare<Immediate>(cpu, state.a);
+            case 0xCA: return transfer<Implied<>>(cpu, state.x, state.x - 1);
+            case 0xCB: return sax<Immediate>(cpu);
+            case 0xCC: return compare<Absolute<>>(cpu, state.y);
+            case 0xCD: return compare<Absolute<>>(cpu, state.a);
+            case 0xCE: return dec<Absolute<6>>(cpu);
+            case 0xCF: return dcp<Absolute<6>>(cpu);
+            case 0xD0: return branch<Relative>(cpu, state.sr.z == 0);
+            case 0xD1: return compare<IndirectY<>>(cpu, state.a);
+            case 0xD3: return dcp<IndirectY<8, false>>(cpu);
+            case 0xD4: return nop<ZeroPageXIndexed<>>(cpu);
+            case 0xD5: return compare<ZeroPageXIndexed<>>(cpu, state.a);
+            case 0xD6: return dec<ZeroPageXIndexed<6>>(cpu);
+            case 0xD7: return dcp<ZeroPageXIndexed<6>>(cpu);
+            case 0xD8: return setFlag<Implied<>>(cpu, state.sr.d, 0);
+            case 0xD9: return compare<AbsoluteYIndexed<4>>(cpu, state.a);
+            case 0xDA: return nop<Implied<>>(cpu);
+            case 0xDB: return dcp<AbsoluteYIndexed<7, false>>(cpu);
+            case 0xDC: return nop<AbsoluteXIndexed<4>>(cpu);
+            case 0xDD: return compare<AbsoluteXIndexed<4>>(cpu, state.a);
+            case 0xDE: return dec<AbsoluteXIndexed<7>>(cpu);
+            case 0xDF: return dcp<AbsoluteXIndexed<7, false>>(cpu);
+            case 0xE0: return compare<Immediate>(cpu, state.x);
+            case 0xE1: return sbc<IndirectX>(cpu);
+            case 0xE3: return isb<IndirectX>(cpu);
+            case 0xE4: return compare<ZeroPage<>>(cpu, state.x);
+            case 0xE5: return sbc<ZeroPage<>>(cpu);
+            case 0xE6: return inc<ZeroPage<5>>(cpu);
+            case 0xE7: return isb<ZeroPage<5>>(cpu);
+            case 0xE8: return transfer<Implied<>>(cpu, state.x, state.x + 1);
+            case 0xE9: return sbc<Immediate>(cpu);
+            case 0xEA: return nop<Implied<>>(cpu);
+            case 0xEB: return sbc<Immediate>(cpu);
+            case 0xEC: return compare<Absolute<>>(cpu, state.x);
+            case 0xED: return sbc<Absolute<>>(cpu);
+            case 0xEE: return inc<Absolute<6>>(cpu);
+            case 0xEF: return isb<Absolute<6>>(cpu);
+            case 0xF0: return branch<Relative>(cpu, state.sr.z == 1);
+            case 0xF1: return sbc<IndirectY<>>(cpu);
+            case 0xF3: return isb<IndirectY<8, false>>(cpu);
+            case 0xF4: return nop<ZeroPageXIndexed<>>(cpu);
+            case 0xF5: return sbc<ZeroPageXIndexed<>>(cpu);
+            case 0xF6: return inc<ZeroPageXIndexed<6>>(cpu);
+            case 0xF7: return isb<ZeroPageXIndexed<6>>(cpu);
+            case 0xF8: return setFlag<Implied<>>(cpu, state.sr.d, 1);
+            case 0xF9: return sbc<AbsoluteYIndexed<4>>(cpu);
+            case 0xFA: return nop<Implied<>>(cpu);
+            case 0xFB: return isb<AbsoluteYIndexed<7, false>>(cpu);
+            case 0xFC: return nop<AbsoluteXIndexed<4>>(cpu);
+            case 0xFD: return sbc<AbsoluteXIndexed<4>>(cpu);
+            case 0xFE: return inc<AbsoluteXIndexed<7>>(cpu);
+            case 0xFF: return isb<AbsoluteXIndexed<7, false>>(cpu);
+            default:
+                throw std::runtime_error("Unknown instruction :" + toHexString(opcode, 2));
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <memory>
+#include <unordered_map>
+
+// Instructions in PRG-ROM decoded once, kept per 256 byte page of host memory. Pages are
+// found by where they are in the ROM image rather than by CPU address, so a bank switch
+// needs no invalidation. Code in RAM can change and is never decoded.
+class DecodeCache
+{
+    public:
+        struct Op
+        {
+            uint8_t opcode;
+            uint8_t length;     // 0 until the instruction is decoded
+            bool isLocal;       // only touches RAM and reads ROM, nothing the PPU or a mapper sees
+            uint8_t fusion;     // index + 1 of the sequence of local instructions it starts (see fusion.h)
+            uint8_t idleLength; // instructions in a round of the idle loop it starts, 0 for none
+            bool isIdleStatus;  // the idle loop reads PPUSTATUS
+        };
+
+        // An idle loop goes round from here back to here without a jump out being taken. It
+        // only reads RAM, ROM and PPUSTATUS, changes nothing but registers and flags, and stays
+        // in this page. None of its instructions takes more than IDLE_CYCLES cycles.
+        static constexpr size_t MAX_IDLE_LENGTH = 8;
+        static constexpr uint8_t IDLE_CYCLES = 5;
+
+        DecodeCache();
+
+        // page is the read-only host memory mapped at the page of pc
+        const Op& find(uint16_t pc, const uint8_t* page)
+        {
+            auto& slot = m_slots[pc >> 8];
+            if(slot.page != page)
+                bind(slot, page);
+            Op& op = (*slot.ops)[pc & 0xFF];
+            if(op.length == 0)
+                op = decode(pc, page);
+            return op;
+        }
+
+    private:
+        using Page = std::array<Op, 256>;
+
+        struct Slot
+        {
+            const uint8_t* page;
+            Page* ops;
+        };
+
+        std::array<Slot, 256> m_slots;  // page last seen at each CPU page
+        std::unordered_map<const uint8_t*, std::unique_ptr<Page>> m_pages;
+
+        void bind(Slot& slot, const uint8_t* page);
+        static Op decode(uint16_t pc, const uint8_t* page);
+        static Op decodeInstruction(uint16_t pc, const uint8_t* page);
+        static void findIdleLoop(Op& op, uint16_t pc, const uint8_t* page);
+};
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include <cstdint>
 
+class MemoryMap;
+
 class Device
 {
     public:
@@ -9,4 +11,5 @@ class Device
         virtual uint8_t cpuRead(uint16_t address) = 0;
         virtual void cpuWrite(uint16_t address, uint8_t data) = 0;
         virtual bool isAddressInRange(uint16_t address) const = 0;
+        virtual void attach(MemoryMap& memoryMap){};
 };
\ No newline at end of file
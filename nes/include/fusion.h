@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Short runs of local instructions (see DecodeCache) that are common in game code, such as a
+// compare and its branch. They are recognised when the first one is decoded and run by one
+// handler rather than one dispatch each (see Cpu::runFused). Every instruction but the last
+// leaves the flow alone.
+namespace fusion
+{
+    constexpr size_t MAX_LENGTH = 3;
+
+    struct Sequence
+    {
+        const char* name;
+        uint8_t length;
+        uint8_t opcodes[MAX_LENGTH];
+    };
+
+    constexpr Sequence SEQUENCES[] = {
+        {"LDA #/STA zp", 2, {0xA9, 0x85}},
+        {"LDA #/STA abs", 2, {0xA9, 0x8D}},
+        {"LDA zp/STA zp", 2, {0xA5, 0x85}},
+        {"LDA abs/STA abs", 2, {0xAD, 0x8D}},
+        {"LDA abs,X/STA abs,X", 2, {0xBD, 0x9D}},
+        {"LDA abs,Y/STA abs,Y", 2, {0xB9, 0x99}},
+        {"LDA zp/BNE", 2, {0xA5, 0xD0}},
+        {"LDA zp/BEQ", 2, {0xA5, 0xF0}},
+        {"LDA abs/BPL", 2, {0xAD, 0x10}},
+        {"LDA abs/BMI", 2, {0xAD, 0x30}},
+        {"CMP #/BNE", 2, {0xC9, 0xD0}},
+        {"CMP #/BEQ", 2, {0xC9, 0xF0}},
+        {"CMP #/BCC", 2, {0xC9, 0x90}},
+        {"CMP #/BCS", 2, {0xC9, 0xB0}},
+        {"CMP zp/BNE", 2, {0xC5, 0xD0}},
+        {"CMP zp/BEQ", 2, {0xC5, 0xF0}},
+        {"CPX #/BNE", 2, {0xE0, 0xD0}},
+        {"CPY #/BNE", 2, {0xC0, 0xD0}},
+        {"DEX/BNE", 2, {0xCA, 0xD0}},
+        {"DEY/BNE", 2, {0x88, 0xD0}},
+        {"INX/BNE", 2, {0xE8, 0xD0}},
+        {"INY/BNE", 2, {0xC8, 0xD0}},
+        {"DEX/BPL", 2, {0xCA, 0x10}},
+        {"DEY/BPL", 2, {0x88, 0x10}},
+        {"DEC zp/BNE", 2, {0xC6, 0xD0}},
+        {"INC zp/LDA zp", 2, {0xE6, 0xA5}},
+        {"LDA zp/CMP #/BNE", 3, {0xA5, 0xC9, 0xD0}},
+        {"LDA zp/CMP #/BEQ", 3, {0xA5, 0xC9, 0xF0}},
+        {"LDA zp/AND #/BNE", 3, {0xA5, 0x29, 0xD0}},
+        {"LDA zp/AND #/BEQ", 3, {0xA5, 0x29, 0xF0}},
+        {"CLC/ADC #/STA zp", 3, {0x18, 0x69, 0x85}},
+        {"SEC/SBC #/STA zp", 3, {0x38, 0xE9, 0x85}}
+    };
+
+    constexpr size_t COUNT = sizeof(SEQUENCES) / sizeof(SEQUENCES[0]);
+
+    // index + 1 of the longest sequence the opcodes start with, 0 for none
+    inline uint8_t find(const uint8_t* opcodes, size_t count)
+    {
+        uint8_t found = 0;
+        for(size_t i = 0; i < COUNT; ++i)
+        {
+            const auto& sequence = SEQUENCES[i];
+            if(sequence.length > count || (found && SEQUENCES[found - 1].length >= sequence.length))
+                continue;
+            size_t k = 0;
+            while(k < sequence.length && sequence.opcodes[k] == opcodes[k])
+                ++k;
+            if(k == sequence.length)
+                found = i + 1;
+        }
+        return found;
+    }
+
+    // runs of each sequence while profiling, a run of n instructions saves n - 1 dispatches
+    struct Count
+    {
+        const char* name;
+        uint64_t runs;
+        uint64_t instructions;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "bus.h"
+#include "decodeCache.h"
+#include "romImage.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+struct CpuState;
+struct PrecompiledRom;
+
+// Optional x86-64 backend for Linux. Runs of local PRG-ROM code (see DecodeCache) that are
+// entered often enough are translated to native code, with the 6502 registers and flags in
+// host registers while a block runs. RAM and ROM are reached through the page table of the
+// bus and the cycles are charged when the block exits. Anything the translator does not
+// cover, code in RAM included, is left to the interpreter. Blocks of a ROM translated ahead
+// of time (see Recompiler) are used on every platform, without waiting for them to get hot.
+class Jit
+{
+    public:
+        enum class Mode
+        {
+            OFF,
+            ON,
+            CHECKED     // each block is run again by the interpreter and has to match
+        };
+
+        // what compiled code works on
+        struct Context
+        {
+            const MemoryMap::Page* pages;
+            Bus* bus;
+            uint32_t a;
+            uint32_t x;
+            uint32_t y;
+            int32_t sp;
+            uint32_t c;
+            uint32_t v;
+            uint32_t nz;        // Z when the low byte is 0, N is bit 7 xor bit 8
+            uint32_t pc;
+            uint8_t i;
+            uint8_t d;
+            uint32_t limit;     // latest start of an instruction, in cycles after the first
+            uint32_t cycles;
+            uint32_t lastStart;
+        };
+
+        struct Block
+        {
+            void (*code)(Context*);
+            uint16_t pc;
+            uint32_t maxStart;  // latest start of its last instruction, in cycles after the first
+        };
+
+        Jit(Bus& bus, DecodeCache& decodeCache);
+        ~Jit();
+        Jit(const Jit&) = delete;
+        Jit& operator=(const Jit&) = delete;
+
+        static bool isSupported();
+        void setMode(Mode mode);
+        Mode getMode() const;
+        // blocks translated ahead of time from image, nullptr for none
+        void setPrecompiled(RomSpan image, const PrecompiledRom* rom);
+
+        // block at pc on the given host page of PRG-ROM, nullptr until it was entered often
+        // enough and when it cannot be translated
+        const Block* find(uint16_t pc, const uint8_t* page)
+        {
+            auto& slot = m_slots[pc >> 8];
+            if(slot.page != page)
+                bind(slot, pc >> 8, page);
+            Entry& entry = (*slot.entries)[pc & 0xFF];
+            if(entry.visits > HOT_VISITS)
+                return entry.block;
+            if(++entry.visits > HOT_VISITS)
+                entry.block = compile(pc, page);
+            return entry.block;
+        }
+
+        // every instruction of the block has to start at most limit cycles after its first one,
+        // returns the cycles it took
+        uint32_t run(const Block& block, CpuState& state, uint32_t limit, uint32_t& lastStart);
+
+    private:
+        static constexpr uint16_t HOT_VISITS = 16;
+
+        struct Entry
+        {
+            const Block* block;
+            uint16_t visits;
+        };
+
+        using Entries = std::array<Entry, 256>;
+
+        struct Slot
+        {
+            const uint8_t* page;
+            Entries* entries;
+        };
+
+        Bus& m_bus;
+        DecodeCache& m_decodeCache;
+        Mode m_mode;
+        std::array<Slot, 256> m_slots;  // entries of the page last seen at each CPU page
+        std::map<std::pair<const uint8_t*, uint8_t>, std::unique_ptr<Entries>> m_entries;
+        std::vector<std::unique_ptr<Block>> m_blocks;
+        RomSpan m_image;
+        const PrecompiledRom* m_precompiled;
+        std::vector<uint8_t*> m_chunks;     // executable memory, the last one is being filled
+        size_t m_chunkUsed;
+
+        void bind(Slot& slot, uint8_t cpuPage, const uint8_t* page);
+        const Block* compile(uint16_t pc, const uint8_t* page);
+        void* install(const std::vector<uint8_t>& code);
+};
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "cpu.h"
+#include "cartridge.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <functional>
+#include <ostream>
+
+// Experimental: the CPUs of many copies of one NROM game, kept as one array per register
+// with a lane per copy. The lanes at the same PC as the lane furthest behind run each
+// instruction together, common opcodes as loops over all lanes that the compiler can turn
+// into vector code, everything else one lane at a time through core::execute.
+// Only the CPU is emulated, PPU, APU and controller registers go to the callbacks.
+class LockstepCpu
+{
+    public:
+        using ReadCallback = std::function<uint8_t(size_t lane, uint16_t address)>;
+        using WriteCallback = std::function<void(size_t lane, uint16_t address, uint8_t data)>;
+
+        struct Stats
+        {
+            uint64_t groups{0};         // instructions issued, each for the lanes at one PC
+            uint64_t vectorLanes{0};    // lane instructions run by the vector path
+            uint64_t scalarLanes{0};    // lane instructions run one lane at a time
+
+            // share of lane instructions that left the vector path
+            double divergence() const;
+        };
+
+        LockstepCpu(const std::string& nesFile, size_t numLanes, ReadCallback read, WriteCallback write, std::streambuf* log = nullptr);
+
+        void reset();
+        // every lane runs at least this many cycles further
+        void run(uint64_t cycles);
+        void nmi(size_t lane);
+        void irq(size_t lane);
+
+        CpuState getState(size_t lane) const;
+        uint64_t getCycles(size_t lane) const;
+        uint8_t readRam(size_t lane, uint16_t address) const;
+        size_t size() const;
+
+        // off runs every lane through the scalar path, for comparing the two
+        void setVectorized(bool isVectorized);
+        const Stats& getStats() const;
+        void clearStats();
+
+    private:
+        enum class Mode
+        {
+            IMMEDIATE,
+            ZERO_PAGE,
+            ABSOLUTE
+        };
+
+        struct Lane;
+
+        std::ostream m_log;
+        Cartridge m_cartridge;
+        std::vector<uint8_t> m_prg;     // $8000-$FFFF, also seen at $4020-$7FFF like Mapper000 does
+        size_t m_numLanes;
+        ReadCallback m_read;
+        WriteCallback m_write;
+
+        std::vector<uint16_t> m_pc;
+        std::vector<uint8_t> m_a;
+        std::vector<uint8_t> m_x;
+        std::vector<uint8_t> m_y;
+        std::vector<int> m_sp;
+        std::vector<uint8_t> m_n;
+        std::vector<uint8_t> m_v;
+        std::vector<uint8_t> m_unused;
+        std::vector<uint8_t> m_b;
+        std::vector<uint8_t> m_d;
+        std::vector<uint8_t> m_i;
+        std::vector<uint8_t> m_z;
+        std::vector<uint8_t> m_c;
+        std::vector<uint64_t> m_cycles;
+        std::vector<uint8_t> m_ram;     // byte a of lane l at a * numLanes + l
+
+        std::vector<uint64_t> m_targets;
+        std::vector<uint8_t> m_mask;    // 1 for the lanes of the current group
+        std::vector<uint8_t> m_operand;
+        bool m_isVectorized;
+        Stats m_stats;
+
+        static uint8_t length(Mode mode);
+        static uint8_t cycles(Mode mode);
+
+        bool stepGroup();
+        bool stepVector(uint16_t pc);
+        void stepScalar(size_t lane);
+
+        uint16_t operandAddress(Mode mode, uint16_t pc) const;
+        bool loadOperand(Mode mode, uint16_t pc);
+        uint8_t* ramRow(uint16_t address);
+        void finish(uint16_t pc, uint8_t cycles);
+        void setZn(const uint8_t* value);
+
+        bool load(std::vector<uint8_t>& reg, Mode mode, uint16_t pc);
+        bool store(const std::vector<uint8_t>& reg, Mode mode, uint16_t pc);
+        bool logic(uint8_t opcode, Mode mode, uint16_t pc);
+        bool adc(Mode mode, uint16_t pc);
+        bool compare(const std::vector<uint8_t>& reg, Mode mode, uint16_t pc);
+        bool modify(int8_t delta, Mode mode, uint16_t pc);
+        bool transfer(std::vector<uint8_t>& dst, const std::vector<uint8_t>& src, int8_t delta, uint16_t pc);
+        bool setFlag(std::vector<uint8_t>& flag, uint8_t value, uint16_t pc);
+        bool branch(const std::vector<uint8_t>& flag, uint8_t value, uint16_t pc);
+};
\ No newline at end of file
@@ -1,6 +1,25 @@
 #pragma once
 
+#include "tileCache.h"
+#include "state.h"
+
 #include <cstdint>
+#include <cstring>
+#include <array>
+#include <memory>
+#include <vector>
+#include <functional>
+
+class MemoryMap;
+
+enum class Mirroring
+{
+    HORIZONTAL = 0,
+    VERTICAL = 1,
+    SINGLE_SCREEN_A = 2,
+    SINGLE_SCREEN_B = 3,
+    FOUR_SCREEN = 4
+};
 
 class Mapper
 {
@@ -13,4 +32,161 @@ class Mapper
         virtual void scanline(){};
         virtual bool isIrqActive(){return false;};
         virtual void clearIrq(){};
+        virtual bool hasScanlineCounter(){return false;};
+
+        void attach(MemoryMap& memoryMap)
+        {
+            m_memoryMap = &memoryMap;
+            updateMemoryMap();
+        }
+
+        void setTileCache(std::shared_ptr<TileCache> tileCache)
+        {
+            m_tileCache = std::move(tileCache);
+            updateChrMap();
+        }
+
+        Mirroring getMirroring() const
+        {
+            return m_mirroring;
+        }
+
+        void setMirroring(Mirroring mirroring)
+        {
+            m_mirroring = mirroring;
+            if(m_mirroringCallback)
+                m_mirroringCallback(mirroring);
+        }
+
+        void setMirroringCallback(std::function<void(Mirroring)> callback)
+        {
+            m_mirroringCallback = std::move(callback);
+        }
+
+        // decoded rows of the tile at a pattern table address, nullptr when the mapper does not publish CHR
+        const uint16_t* tileRows(uint16_t address) const
+        {
+            const uint16_t* page = m_chrPages[(address >> 10) & 0x7];
+            return page ? page + (address & 0x3F0) : nullptr;
+        }
+
+        // 1kB CHR window holding a pattern table address, nullptr when reads go through ppuRead
+        const uint8_t* chrBank(uint16_t address) const
+        {
+            return m_chrBanks[(address >> 10) & 0x7];
+        }
+
+        // CHR-RAM is part of the state, CHR-ROM is not even after it has been written to
+        void saveState(StateWriter& state) const
+        {
+            state.write(m_mirroring);
+            if(m_isChrRam)
+                state.writePages(m_chrRam.data(), m_chrDirty.data(), m_chrSize / STATE_PAGE_SIZE);
+            saveRegisters(state);
+        }
+
+        void loadState(StateReader& state)
+        {
+            Mirroring mirroring;
+            state.read(mirroring);
+            setMirroring(mirroring);
+            if(m_isChrRam)
+            {
+                // only tiles that differ are copied and decoded again
+                RomSpan chr{m_chrRam.data(), m_chrSize};
+                state.readPages(m_chrSize / STATE_PAGE_SIZE, [this, chr](size_t page, const uint8_t* bytes) {
+                    for(uint32_t offset = page * STATE_PAGE_SIZE; offset < (page + 1) * STATE_PAGE_SIZE; offset += 16, bytes += 16)
+                    {
+                        if(std::memcmp(bytes, &m_chrRam[offset], 16) == 0)
+                            continue;
+                        std::memcpy(&m_chrRam[offset], bytes, 16);
+                        m_chrDirty[page] = 1;
+                        for(uint32_t row = 0; m_tileCache && row < 8; ++row)
+                            m_tileCache->write(offset + row, chr);
+                    }
+                });
+                if(!state.keepsDirtyFlags())
+                    m_chrDirty.fill(0);
+            }
+            loadRegisters(state);
+            updateMemoryMap();
+            updateChrMap();
+        }
+
+    protected:
+        // publishes the currently selected PRG banks as host pointers
+        virtual void updateMemoryMap(){};
+
+        // bank registers and PRG-RAM, the banks are published again after loading
+        virtual void saveRegisters(StateWriter& state) const{};
+        virtual void loadRegisters(StateReader& state){};
+
+        // publishes the currently selected CHR banks, by default 8kB not switched
+        virtual void updateChrMap()
+        {
+            for(uint8_t page = 0; page < 8; ++page)
+                mapChr(page, page * 0x400);
+        }
+
+        // CHR-ROM stays shared with the ROM image, an empty span gives the mapper 8kB of CHR-RAM
+        void setChrMemory(RomSpan chr)
+        {
+            if(chr.empty())
+            {
+                m_chrRam.assign(0x2000, 0);
+                m_isChrRam = true;
+                chr = RomSpan{m_chrRam.data(), static_cast<uint32_t>(m_chrRam.size())};
+            }
+            m_chrMemory = chr.data();
+            m_chrSize = chr.size();
+        }
+
+        uint8_t readChr(uint32_t offset) const
+        {
+            return m_chrMemory[offset % m_chrSize];
+        }
+
+        void mapChr(uint8_t page, uint32_t offset)
+        {
+            m_chrPages[page] = m_tileCache ? m_tileCache->rows(offset) : nullptr;
+            m_chrBanks[page] = m_chrMemory ? m_chrMemory + (offset % m_chrSize) : nullptr;
+        }
+
+        // a write to CHR-ROM makes a private copy of it first, the same goes for a shared tile cache
+        void writeChr(uint32_t offset, uint8_t data)
+        {
+            bool isCopied = false;
+            if(m_chrRam.empty())
+            {
+                m_chrRam.assign(m_chrMemory, m_chrMemory + m_chrSize);
+                m_chrMemory = m_chrRam.data();
+                isCopied = true;
+            }
+            m_chrRam[offset % m_chrSize] = data;
+            m_chrDirty[(offset % m_chrSize) >> 8] = 1;
+
+            RomSpan chr{m_chrRam.data(), m_chrSize};
+            if(m_tileCache && m_tileCache->isShared())
+            {
+                m_tileCache = std::make_shared<TileCache>(chr);
+                isCopied = true;
+            }
+            else if(m_tileCache)
+                m_tileCache->write(offset % m_chrSize, chr);
+
+            if(isCopied)
+                updateChrMap();
+        }
+
+        MemoryMap* m_memoryMap{nullptr};
+        Mirroring m_mirroring{Mirroring::HORIZONTAL};
+        std::function<void(Mirroring)> m_mirroringCallback;
+        std::shared_ptr<TileCache> m_tileCache;
+        std::array<const uint16_t*, 8> m_chrPages{};
+        std::array<const uint8_t*, 8> m_chrBanks{};
+        const uint8_t* m_chrMemory{nullptr};
+        uint32_t m_chrSize{0};
+        std::vector<uint8_t> m_chrRam;  // CHR-RAM, or CHR-ROM once it has been written
+        bool m_isChrRam{false};
+        mutable std::array<uint8_t, 32> m_chrDirty{};   // CHR-RAM pages written since the last snapshot
 };
\ No newline at end of file
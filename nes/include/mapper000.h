@@ -7,7 +7,7 @@
 class Mapper000 : public Mapper
 {
     public:
-        Mapper000(std::vector<uint8_t> prg, uint8_t numPrgBlocks, std::vector<uint8_t> chr);
+        Mapper000(RomSpan prg, uint8_t numPrgBlocks, RomSpan chr);
         
         uint16_t cpuRead(uint16_t address) override;
         void cpuWrite(uint16_t address, uint8_t data) override;
@@ -15,7 +15,8 @@ class Mapper000 : public Mapper
         void ppuWrite(uint16_t address, uint8_t data) override;
     
     private:
-        std::vector<uint8_t> m_prg;
+        RomSpan m_prg;
         uint8_t m_numBlocks;
-        std::vector<uint8_t> m_chr;
+
+        void updateMemoryMap() override;
 };
\ No newline at end of file
@@ -7,7 +7,7 @@
 class Mapper001 : public Mapper
 {
     public:
-        Mapper001(std::vector<uint8_t> prg, uint8_t numPrgBlocks, std::vector<uint8_t> chr, uint8_t numChr);
+        Mapper001(RomSpan prg, uint8_t numPrgBlocks, RomSpan chr, uint8_t numChr);
         
         uint16_t cpuRead(uint16_t address) override;
         void cpuWrite(uint16_t address, uint8_t data) override;
@@ -15,9 +15,8 @@ class Mapper001 : public Mapper
         void ppuWrite(uint16_t address, uint8_t data) override;
     
     private:
-        std::vector<uint8_t> m_prg;
+        RomSpan m_prg;
         uint8_t m_numBlocks;
-        std::vector<uint8_t> m_chr;
         uint8_t m_numChr;
         uint8_t m_sr;
         uint8_t m_writeCounter;
@@ -36,6 +35,11 @@ class Mapper001 : public Mapper
         uint8_t m_numChrBanks;
 
         std::vector<uint8_t> m_ram;
+        mutable std::array<uint8_t, 32> m_ramDirty;    // pages written since the last snapshot
 
         void internalWrite(uint16_t address, uint8_t data);
+        void updateMemoryMap() override;
+        void saveRegisters(StateWriter& state) const override;
+        void loadRegisters(StateReader& state) override;
+        void updateChrMap() override;
 };
\ No newline at end of file
@@ -4,11 +4,12 @@
 
 #include <vector>
 #include <array>
+#include <ostream>
 
 class Mapper004 : public Mapper
 {
     public:
-        Mapper004(std::vector<uint8_t> prg, uint8_t numPrgBlocks, std::vector<uint8_t> chr, uint8_t numChr);
+        Mapper004(RomSpan prg, uint8_t numPrgBlocks, RomSpan chr, uint8_t numChr, std::ostream& log);
 
         uint16_t cpuRead(uint16_t address) override;
         void cpuWrite(uint16_t address, uint8_t data) override;
@@ -17,13 +18,15 @@ class Mapper004 : public Mapper
         void scanline() override;
         bool isIrqActive();
         void clearIrq();
+        bool hasScanlineCounter() override;
 
     private:
-        std::vector<uint8_t> m_prg;
-        std::vector<uint8_t> m_chr;
+        std::ostream& m_log;
+        RomSpan m_prg;
         uint8_t m_numBlocks;
         uint8_t m_numChrBanks;
         std::vector<uint8_t> m_ram;
+        mutable std::array<uint8_t, 32> m_ramDirty;    // pages written since the last snapshot
         
         uint8_t m_prgMode;
         uint8_t m_chrMode;
@@ -34,4 +37,9 @@ class Mapper004 : public Mapper
         bool m_irqActive;
 
         std::array<uint8_t, 8> m_r;
+
+        void updateMemoryMap() override;
+        void saveRegisters(StateWriter& state) const override;
+        void loadRegisters(StateReader& state) override;
+        void updateChrMap() override;
 };
\ No newline at end of file
@@ -7,7 +7,7 @@
 class Mapper071 : public Mapper
 {
     public:
-        Mapper071(std::vector<uint8_t> prg, uint8_t numPrgBlocks, std::vector<uint8_t> chr);
+        Mapper071(RomSpan prg, uint8_t numPrgBlocks, RomSpan chr);
 
         uint16_t cpuRead(uint16_t address) override;
         void cpuWrite(uint16_t address, uint8_t data) override;
@@ -15,8 +15,11 @@ class Mapper071 : public Mapper
         void ppuWrite(uint16_t address, uint8_t data) override;
 
     private:
-        std::vector<uint8_t> m_prg;
+        RomSpan m_prg;
         uint8_t m_numBlocks;
-        std::vector<uint8_t> m_chr;
         uint16_t m_selectedBank;
+
+        void updateMemoryMap() override;
+        void saveRegisters(StateWriter& state) const override;
+        void loadRegisters(StateReader& state) override;
 };
\ No newline at end of file
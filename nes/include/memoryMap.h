@@ -0,0 +1,47 @@
+#pragma once
+
+#include "device.h"
+
+#include <cstdint>
+#include <array>
+#include <memory>
+#include <vector>
+
+class MemoryMap
+{
+    public:
+        struct Page
+        {
+            const uint8_t* read;    // host memory backing the page, nullptr for I/O
+            uint8_t* write;         // nullptr when writes go to the device (ROM, registers)
+            uint8_t* dirty;         // flag set on every write through the write pointer
+            Device* device;         // handler used when there is no host pointer
+            Device** registers;     // per address handlers when devices share the page
+        };
+
+        MemoryMap();
+
+        const Page& page(uint16_t address) const
+        {
+            return m_pages[address >> 8];
+        }
+
+        // all 256 pages, for code that indexes them itself
+        const Page* pages() const
+        {
+            return m_pages.data();
+        }
+
+        void mapDevice(uint8_t page, Device* device);
+        void mapRegister(uint16_t address, Device* device);
+        // dirty points at one flag per 256 bytes of data, for snapshots of what changed
+        void mapMemory(uint16_t first, uint16_t last, uint8_t* data, uint32_t size, bool writable, uint8_t* dirty = nullptr);
+        void mapMemory(uint16_t first, uint16_t last, const uint8_t* data, uint32_t size);
+        void unmapMemory(uint16_t first, uint16_t last);
+        void clear();
+
+    private:
+        std::array<Page, 256> m_pages;
+        std::vector<std::unique_ptr<std::array<Device*, 256>>> m_registers;
+        uint8_t m_dirtySink;    // for writable memory nobody tracks
+};
\ No newline at end of file
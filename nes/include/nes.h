@@ -7,24 +7,95 @@
 #include "apu.h"
 #include "cartridge.h"
 #include "ppu.h"
+#include "videoOutput.h"
+#include "rewind.h"
 
 #include <string>
+#include <iostream>
 #include <functional>
+#include <memory>
+#include <vector>
+#include <chrono>
 #include <cstdint>
+#include <cstddef>
 
 class Nes
 {
     public:
-        Nes(const std::string& nesFile, std::function<uint8_t()> btnStateGetter, std::function<void(const uint32_t*)> frameUpdate);
+        // messages of this machine go to the log buffer, nullptr drops them
+        Nes(const std::string& nesFile, std::function<uint8_t()> btnStateGetter, std::function<void(const uint32_t*)> frameUpdate, std::streambuf* log = std::cout.rdbuf());
 
+        // start() never returns, the others stop at the end of a step of the scheduler, one CPU
+        // instruction at most, once the condition holds. Frames ending on the way are delivered.
+        // The runUntil functions return false when maxCycles CPU cycles pass first.
         void start();
+        void runFrame();
+        void runCycles(uint64_t cycles);
+        bool runUntil(const std::function<bool()>& predicate, uint64_t maxCycles);
+        bool runUntilPc(uint16_t pc, uint64_t maxCycles);
+        bool runUntilScanline(int scanline, uint64_t maxCycles);
         void reset();
+        void setVideoOutput(VideoOutput::PixelFormat format, std::function<void(const void*)> frameUpdate);
+        void setLog(std::streambuf* log);
+        void setTraceFile(const std::string& path);
+        void setHeadless(bool headless, uint32_t renderInterval);
+        // hot code in PRG-ROM runs as native code where Jit::isSupported(), and so does code
+        // of a ROM recompiled ahead of time and linked in (see Recompiler) on any platform.
+        // CHECKED runs every block through the interpreter as well and throws when they disagree
+        void setJit(Jit::Mode mode);
+        // Counts the runs of each fused sequence of instructions (see fusion.h) from now on,
+        // the profile is empty while it is off
+        void setFusionProfile(bool enabled);
+        std::vector<fusion::Count> getFusionProfile() const;
+
+        // An independent machine in the same state, for trying other inputs from here. The ROM
+        // and decoded CHR-ROM stay shared, CHR-ROM is copied by the first machine writing to it
+        // and everything else the game can change is copied now. The child keeps the log, the
+        // pixel format, the headless setting and the JIT mode but has no rewind history and no
+        // run-ahead, compiled code is not shared.
+        // It may run on another thread, this machine must not be running while it is cloned.
+        std::unique_ptr<Nes> clone(std::function<uint8_t()> btnStateGetter, std::function<void(const void*)> frameUpdate);
+
+        // Snapshots of the whole machine, the size is fixed for a cartridge. They can be
+        // taken and restored from the frame callback. A delta only holds the memory pages
+        // written since the previous snapshot and is loaded on top of that one.
+        size_t stateSize();
+        size_t saveState(uint8_t* data, size_t size);
+        size_t saveStateDelta(uint8_t* data, size_t size);
+        void loadState(const uint8_t* data, size_t size);
+
+        // Records a snapshot at the end of every frame, history stops at maxFrames or when the
+        // arena is full, 0 frames turns it off. rewind() returns the frames it went back, called
+        // from the frame callback rewind(1) restarts the frame that was just delivered.
+        void setRewind(uint32_t maxFrames, size_t arenaSize);
+        uint32_t rewind(uint32_t frames);
+
+        // Totals since run-ahead was set, frameNs is the frame that is kept, the rest is the
+        // cost of running ahead.
+        struct RunAheadCost
+        {
+            uint64_t frames;
+            uint64_t frameNs;
+            uint64_t snapshotNs;
+            uint64_t aheadNs;
+            uint64_t restoreNs;
+        };
+
+        // Each frame is followed by the given number of frames with the same input, the last of
+        // them is the one delivered and the machine goes back to where it was. 0 turns it off.
+        void setRunAhead(uint32_t frames);
+        const RunAheadCost& getRunAheadCost() const;
 
     private:
+        // the bus of a clone copies the address layout of its parent
+        Nes(std::shared_ptr<const RomImage> image, std::function<uint8_t()> btnStateGetter, std::function<void(const uint32_t*)> frameUpdate, std::streambuf* log, const Nes* parent);
+
+        std::ostream m_log;     // own stream so formatting flags are not shared with other machines
         Controller m_controller;
         Bus m_bus;
         Cartridge m_cartridge;
         Ppu m_ppu;
+        VideoOutput m_videoOutput;
         Cpu m_cpu;
         Ram m_ram;
         Apu m_apu;
@@ -33,4 +104,26 @@ class Nes
         uint8_t m_dmaData;
         uint16_t m_dmaOffset;
         bool m_dummyDma;
+        uint64_t m_cpuDot;
+        uint64_t m_localEndDot;  // runs of local code stop before it, 0 for one instruction per step
+        bool m_isFrameDone;
+        bool m_isFrameReady;     // the frame was drawn
+        std::unique_ptr<Rewind> m_rewind;
+        uint32_t m_runAhead;
+        std::vector<uint8_t> m_runAheadState;
+        std::vector<uint8_t> m_cloneState;
+        RunAheadCost m_runAheadCost;
+        std::chrono::steady_clock::time_point m_frameStart;
+
+        bool advance();
+        void step();
+        void runLocalCode();
+        bool runIdleLoop(uint64_t dot, uint64_t endDot, uint32_t& lastStart);
+        void emulateFrame();
+        void endFrame();
+        void runAhead();
+        void clockCpu();
+        void pollInterrupts();
+        void saveState(StateWriter& state);
+        void loadState(StateReader& state);
 };
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "nes.h"
+#include "videoOutput.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+// Independent machines stepped a frame at a time by a pool of threads. Each thread starts on
+// the same range of machines every frame and steals from the back of the other ranges once
+// its own is done, so a machine mostly stays on one thread.
+class NesBatch
+{
+    public:
+        // 0 threads is one per hardware thread, machine messages are dropped
+        NesBatch(const std::vector<std::string>& nesFiles, size_t numThreads, VideoOutput::PixelFormat format);
+        ~NesBatch();
+
+        // inputs holds the buttons of each machine, the frame of machine i is written at
+        // observations + i * observationSize() and is left as it was when it is not drawn
+        void stepFrame(const uint8_t* inputs, void* observations);
+
+        size_t observationSize() const;
+        size_t size() const;
+        Nes& operator[](size_t index);
+
+    private:
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<size_t> queue;
+        };
+
+        std::vector<std::unique_ptr<Nes>> m_machines;
+        std::vector<uint8_t> m_inputs;
+        uint8_t* m_observations;
+        size_t m_observationSize;
+        std::vector<std::unique_ptr<Worker>> m_workers;
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_start;
+        std::condition_variable m_done;
+        uint64_t m_generation;
+        size_t m_remaining;
+        bool m_isStopping;
+        std::exception_ptr m_error;
+
+        void run(size_t worker);
+        bool next(size_t worker, size_t& machine);
+};
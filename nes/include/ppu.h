@@ -2,11 +2,13 @@
 
 #include "device.h"
 #include "cartridge.h"
+#include "state.h"
 
 #include <cstdint>
 #include <array>
 #include <vector>
 #include <functional>
+#include <ostream>
 
 struct Ppuctrl
 {
@@ -65,58 +67,35 @@ struct VramRegister
 class TileHelper
 {
     public:
-        TileHelper(uint16_t lower, uint16_t upper):
-        m_lower{lower}, m_upper{upper}
+        TileHelper(uint32_t pixels):
+        m_pixels{pixels}
         {
 
         }
 
-        void writeLower(uint16_t lower){
-            m_lower = lower;
+        void write(uint32_t pixels){
+            m_pixels = pixels;
         }
 
-
-        void writeLowerL(uint8_t lower){
-            m_lower = (m_lower & 0xFF00) | lower;
-        }
-
-        void writeUpper(uint16_t upper){
-            m_upper = upper;
-        }
-
-        void writeUpperL(uint8_t upper) {
-            m_upper = (m_upper & 0xFF00) | upper;
+        void writeLow(uint16_t pixels){
+            m_pixels = (m_pixels & 0xFFFF0000) | pixels;
         }
 
         uint8_t shift() {
-            uint8_t b1 = (m_lower & 0x8000) > 0;
-            uint8_t b2 = (m_upper & 0x8000) > 0;
-            m_lower <<= 1;
-            m_upper <<= 1;
-            return (b2 << 1) | b1;
+            uint8_t pixel = m_pixels >> 30;
+            m_pixels <<= 2;
+            return pixel;
         }
 
         uint8_t shiftBitSelect(uint8_t fineX)
         {
-            m_lower <<= 1;
-            m_upper <<= 1;
-
-            uint16_t bitSelect = (0x8000 >> fineX);
-            uint8_t b1 = (m_lower & bitSelect) > 0;
-            uint8_t b2 = (m_upper & bitSelect) > 0;
-            return (b2 << 1) | b1;
+            m_pixels <<= 2;
+            return (m_pixels >> (30 - 2 * fineX)) & 0x3;
         }
 
 
     private:
-        uint16_t m_lower;
-        uint16_t m_upper;
-};
-
-struct TileRow
-{
-    uint8_t lower;
-    uint8_t upper;
+        uint32_t m_pixels;  // 16 pixels, 2 bits each, as decoded by TileCache
 };
 
 struct Pixel
@@ -141,14 +120,21 @@ struct OamData
 class Ppu : public Device
 {
     public:
-        Ppu(Cartridge& cartridge, std::function<void(const uint32_t*)> frameUpdate);
+        Ppu(Cartridge& cartridge, std::function<void(const uint8_t*)> frameUpdate, std::ostream& log);
 
         uint8_t cpuRead(uint16_t address) override;
         void cpuWrite(uint16_t address, uint8_t data) override;
         bool isAddressInRange(uint16_t address) const override;
 
         void clock();
-        const std::vector<uint32_t>& getScreenData();
+        void setCurrentDot(uint64_t dot);
+        void sync();
+        uint64_t nextEventDot();
+        // first dot a PPUSTATUS read may return other flags on or do more than one now does,
+        // the PPU has to be synced
+        uint64_t nextStatusDot();
+        const std::vector<uint8_t>& getScreenData();
+        const std::array<uint32_t, 64>& getPalette();
         void reset();
         bool isAddressValid(uint16_t address);
         bool isNmiRaised();
@@ -158,11 +144,18 @@ class Ppu : public Device
         uint8_t readOamData(uint8_t address);
         uint16_t getCycle();
         int getScanline();
+        void setMirroring(Cartridge::Mirroring mirroring);
+        void setRenderInterval(uint32_t interval);
+        uint32_t getRenderInterval() const;
+        void setRendering(bool isRendering);
+        void saveState(StateWriter& state) const;
+        void loadState(StateReader& state);
 
         bool m_raiseNmiNextIns;
 
     private:
         Cartridge& m_cartridge;
+        std::ostream& m_log;
 
         uint16_t m_cycle;
         int m_scanline;
@@ -177,6 +170,11 @@ class Ppu : public Device
 
         std::array<uint8_t, 1024> m_nt0;
         std::array<uint8_t, 1024> m_nt1;
+        std::array<uint8_t, 1024> m_nt2;    // only used by four screen carts
+        std::array<uint8_t, 1024> m_nt3;
+        std::array<uint8_t*, 4> m_nameTables;   // $2000, $2400, $2800, $2C00 after mirroring
+        std::array<uint8_t, 4> m_nameTableIndex;    // which of m_nt0-m_nt3 each one is
+        mutable std::array<uint8_t, 16> m_nameTableDirty;   // pages written since the last snapshot
         std::array<uint8_t, 32> m_paletteRam;
 
         TileHelper m_th;
@@ -191,13 +189,14 @@ class Ppu : public Device
 
         uint16_t m_paletteBaseAddr;
 
-        TileRow m_nextTileData;
+        uint16_t m_nextTileData;
 
         uint8_t m_bgPixel;
 
         bool m_raiseNmi;
 
-        std::vector<uint32_t> m_frameData;
+        std::vector<uint8_t> m_frameData;    // palette index of each pixel
+        mutable std::array<uint8_t, 240> m_frameDirty;  // lines drawn since the last snapshot
         std::array<uint32_t, 64> m_palette;
 
         uint8_t m_lastWrittenData;
@@ -212,10 +211,13 @@ class Ppu : public Device
         uint8_t m_oamAddr;
         std::array<OamData, 8> m_secondaryOam;
         uint8_t m_numSecondarySprites;
-        std::array<uint8_t, 8> m_secondaryOamNumPixelToDraw;
-        std::array<uint8_t, 8> m_secondaryOamXCounter;
         std::array<uint8_t, 8> m_secondaryOamAttrBytes;
-        std::array<TileHelper, 8> m_sh;
+        std::array<uint8_t, 256> m_spriteLine;  // last sprite over each step, 0x80 | palette << 2 | colour, 0 when none
+        std::array<uint8_t, 256> m_spriteFront; // last opaque sprite with priority in front of the background
+        std::array<uint8_t, 256> m_spriteZero;  // opaque pixel of a sprite with the tile of sprite 0
+        uint16_t m_spriteDot;                   // steps of the sprite x counters taken on this line
+        bool m_isSpriteLineUsed;
+        bool m_isSpriteZeroOnLine;
 
         TileHelper m_nextAttribDataH;
         uint8_t m_nextAttribData;
@@ -223,16 +225,26 @@ class Ppu : public Device
         bool m_vblankFlagRead;
         uint8_t m_fineX;
         uint64_t m_frameNum;
-        std::function<void(const uint32_t*)> m_frameUpdate;
+        uint64_t m_dots;
+        uint64_t m_currentDot;
+        uint64_t m_nextEventDot;
+        std::function<void(const uint8_t*)> m_frameUpdate;
+        uint32_t m_renderInterval;  // frames are rendered and delivered every Nth frame, 0 for never
+        bool m_isRendering;         // headless otherwise, only what the CPU can observe is kept
 
         uint8_t readVideoMem(uint16_t address);
-        TileRow getTileData(uint8_t tileNum, uint8_t row, uint8_t half);
+        uint16_t getTileData(uint8_t tileNum, uint8_t row, uint8_t half, bool flip);
         void getPaletteIdx();
         void clearSecondaryOam();
         void fillSecondaryOam(int y);
-        void decrementSpriteXCounters();
-        void fillSpritesShiftRegisters(int y);
+        void drawSpritePixel();
+        void writePixel(uint32_t pixel, uint8_t idx);
+        void fillSpriteLine(int y);
         void debug();
+        void updateNextEvent();
+        void fetchBackground();
+        void renderScanline();
+        bool isLineIdle();
 };
 
 uint8_t reverseBits(uint8_t val);
\ No newline at end of file
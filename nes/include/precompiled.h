@@ -0,0 +1,217 @@
+#pragma once
+
+#include "jit.h"
+
+#include <cstdint>
+#include <cstddef>
+
+// Blocks of one ROM translated to C++ by Recompiler, compiled and linked with the core.
+// They are found by the hash of the ROM image and run like the ones of the JIT.
+struct PrecompiledBlock
+{
+    uint32_t offset;    // of the first instruction in the ROM image
+    Jit::Block block;
+};
+
+struct PrecompiledRom
+{
+    uint64_t hash;
+    const PrecompiledBlock* blocks;     // by offset, then pc
+    size_t numBlocks;
+};
+
+namespace precompiled
+{
+    // called by the generated code when the program starts
+    bool add(const PrecompiledRom& rom);
+    const PrecompiledRom* find(uint64_t hash);
+
+    // The registers of a Jit::Context in locals while a block runs, and the operations the
+    // generated code is made of. They do what the JIT emits for the same instructions.
+    class Machine
+    {
+        public:
+            explicit Machine(Jit::Context* context)
+            : a{context->a}
+            , x{context->x}
+            , y{context->y}
+            , sp{context->sp}
+            , c{context->c}
+            , v{context->v}
+            , nz{context->nz}
+            , cycles{0}
+            , m_context{context}
+            {
+
+            }
+
+            uint32_t a;
+            uint32_t x;
+            uint32_t y;
+            int32_t sp;
+            uint32_t c;
+            uint32_t v;
+            uint32_t nz;
+            uint32_t cycles;
+
+            // before the last instruction of a block
+            void last()
+            {
+                m_context->lastStart = cycles;
+            }
+
+            // a jump back to the start of the block may go round again
+            bool fits(uint32_t maxStart) const
+            {
+                return cycles + maxStart <= m_context->limit;
+            }
+
+            void exit(uint16_t pc)
+            {
+                m_context->pc = pc;
+                m_context->a = a;
+                m_context->x = x;
+                m_context->y = y;
+                m_context->sp = sp;
+                m_context->c = c;
+                m_context->v = v;
+                m_context->nz = nz;
+                m_context->cycles = cycles;
+            }
+
+            uint8_t readRam(uint16_t address) const
+            {
+                return m_context->pages[address >> 8].read[address & 0xFF];
+            }
+
+            uint8_t read(uint16_t address) const
+            {
+                const uint8_t* page = m_context->pages[address >> 8].read;
+                return page ? page[address & 0xFF] : m_context->bus->read(address);
+            }
+
+            void write(uint16_t address, uint8_t value)
+            {
+                const auto& page = m_context->pages[address >> 8];
+                page.write[address & 0xFF] = value;
+                *page.dirty = 1;
+            }
+
+            uint16_t zeroPage(uint8_t base, uint32_t index) const
+            {
+                return (base + index) & 0xFF;
+            }
+
+            uint16_t absolute(uint16_t base, uint32_t index, bool extraCycle)
+            {
+                if(extraCycle && index > 0xFFu - (base & 0xFF))
+                    cycles += 1;
+                return (base + index) & 0xFFFF;
+            }
+
+            bool n() const
+            {
+                return ((nz >> 7) ^ (nz >> 8)) & 1;
+            }
+
+            bool z() const
+            {
+                return (nz & 0xFF) == 0;
+            }
+
+            void setI(uint8_t value)
+            {
+                m_context->i = value;
+            }
+
+            void setD(uint8_t value)
+            {
+                m_context->d = value;
+            }
+
+            void adc(uint8_t value)
+            {
+                uint32_t result = a + value + c;
+                v = (((a ^ result) & (value ^ result)) >> 7) & 1;
+                c = result >> 8;
+                a = result & 0xFF;
+                nz = a;
+            }
+
+            // core::sbc, which takes N from the result less one when A is positive and the operand negative
+            void sbc(uint8_t value)
+            {
+                int32_t result = int32_t(a) - value + int32_t(c) - 1;
+                c = result >= 0;
+                int32_t difference = int8_t(a) - int8_t(value);
+                v = difference < -128 || difference > 127;
+                uint32_t low = result & 0xFF;
+                uint32_t borrow = ((~a & value) >> 7) & 1;
+                nz = ((((low - borrow) ^ low) & 0x80) << 1) | low;
+                a = low;
+            }
+
+            void compare(uint32_t reg, uint8_t value)
+            {
+                c = reg >= value;
+                nz = (reg - value) & 0xFF;
+            }
+
+            uint8_t inc(uint8_t value)
+            {
+                nz = (value + 1) & 0xFF;
+                return nz;
+            }
+
+            uint8_t dec(uint8_t value)
+            {
+                nz = (value - 1) & 0xFF;
+                return nz;
+            }
+
+            uint8_t asl(uint8_t value)
+            {
+                c = value >> 7;
+                nz = (value << 1) & 0xFF;
+                return nz;
+            }
+
+            uint8_t lsr(uint8_t value)
+            {
+                c = value & 1;
+                nz = value >> 1;
+                return nz;
+            }
+
+            uint8_t rol(uint8_t value)
+            {
+                nz = ((value << 1) | c) & 0xFF;
+                c = value >> 7;
+                return nz;
+            }
+
+            uint8_t ror(uint8_t value)
+            {
+                nz = (c << 7) | (value >> 1);
+                c = value & 1;
+                return nz;
+            }
+
+            void push(uint8_t value)
+            {
+                write(sp | 0x100, value);
+                sp -= 1;
+                if(sp < 0)
+                    sp = 0xFF;
+            }
+
+            uint8_t pop()
+            {
+                sp += 1;
+                return readRam(sp | 0x100);
+            }
+
+        private:
+            Jit::Context* m_context;
+    };
+}
\ No newline at end of file
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "device.h"
+#include "state.h"
 
 #include <vector>
+#include <array>
 
 class Ram : public Device
 {
@@ -11,7 +13,11 @@ class Ram : public Device
         uint8_t cpuRead(uint16_t address) override;
         void cpuWrite(uint16_t address, uint8_t data) override;
         bool isAddressInRange(uint16_t address) const override;
+        void attach(MemoryMap& memoryMap) override;
+        void saveState(StateWriter& state) const;
+        void loadState(StateReader& state);
 
     private:
         std::vector<uint8_t> m_data;
+        mutable std::array<uint8_t, 8> m_dirty;    // pages written since the last snapshot
 };
\ No newline at end of file
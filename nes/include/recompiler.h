@@ -0,0 +1,49 @@
+#pragma once
+
+#include "codeBlock.h"
+#include "decodeCache.h"
+#include "romImage.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Translates the PRG-ROM code of a ROM to C++ ahead of time, block by block as the JIT does.
+// The code is found by following the flow from the NMI, reset and IRQ vectors. Which bank a
+// switchable window holds is guessed: $C000-$FFFF is the last 16KB, $8000-$BFFF stays in its
+// bank while the flow does and is any bank when it comes from elsewhere. A wrong guess only
+// costs code, blocks are run only where the bytes they were made from are mapped. Anything
+// reached through a pointer, code in RAM included, stays with the interpreter.
+class Recompiler
+{
+    public:
+        explicit Recompiler(const std::string& nesFile);
+
+        // a translation unit registering the blocks for the hash of the ROM (see precompiled.h)
+        void write(std::ostream& out) const;
+        size_t getNumBlocks() const;
+
+    private:
+        struct Location
+        {
+            uint32_t base;  // offset in the image of the 16KB window holding pc
+            uint16_t pc;
+        };
+
+        std::shared_ptr<const RomImage> m_image;
+        uint32_t m_prgStart;
+        uint32_t m_prgSize;
+        uint8_t m_mapperId;
+        DecodeCache m_decodeCache;
+        std::map<std::pair<uint32_t, uint16_t>, CodeBlock> m_blocks;    // by offset in the image, then pc
+
+        void walk();
+        void follow(const Location& from, uint16_t target, std::vector<Location>& pending) const;
+        const uint8_t* page(const Location& at) const;
+        uint8_t byte(const Location& at, uint16_t pc) const;
+};
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// History of the last frames in an arena allocated once. Only the newest snapshot is kept
+// whole, every older frame is the XOR with the one after it, run length coded over 8 byte
+// words. Stepping back n frames applies the n newest records, the oldest ones are dropped
+// when the arena or the record ring is full.
+class Rewind
+{
+    public:
+        Rewind(size_t stateSize, size_t arenaSize, uint32_t maxFrames);
+
+        // buffer for the snapshot of the frame that just ended, push() records it
+        uint8_t* nextState();
+        void push();
+
+        // returns the number of frames stepped back, the state it lands on is in state()
+        uint32_t stepBack(uint32_t frames);
+        const uint8_t* state() const;
+        size_t stateSize() const;
+        uint32_t numFrames() const;
+
+    private:
+        struct Record
+        {
+            size_t offset;
+            size_t size;
+        };
+
+        size_t m_stateSize;
+        size_t m_numWords;
+        std::vector<uint8_t> m_arena;
+        std::vector<Record> m_records;  // ring, the oldest at m_first
+        size_t m_first;
+        size_t m_count;
+        size_t m_head;                  // arena offset after the newest record
+        std::vector<uint64_t> m_state;  // newest snapshot
+        std::vector<uint64_t> m_next;
+        std::vector<uint8_t> m_encoded;
+        bool m_hasState;
+
+        size_t encode();
+        void decode(const Record& record);
+        void store(size_t size);
+        void dropOldest();
+};
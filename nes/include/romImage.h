@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <memory>
+
+// read-only view of a part of a ROM image
+class RomSpan
+{
+    public:
+        RomSpan() = default;
+
+        RomSpan(const uint8_t* data, uint32_t size)
+        : m_data{data}
+        , m_size{size}
+        {
+
+        }
+
+        const uint8_t* data() const
+        {
+            return m_data;
+        }
+
+        uint32_t size() const
+        {
+            return m_size;
+        }
+
+        bool empty() const
+        {
+            return m_size == 0;
+        }
+
+        const uint8_t& operator[](uint32_t index) const
+        {
+            return m_data[index];
+        }
+
+        RomSpan sub(uint32_t offset, uint32_t size) const;
+
+    private:
+        const uint8_t* m_data{nullptr};
+        uint32_t m_size{0};
+};
+
+class RomImage
+{
+    public:
+        ~RomImage();
+        RomImage(const RomImage&) = delete;
+        RomImage& operator=(const RomImage&) = delete;
+
+        // the file is mapped read-only, images with the same content are shared by the whole process
+        static std::shared_ptr<const RomImage> load(const std::string& filePath);
+
+        RomSpan data() const;
+        uint64_t hash() const;
+
+    private:
+        RomImage(void* mapping, size_t size);
+
+        void* m_mapping;
+        size_t m_size;
+        uint64_t m_hash;
+};
\ No newline at end of file
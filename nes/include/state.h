@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+// Snapshots are a fixed sequence of raw values in host layout, written by each component in
+// turn. A writer without a buffer only counts the bytes, which is how the state size is found.
+//
+// Memory is stored in pages of 256 bytes, each group of 8 pages is preceded by a mask of the
+// pages present. A full snapshot has all of them, a delta only the pages written since the
+// previous snapshot, which the components flag in their dirty arrays.
+constexpr size_t STATE_PAGE_SIZE = 256;
+
+enum StateFlags : uint8_t
+{
+    STATE_DELTA = 1,        // only the pages written since the previous snapshot
+    STATE_KEEP_DIRTY = 2,   // leaves the base of the next delta as it is, a load flags what it changes
+    STATE_NO_PICTURE = 4    // the rendered picture is left out, it is drawn again by the next frame
+};
+
+class StateWriter
+{
+    public:
+        StateWriter(uint8_t* data, size_t size, uint8_t flags = 0)
+        : m_data{data}
+        , m_size{size}
+        , m_offset{0}
+        , m_flags{flags}
+        {
+
+        }
+
+        void write(const void* data, size_t size)
+        {
+            if(m_data)
+            {
+                if(size > m_size - m_offset)
+                    throw std::runtime_error("StateWriter::write() Buffer too small:" + std::to_string(m_size));
+                std::memcpy(m_data + m_offset, data, size);
+            }
+            m_offset += size;
+        }
+
+        template<typename T>
+        void write(const T& value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "state values are copied as raw bytes");
+            write(&value, sizeof(T));
+        }
+
+        // the dirty flags are cleared once the pages are written to a buffer, pages that are
+        // not included only take up their masks
+        void writePages(const uint8_t* data, uint8_t* dirty, size_t numPages, bool isIncluded = true)
+        {
+            for(size_t first = 0; first < numPages; first += 8)
+            {
+                uint8_t mask = 0;
+                for(size_t i = 0; i < 8 && first + i < numPages; ++i)
+                {
+                    if(isIncluded && (!isDelta() || dirty[first + i]))
+                        mask |= 1 << i;
+                }
+                write(mask);
+                for(size_t i = 0; i < 8; ++i)
+                {
+                    if(mask & (1 << i))
+                        write(data + (first + i) * STATE_PAGE_SIZE, STATE_PAGE_SIZE);
+                }
+            }
+            if(m_data && isIncluded && !(m_flags & STATE_KEEP_DIRTY))
+                std::memset(dirty, 0, numPages);
+        }
+
+        // overwrites a value written before, e.g. a size only known at the end
+        template<typename T>
+        void rewrite(size_t offset, const T& value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "state values are copied as raw bytes");
+            if(m_data)
+                std::memcpy(m_data + offset, &value, sizeof(T));
+        }
+
+        size_t size() const
+        {
+            return m_offset;
+        }
+
+        bool isDelta() const
+        {
+            return m_flags & STATE_DELTA;
+        }
+
+        bool hasPicture() const
+        {
+            return !(m_flags & STATE_NO_PICTURE);
+        }
+
+    private:
+        uint8_t* m_data;
+        size_t m_size;
+        size_t m_offset;
+        uint8_t m_flags;
+};
+
+class StateReader
+{
+    public:
+        StateReader(const uint8_t* data, size_t size, uint8_t flags = 0)
+        : m_data{data}
+        , m_size{size}
+        , m_offset{0}
+        , m_flags{flags}
+        {
+
+        }
+
+        void read(void* data, size_t size)
+        {
+            std::memcpy(data, next(size), size);
+        }
+
+        template<typename T>
+        void read(T& value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "state values are copied as raw bytes");
+            read(&value, sizeof(T));
+        }
+
+        // calls apply(page, bytes) for each page in the snapshot
+        template<typename F>
+        void readPages(size_t numPages, F&& apply)
+        {
+            for(size_t first = 0; first < numPages; first += 8)
+            {
+                uint8_t mask = 0;
+                read(mask);
+                for(size_t i = 0; i < 8 && first + i < numPages; ++i)
+                {
+                    if(mask & (1 << i))
+                        apply(first + i, next(STATE_PAGE_SIZE));
+                }
+            }
+        }
+
+        // the memory matches the snapshot afterwards, so no page is dirty relative to it
+        void readPages(uint8_t* data, uint8_t* dirty, size_t numPages)
+        {
+            bool keepsDirty = keepsDirtyFlags();
+            readPages(numPages, [data, dirty, keepsDirty](size_t page, const uint8_t* bytes) {
+                uint8_t* target = data + page * STATE_PAGE_SIZE;
+                if(keepsDirty && std::memcmp(target, bytes, STATE_PAGE_SIZE) != 0)
+                    dirty[page] = 1;
+                std::memcpy(target, bytes, STATE_PAGE_SIZE);
+            });
+            if(!keepsDirty)
+                std::memset(dirty, 0, numPages);
+        }
+
+        // of the whole snapshot buffer
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        bool keepsDirtyFlags() const
+        {
+            return m_flags & STATE_KEEP_DIRTY;
+        }
+
+        // the next bytes in place, for data that is compared before it is copied
+        const uint8_t* next(size_t size)
+        {
+            if(size > m_size - m_offset)
+                throw std::runtime_error("StateReader::read() Truncated state, size:" + std::to_string(m_size));
+            const uint8_t* data = m_data + m_offset;
+            m_offset += size;
+            return data;
+        }
+
+    private:
+        const uint8_t* m_data;
+        size_t m_size;
+        size_t m_offset;
+        uint8_t m_flags;
+};
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "romImage.h"
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+
+class TileCache
+{
+    public:
+        explicit TileCache(RomSpan chr);
+
+        // CHR-ROM is decoded once and shared by every cartridge using the same ROM image
+        static std::shared_ptr<TileCache> shared(std::shared_ptr<const RomImage> image, RomSpan chr);
+
+        // 2 bits per pixel, leftmost pixel in the top bits
+        static uint16_t decodeRow(uint8_t lower, uint8_t upper, bool flip);
+
+        // 16 rows per tile, the 8 rows as stored followed by the 8 horizontally flipped ones
+        const uint16_t* rows(uint32_t offset) const
+        {
+            return &m_rows[((offset % m_size) >> 4) << 4];
+        }
+
+        void write(uint32_t offset, RomSpan chr);
+        bool isShared() const;
+
+    private:
+        std::vector<uint16_t> m_rows;
+        uint32_t m_size;
+        bool m_isShared;
+        std::shared_ptr<const RomImage> m_image;    // keeps the decoded CHR-ROM mapped
+
+        void decode(uint32_t offset, RomSpan chr);
+};
\ No newline at end of file
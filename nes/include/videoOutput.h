@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <functional>
+
+class VideoOutput
+{
+    public:
+        enum class PixelFormat
+        {
+            INDEXED = 0,    // 6 bit palette index per byte, as rendered by the PPU
+            XRGB8888 = 1,   // native uint32_t 0x00RRGGBB
+            RGBA8888 = 2,
+            BGRA8888 = 3,
+            RGB565 = 4,     // native uint16_t
+            GRAYSCALE = 5
+        };
+
+        VideoOutput(const std::array<uint32_t, 64>& palette, PixelFormat format, std::function<void(const void*)> frameUpdate);
+
+        // converts a frame of palette indices and hands it to the consumer
+        void present(const uint8_t* indices);
+
+        PixelFormat getFormat() const;
+
+        static uint8_t bytesPerPixel(PixelFormat format);
+
+    private:
+        PixelFormat m_format;
+        std::function<void(const void*)> m_frameUpdate;
+        std::array<std::array<uint8_t, 4>, 64> m_lut;   // bytes of each palette index in the output format
+        std::vector<uint32_t> m_frame;
+
+        template<uint8_t N>
+        void convert(const uint8_t* indices);
+};
\ No newline at end of file
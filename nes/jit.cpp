@@ -0,0 +1,1004 @@
+#include "include/jit.h"
+#include "include/codeBlock.h"
+#include "include/cpu.h"
+#include "include/precompiled.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <initializer_list>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define NES_JIT_SUPPORTED 1
+#else
+#define NES_JIT_SUPPORTED 0
+#endif
+
+namespace
+{
+    constexpr size_t CHUNK_SIZE = 1 << 20;
+    constexpr size_t MAX_CHUNKS = 16;
+
+    enum Reg
+    {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15
+    };
+
+    // where the 6502 lives while a block runs, all callee-saved except the flags and the cycles
+    constexpr int REG_A = R12;
+    constexpr int REG_X = R13;
+    constexpr int REG_Y = R14;
+    constexpr int REG_SP = R15;
+    constexpr int REG_NZ = R8;
+    constexpr int REG_C = R9;
+    constexpr int REG_V = R10;
+    constexpr int REG_CYCLES = R11;
+    constexpr int REG_CONTEXT = RBX;
+    constexpr int REG_PAGES = RBP;
+
+    enum Condition
+    {
+        CC_B = 2,
+        CC_AE = 3,
+        CC_E = 4,
+        CC_NE = 5,
+        CC_BE = 6,
+        CC_A = 7,
+        CC_S = 8,
+        CC_NS = 9
+    };
+
+    // just the x86-64 encodings the translator needs, 32 bit operations unless named otherwise
+    class Assembler
+    {
+        public:
+            std::vector<uint8_t> code;
+
+            size_t pos() const
+            {
+                return code.size();
+            }
+
+            void byte(uint8_t value)
+            {
+                code.push_back(value);
+            }
+
+            void dword(uint32_t value)
+            {
+                for(int i = 0; i < 4; ++i)
+                    byte(value >> (8 * i));
+            }
+
+            // op r/m, reg with both in registers, as in mov, add, or, and, sub, xor, cmp, test
+            void rr(uint8_t op, int rm, int reg, bool wide = false)
+            {
+                rex(wide, reg, 0, rm, false);
+                byte(op);
+                byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+            }
+
+            void mov(int dst, int src)
+            {
+                rr(0x89, dst, src);
+            }
+
+            // op reg, [base + index + disp], index -1 for none
+            void mem(std::initializer_list<uint8_t> op, int reg, int base, int32_t disp, int index = -1, bool wide = false, bool byteReg = false)
+            {
+                rex(wide, reg, index < 0 ? 0 : index, base, byteReg && reg >= 4 && reg < 8);
+                for(auto b : op)
+                    byte(b);
+                if(index < 0 && (base & 7) != 4)
+                    byte(0x80 | ((reg & 7) << 3) | (base & 7));
+                else
+                {
+                    byte(0x80 | ((reg & 7) << 3) | 4);
+                    byte((((index < 0) ? 4 : index) & 7) << 3 | (base & 7));
+                }
+                dword(disp);
+            }
+
+            void load(int dst, int base, int32_t disp, int index = -1)
+            {
+                mem({0x8B}, dst, base, disp, index);
+            }
+
+            void load64(int dst, int base, int32_t disp, int index = -1)
+            {
+                mem({0x8B}, dst, base, disp, index, true);
+            }
+
+            void loadByte(int dst, int base, int32_t disp, int index = -1)
+            {
+                mem({0x0F, 0xB6}, dst, base, disp, index);
+            }
+
+            void store(int base, int32_t disp, int src)
+            {
+                mem({0x89}, src, base, disp);
+            }
+
+            void storeByte(int base, int32_t disp, int src, int index = -1)
+            {
+                mem({0x88}, src, base, disp, index, false, true);
+            }
+
+            void storeByte(int base, int32_t disp, uint8_t value)
+            {
+                mem({0xC6}, 0, base, disp);
+                byte(value);
+            }
+
+            void compare(int reg, int base, int32_t disp)
+            {
+                mem({0x3B}, reg, base, disp);
+            }
+
+            void lea(int dst, int base, int32_t disp)
+            {
+                mem({0x8D}, dst, base, disp);
+            }
+
+            // add 0, or 1, and 4, sub 5, xor 6, cmp 7
+            void alu(int ext, int reg, int32_t value)
+            {
+                rex(false, 0, 0, reg, false);
+                byte(0x81);
+                byte(0xC0 | (ext << 3) | (reg & 7));
+                dword(value);
+            }
+
+            void add(int reg, int32_t value)
+            {
+                alu(0, reg, value);
+            }
+
+            void and_(int reg, int32_t value)
+            {
+                alu(4, reg, value);
+            }
+
+            void cmp(int reg, int32_t value)
+            {
+                alu(7, reg, value);
+            }
+
+            void shl(int reg, uint8_t count)
+            {
+                rex(false, 0, 0, reg, false);
+                byte(0xC1);
+                byte(0xE0 | (reg & 7));
+                byte(count);
+            }
+
+            void shr(int reg, uint8_t count)
+            {
+                rex(false, 0, 0, reg, false);
+                byte(0xC1);
+                byte(0xE8 | (reg & 7));
+                byte(count);
+            }
+
+            void not_(int reg)
+            {
+                rex(false, 0, 0, reg, false);
+                byte(0xF7);
+                byte(0xD0 | (reg & 7));
+            }
+
+            void imul(int dst, int src, int32_t value)
+            {
+                rex(false, dst, 0, src, false);
+                byte(0x69);
+                byte(0xC0 | ((dst & 7) << 3) | (src & 7));
+                dword(value);
+            }
+
+            void movzxByte(int dst, int src)
+            {
+                rex(false, dst, 0, src, src >= 4 && src < 8);
+                byte(0x0F);
+                byte(0xB6);
+                byte(0xC0 | ((dst & 7) << 3) | (src & 7));
+            }
+
+            void movzxWord(int dst, int src)
+            {
+                rex(false, dst, 0, src, false);
+                byte(0x0F);
+                byte(0xB7);
+                byte(0xC0 | ((dst & 7) << 3) | (src & 7));
+            }
+
+            void movsxByte(int dst, int src)
+            {
+                rex(false, dst, 0, src, src >= 4 && src < 8);
+                byte(0x0F);
+                byte(0xBE);
+                byte(0xC0 | ((dst & 7) << 3) | (src & 7));
+            }
+
+            void set(Condition cc, int reg)
+            {
+                rex(false, 0, 0, reg, reg >= 4 && reg < 8);
+                byte(0x0F);
+                byte(0x90 | cc);
+                byte(0xC0 | (reg & 7));
+            }
+
+            void testByte(int reg, uint8_t value)
+            {
+                rex(false, 0, 0, reg, reg >= 4 && reg < 8);
+                byte(0xF6);
+                byte(0xC0 | (reg & 7));
+                byte(value);
+            }
+
+            void movImm(int reg, uint32_t value)
+            {
+                rex(false, 0, 0, reg, false);
+                byte(0xB8 | (reg & 7));
+                dword(value);
+            }
+
+            void movImm64(int reg, uint64_t value)
+            {
+                rex(true, 0, 0, reg, false);
+                byte(0xB8 | (reg & 7));
+                dword(value);
+                dword(value >> 32);
+            }
+
+            void push(int reg)
+            {
+                rex(false, 0, 0, reg, false);
+                byte(0x50 | (reg & 7));
+            }
+
+            void pop(int reg)
+            {
+                rex(false, 0, 0, reg, false);
+                byte(0x58 | (reg & 7));
+            }
+
+            void call(int reg)
+            {
+                rex(false, 0, 0, reg, false);
+                byte(0xFF);
+                byte(0xD0 | (reg & 7));
+            }
+
+            // returns where the displacement goes, for bind()
+            size_t jump(Condition cc)
+            {
+                byte(0x0F);
+                byte(0x80 | cc);
+                dword(0);
+                return pos() - 4;
+            }
+
+            size_t jump()
+            {
+                byte(0xE9);
+                dword(0);
+                return pos() - 4;
+            }
+
+            void jumpTo(size_t target)
+            {
+                byte(0xE9);
+                dword(target - (pos() + 4));
+            }
+
+            void bind(size_t at)
+            {
+                bind(at, pos());
+            }
+
+            void bind(size_t at, size_t target)
+            {
+                uint32_t displacement = target - (at + 4);
+                std::memcpy(&code[at], &displacement, 4);
+            }
+
+        private:
+            void rex(bool wide, int reg, int index, int base, bool force)
+            {
+                uint8_t prefix = 0x40 | (wide << 3) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+                if(prefix != 0x40 || force)
+                    byte(prefix);
+            }
+    };
+
+    using Kind = CodeBlock::Kind;
+    using Mode = CodeBlock::Mode;
+
+    int host(int reg)
+    {
+        constexpr int HOST[] = {REG_A, REG_X, REG_Y};
+        return HOST[reg];
+    }
+
+    uint8_t readBus(Jit::Context* context, uint32_t address);
+
+    class Translator
+    {
+        public:
+            Translator(const CodeBlock& block)
+            : m_block{block}
+            , m_ops{block.getOps()}
+            , m_isNzWide{true}
+            , m_loopStart{0}
+            {
+
+            }
+
+            std::vector<uint8_t> translate()
+            {
+                prologue();
+                m_loopStart = m_asm.pos();
+                for(size_t i = 0; i < m_ops.size(); ++i)
+                {
+                    const auto& in = m_ops[i];
+                    if(i + 1 == m_ops.size())
+                        m_asm.store(REG_CONTEXT, offsetof(Jit::Context, lastStart), REG_CYCLES);
+                    m_asm.add(REG_CYCLES, in.info.cycles);
+                    instruction(in);
+                }
+                if(!CodeBlock::isExit(m_ops.back().info.kind))
+                    exit(m_block.getEnd());
+                epilogue();
+                return std::move(m_asm.code);
+            }
+
+        private:
+            const CodeBlock& m_block;
+            const std::vector<CodeBlock::Op>& m_ops;
+            Assembler m_asm;
+            bool m_isNzWide;    // bit 8 of the NZ register may be set
+            size_t m_loopStart;
+            std::vector<size_t> m_exits;
+
+            static int32_t pageOffset(uint16_t address, size_t field)
+            {
+                return (address >> 8) * sizeof(MemoryMap::Page) + field;
+            }
+
+            void prologue()
+            {
+                for(int reg : {RBX, RBP, R12, R13, R14, R15})
+                    m_asm.push(reg);
+                m_asm.code.insert(m_asm.code.end(), {0x48, 0x83, 0xEC, 0x08});    // sub rsp, 8
+                m_asm.rr(0x89, RBX, RDI, true);
+                m_asm.load64(REG_PAGES, REG_CONTEXT, offsetof(Jit::Context, pages));
+                m_asm.load(REG_A, REG_CONTEXT, offsetof(Jit::Context, a));
+                m_asm.load(REG_X, REG_CONTEXT, offsetof(Jit::Context, x));
+                m_asm.load(REG_Y, REG_CONTEXT, offsetof(Jit::Context, y));
+                m_asm.load(REG_SP, REG_CONTEXT, offsetof(Jit::Context, sp));
+                m_asm.load(REG_NZ, REG_CONTEXT, offsetof(Jit::Context, nz));
+                m_asm.load(REG_C, REG_CONTEXT, offsetof(Jit::Context, c));
+                m_asm.load(REG_V, REG_CONTEXT, offsetof(Jit::Context, v));
+                m_asm.rr(0x31, REG_CYCLES, REG_CYCLES);
+            }
+
+            void epilogue()
+            {
+                for(auto at : m_exits)
+                    m_asm.bind(at);
+                m_asm.store(REG_CONTEXT, offsetof(Jit::Context, pc), RAX);
+                m_asm.store(REG_CONTEXT, offsetof(Jit::Context, a), REG_A);
+                m_asm.store(REG_CONTEXT, offsetof(Jit::Context, x), REG_X);
+                m_asm.store(REG_CONTEXT, offsetof(Jit::Context, y), REG_Y);
+                m_asm.store(REG_CONTEXT, offsetof(Jit::Context, sp), REG_SP);
+                m_asm.store(REG_CONTEXT, offsetof(Jit::Context, nz), REG_NZ);
+                m_asm.store(REG_CONTEXT, offsetof(Jit::Context, c), REG_C);
+                m_asm.store(REG_CONTEXT, offsetof(Jit::Context, v), REG_V);
+                m_asm.store(REG_CONTEXT, offsetof(Jit::Context, cycles), REG_CYCLES);
+                m_asm.code.insert(m_asm.code.end(), {0x48, 0x83, 0xC4, 0x08});    // add rsp, 8
+                for(int reg : {R15, R14, R13, R12, RBP, RBX})
+                    m_asm.pop(reg);
+                m_asm.byte(0xC3);
+            }
+
+            // pc in eax
+            void exit()
+            {
+                m_exits.push_back(m_asm.jump());
+            }
+
+            void exit(uint16_t pc)
+            {
+                m_asm.movImm(RAX, pc);
+                exit();
+            }
+
+            // taken branches and jumps back to the start of the block go round again while
+            // the whole block still fits in the limit
+            void jumpTo(uint16_t target)
+            {
+                if(target == m_block.getPc() && m_block.canLoop())
+                {
+                    m_asm.mov(RAX, REG_CYCLES);
+                    m_asm.add(RAX, m_block.getMaxStart());
+                    m_asm.compare(RAX, REG_CONTEXT, offsetof(Jit::Context, limit));
+                    size_t over = m_asm.jump(CC_A);
+                    m_asm.jumpTo(m_loopStart);
+                    m_asm.bind(over);
+                }
+                exit(target);
+            }
+
+            void setNz(int reg)
+            {
+                m_asm.mov(REG_NZ, reg);
+                m_isNzWide = false;
+            }
+
+            // byte at a fixed address into eax
+            void read(uint16_t address)
+            {
+                m_asm.load64(RAX, REG_PAGES, pageOffset(address, offsetof(MemoryMap::Page, read)));
+                if(address < 0x2000)
+                {
+                    m_asm.loadByte(RAX, RAX, address & 0xFF);
+                    return;
+                }
+                m_asm.movImm(RCX, address);
+                readChecked();
+            }
+
+            // byte at the address in ecx into eax, ecx is kept when the address is in RAM
+            void readIndexed(bool isRam)
+            {
+                m_asm.mov(RAX, RCX);
+                m_asm.shr(RAX, 8);
+                m_asm.imul(RAX, RAX, sizeof(MemoryMap::Page));
+                m_asm.load64(RAX, REG_PAGES, offsetof(MemoryMap::Page, read), RAX);
+                if(isRam)
+                {
+                    m_asm.movzxByte(RDX, RCX);
+                    m_asm.loadByte(RAX, RAX, 0, RDX);
+                    return;
+                }
+                readChecked();
+            }
+
+            // rax is the host page of the address in ecx, the bus answers when there is none
+            void readChecked()
+            {
+                m_asm.rr(0x85, RAX, RAX, true);
+                size_t slow = m_asm.jump(CC_E);
+                m_asm.movzxByte(RDX, RCX);
+                m_asm.loadByte(RAX, RAX, 0, RDX);
+                size_t done = m_asm.jump();
+                m_asm.bind(slow);
+                for(int reg : {R8, R9, R10, R11})
+                    m_asm.push(reg);
+                m_asm.rr(0x89, RDI, REG_CONTEXT, true);
+                m_asm.mov(RSI, RCX);
+                m_asm.movImm64(RAX, reinterpret_cast<uint64_t>(&readBus));
+                m_asm.call(RAX);
+                for(int reg : {R11, R10, R9, R8})
+                    m_asm.pop(reg);
+                m_asm.movzxByte(RAX, RAX);
+                m_asm.bind(done);
+            }
+
+            // dl to a fixed address in RAM
+            void write(uint16_t address)
+            {
+                m_asm.load64(RAX, REG_PAGES, pageOffset(address, offsetof(MemoryMap::Page, write)));
+                m_asm.storeByte(RAX, address & 0xFF, RDX);
+                m_asm.load64(RAX, REG_PAGES, pageOffset(address, offsetof(MemoryMap::Page, dirty)));
+                m_asm.storeByte(RAX, 0, uint8_t{1});
+            }
+
+            // dl to the address in ecx, which is in RAM
+            void writeIndexed()
+            {
+                m_asm.mov(RAX, RCX);
+                m_asm.shr(RAX, 8);
+                m_asm.imul(RAX, RAX, sizeof(MemoryMap::Page));
+                m_asm.load64(RSI, REG_PAGES, offsetof(MemoryMap::Page, write), RAX);
+                m_asm.load64(RDI, REG_PAGES, offsetof(MemoryMap::Page, dirty), RAX);
+                m_asm.storeByte(RDI, 0, uint8_t{1});
+                m_asm.movzxByte(RAX, RCX);
+                m_asm.storeByte(RSI, 0, RDX, RAX);
+            }
+
+            // puts an indexed address in ecx and charges a crossed page, false for a fixed address
+            bool address(const CodeBlock::Op& in)
+            {
+                int index = REG_X;
+                switch(in.info.mode)
+                {
+                    case Mode::ZERO_PAGE_Y:
+                        index = REG_Y;
+                        // fall through
+                    case Mode::ZERO_PAGE_X:
+                        m_asm.lea(RCX, index, in.operand);
+                        m_asm.movzxByte(RCX, RCX);
+                        return true;
+                    case Mode::ABSOLUTE_Y:
+                        index = REG_Y;
+                        // fall through
+                    case Mode::ABSOLUTE_X:
+                    {
+                        m_asm.lea(RCX, index, in.operand);
+                        m_asm.movzxWord(RCX, RCX);
+                        if(in.info.extraCycle)
+                        {
+                            m_asm.cmp(index, 0xFF - (in.operand & 0xFF));
+                            size_t same = m_asm.jump(CC_BE);
+                            m_asm.add(REG_CYCLES, 1);
+                            m_asm.bind(same);
+                        }
+                        return true;
+                    }
+                    default:
+                        return false;
+                }
+            }
+
+            bool isRam(const CodeBlock::Op& in) const
+            {
+                switch(in.info.mode)
+                {
+                    case Mode::ZERO_PAGE:
+                    case Mode::ZERO_PAGE_X:
+                    case Mode::ZERO_PAGE_Y:
+                        return true;
+                    case Mode::ABSOLUTE_X:
+                    case Mode::ABSOLUTE_Y:
+                        return in.operand + 0xFF < 0x2000;
+                    default:
+                        return in.operand < 0x2000;
+                }
+            }
+
+            // the operand into eax
+            void fetch(const CodeBlock::Op& in)
+            {
+                if(in.info.mode == Mode::IMMEDIATE)
+                    m_asm.movImm(RAX, in.operand);
+                else if(in.info.mode == Mode::ACCUMULATOR)
+                    m_asm.mov(RAX, REG_A);
+                else if(address(in))
+                    readIndexed(isRam(in));
+                else
+                    read(in.operand);
+            }
+
+            // edx to where the operand came from
+            void writeBack(const CodeBlock::Op& in)
+            {
+                if(in.info.mode == Mode::ACCUMULATOR)
+                    m_asm.mov(REG_A, RDX);
+                else if(in.info.mode == Mode::ABSOLUTE || in.info.mode == Mode::ZERO_PAGE)
+                    write(in.operand);
+                else
+                    writeIndexed();
+            }
+
+            void push()
+            {
+                m_asm.mov(RCX, REG_SP);
+                m_asm.alu(1, RCX, 0x100);
+                writeIndexed();
+                m_asm.add(REG_SP, -1);
+                size_t positive = m_asm.jump(CC_NS);
+                m_asm.movImm(REG_SP, 0xFF);
+                m_asm.bind(positive);
+            }
+
+            void pop()
+            {
+                m_asm.add(REG_SP, 1);
+                m_asm.mov(RCX, REG_SP);
+                m_asm.alu(1, RCX, 0x100);
+                readIndexed(true);
+            }
+
+            void instruction(const CodeBlock::Op& in)
+            {
+                const auto& info = in.info;
+                switch(info.kind)
+                {
+                    case Kind::LOAD:
+                        fetch(in);
+                        m_asm.mov(host(info.reg), RAX);
+                        setNz(RAX);
+                        break;
+                    case Kind::STORE:
+                        m_asm.mov(RDX, host(info.reg));
+                        if(address(in))
+                            writeIndexed();
+                        else
+                            write(in.operand);
+                        break;
+                    case Kind::AND:
+                    case Kind::ORA:
+                    case Kind::EOR:
+                        fetch(in);
+                        m_asm.rr(info.kind == Kind::AND ? 0x21 : info.kind == Kind::ORA ? 0x09 : 0x31, REG_A, RAX);
+                        setNz(REG_A);
+                        break;
+                    case Kind::ADC:
+                        fetch(in);
+                        adc();
+                        break;
+                    case Kind::SBC:
+                        fetch(in);
+                        sbc();
+                        break;
+                    case Kind::CMP:
+                        fetch(in);
+                        m_asm.mov(RDX, host(info.reg));
+                        m_asm.rr(0x29, RDX, RAX);
+                        m_asm.set(CC_AE, REG_C);
+                        m_asm.movzxByte(RDX, RDX);
+                        setNz(RDX);
+                        break;
+                    case Kind::INC:
+                    case Kind::DEC:
+                        fetch(in);
+                        m_asm.add(RAX, info.kind == Kind::INC ? 1 : -1);
+                        m_asm.movzxByte(RDX, RAX);
+                        setNz(RDX);
+                        writeBack(in);
+                        break;
+                    case Kind::ASL:
+                        fetch(in);
+                        m_asm.mov(REG_C, RAX);
+                        m_asm.shr(REG_C, 7);
+                        m_asm.mov(RDX, RAX);
+                        m_asm.shl(RDX, 1);
+                        m_asm.movzxByte(RDX, RDX);
+                        setNz(RDX);
+                        writeBack(in);
+                        break;
+                    case Kind::LSR:
+                        fetch(in);
+                        m_asm.mov(REG_C, RAX);
+                        m_asm.and_(REG_C, 1);
+                        m_asm.mov(RDX, RAX);
+                        m_asm.shr(RDX, 1);
+                        setNz(RDX);
+                        writeBack(in);
+                        break;
+                    case Kind::ROL:
+                        fetch(in);
+                        m_asm.mov(RDX, RAX);
+                        m_asm.shl(RDX, 1);
+                        m_asm.rr(0x09, RDX, REG_C);
+                        m_asm.movzxByte(RDX, RDX);
+                        m_asm.mov(REG_C, RAX);
+                        m_asm.shr(REG_C, 7);
+                        setNz(RDX);
+                        writeBack(in);
+                        break;
+                    case Kind::ROR:
+                        fetch(in);
+                        m_asm.mov(RDX, REG_C);
+                        m_asm.shl(RDX, 7);
+                        m_asm.mov(REG_C, RAX);
+                        m_asm.and_(REG_C, 1);
+                        m_asm.shr(RAX, 1);
+                        m_asm.rr(0x09, RDX, RAX);
+                        setNz(RDX);
+                        writeBack(in);
+                        break;
+                    case Kind::STEP:
+                        m_asm.add(host(info.reg), info.value);
+                        m_asm.movzxByte(host(info.reg), host(info.reg));
+                        setNz(host(info.reg));
+                        break;
+                    case Kind::TRANSFER:
+                        m_asm.mov(host(info.reg), host(info.value));
+                        setNz(host(info.reg));
+                        break;
+                    case Kind::TSX:
+                        m_asm.movzxByte(REG_X, REG_SP);
+                        setNz(REG_X);
+                        break;
+                    case Kind::TXS:
+                        m_asm.mov(REG_SP, REG_X);
+                        break;
+                    case Kind::FLAG:
+                        flag(info.reg, info.value);
+                        break;
+                    case Kind::NOP:
+                        break;
+                    case Kind::BRANCH:
+                        branch(in);
+                        break;
+                    case Kind::JMP:
+                        jumpTo(in.operand);
+                        break;
+                    case Kind::JSR:
+                        m_asm.movImm(RDX, (in.pc + 2) >> 8);
+                        push();
+                        m_asm.movImm(RDX, (in.pc + 2) & 0xFF);
+                        push();
+                        exit(in.operand);
+                        break;
+                    case Kind::RTS:
+                        pop();
+                        m_asm.mov(RDI, RAX);
+                        pop();
+                        m_asm.shl(RAX, 8);
+                        m_asm.rr(0x09, RAX, RDI);
+                        m_asm.add(RAX, 1);
+                        m_asm.movzxWord(RAX, RAX);
+                        exit();
+                        break;
+                    case Kind::PHA:
+                        m_asm.mov(RDX, REG_A);
+                        push();
+                        break;
+                    case Kind::PLA:
+                        pop();
+                        m_asm.mov(REG_A, RAX);
+                        setNz(RAX);
+                        break;
+                    default:
+                        throw std::runtime_error("JIT cannot translate opcode " + std::to_string(int(m_block.getPc())));
+                }
+            }
+
+            void adc()
+            {
+                m_asm.mov(RDX, REG_A);
+                m_asm.rr(0x01, RDX, RAX);
+                m_asm.rr(0x01, RDX, REG_C);
+                // overflow when both inputs differ in sign from the result
+                m_asm.mov(RCX, REG_A);
+                m_asm.rr(0x31, RCX, RDX);
+                m_asm.mov(RSI, RAX);
+                m_asm.rr(0x31, RSI, RDX);
+                m_asm.rr(0x21, RCX, RSI);
+                m_asm.shr(RCX, 7);
+                m_asm.and_(RCX, 1);
+                m_asm.mov(REG_V, RCX);
+                m_asm.mov(REG_C, RDX);
+                m_asm.shr(REG_C, 8);
+                m_asm.movzxByte(REG_A, RDX);
+                setNz(REG_A);
+            }
+
+            // core::sbc, which takes N from the result less one when A is positive and the operand negative
+            void sbc()
+            {
+                m_asm.mov(RDX, REG_A);
+                m_asm.rr(0x29, RDX, RAX);
+                m_asm.rr(0x01, RDX, REG_C);
+                m_asm.add(RDX, -1);
+                m_asm.mov(REG_C, RDX);
+                m_asm.not_(REG_C);
+                m_asm.shr(REG_C, 31);
+                m_asm.movsxByte(RCX, REG_A);
+                m_asm.movsxByte(RSI, RAX);
+                m_asm.rr(0x29, RCX, RSI);
+                m_asm.add(RCX, 128);
+                m_asm.cmp(RCX, 255);
+                m_asm.set(CC_A, REG_V);
+                m_asm.movzxByte(RDX, RDX);
+                m_asm.mov(RCX, REG_A);
+                m_asm.not_(RCX);
+                m_asm.rr(0x21, RCX, RAX);
+                m_asm.shr(RCX, 7);
+                m_asm.and_(RCX, 1);
+                m_asm.mov(RSI, RDX);
+                m_asm.rr(0x29, RSI, RCX);
+                m_asm.rr(0x31, RSI, RDX);
+                m_asm.and_(RSI, 0x80);
+                m_asm.shl(RSI, 1);
+                m_asm.rr(0x09, RSI, RDX);
+                m_asm.mov(REG_NZ, RSI);
+                m_asm.mov(REG_A, RDX);
+                m_isNzWide = true;
+            }
+
+            void flag(int flag, int value)
+            {
+                switch(flag)
+                {
+                    case CodeBlock::FLAG_C:
+                        m_asm.movImm(REG_C, value);
+                        break;
+                    case CodeBlock::FLAG_V:
+                        m_asm.movImm(REG_V, value);
+                        break;
+                    case CodeBlock::FLAG_I:
+                        m_asm.storeByte(REG_CONTEXT, offsetof(Jit::Context, i), uint8_t(value));
+                        break;
+                    default:
+                        m_asm.storeByte(REG_CONTEXT, offsetof(Jit::Context, d), uint8_t(value));
+                        break;
+                }
+            }
+
+            void branch(const CodeBlock::Op& in)
+            {
+                Condition taken;
+                switch(in.info.reg)
+                {
+                    case CodeBlock::FLAG_N:
+                        if(m_isNzWide)
+                        {
+                            m_asm.mov(RAX, REG_NZ);
+                            m_asm.shr(RAX, 1);
+                            m_asm.rr(0x31, RAX, REG_NZ);
+                            m_asm.testByte(RAX, 0x80);
+                        }
+                        else
+                            m_asm.testByte(REG_NZ, 0x80);
+                        taken = in.info.value ? CC_NE : CC_E;
+                        break;
+                    case CodeBlock::FLAG_Z:
+                        m_asm.testByte(REG_NZ, 0xFF);
+                        taken = in.info.value ? CC_E : CC_NE;
+                        break;
+                    default:
+                        m_asm.rr(0x85, in.info.reg == CodeBlock::FLAG_C ? REG_C : REG_V, in.info.reg == CodeBlock::FLAG_C ? REG_C : REG_V);
+                        taken = in.info.value ? CC_NE : CC_E;
+                        break;
+                }
+                size_t jump = m_asm.jump(taken);
+                exit(in.pc + 2);
+                m_asm.bind(jump);
+                m_asm.add(REG_CYCLES, in.takenCycles - in.info.cycles);
+                jumpTo(in.target);
+            }
+    };
+
+    uint8_t readBus(Jit::Context* context, uint32_t address)
+    {
+        return context->bus->read(address);
+    }
+}
+
+Jit::Jit(Bus& bus, DecodeCache& decodeCache)
+: m_bus{bus}
+, m_decodeCache{decodeCache}
+, m_mode{Mode::OFF}
+, m_precompiled{nullptr}
+, m_chunkUsed{CHUNK_SIZE}
+{
+    m_slots.fill({nullptr, nullptr});
+}
+
+Jit::~Jit()
+{
+#if NES_JIT_SUPPORTED
+    for(auto chunk : m_chunks)
+        munmap(chunk, CHUNK_SIZE);
+#endif
+}
+
+bool Jit::isSupported()
+{
+    return NES_JIT_SUPPORTED;
+}
+
+void Jit::setMode(Mode mode)
+{
+    m_mode = mode;
+}
+
+Jit::Mode Jit::getMode() const
+{
+    return m_mode;
+}
+
+void Jit::setPrecompiled(RomSpan image, const PrecompiledRom* rom)
+{
+    m_image = image;
+    m_precompiled = rom;
+    m_slots.fill({nullptr, nullptr});
+    m_entries.clear();
+}
+
+void Jit::bind(Slot& slot, uint8_t cpuPage, const uint8_t* page)
+{
+    // code is placed by the CPU address it runs at, a bank mirrored twice gets two sets
+    auto& entries = m_entries[{page, cpuPage}];
+    if(!entries)
+    {
+        entries = std::make_unique<Entries>();
+        entries->fill({nullptr, 0});
+        if(m_precompiled && page >= m_image.data() && page < m_image.data() + m_image.size())
+        {
+            // blocks translated ahead of time count as hot from the start
+            uint32_t offset = page - m_image.data();
+            const PrecompiledBlock* first = m_precompiled->blocks;
+            const PrecompiledBlock* last = first + m_precompiled->numBlocks;
+            auto it = std::lower_bound(first, last, offset, [](const PrecompiledBlock& block, uint32_t offset) { return block.offset < offset; });
+            for(; it != last && it->offset < offset + 256; ++it)
+                if(it->block.pc >> 8 == cpuPage)
+                    (*entries)[it->block.pc & 0xFF] = {&it->block, HOT_VISITS + 1};
+        }
+    }
+    slot.page = page;
+    slot.entries = entries.get();
+}
+
+const Jit::Block* Jit::compile(uint16_t pc, const uint8_t* page)
+{
+    CodeBlock block{pc, page, m_decodeCache};
+    if(block.empty())
+        return nullptr;
+
+    void* code = install(Translator{block}.translate());
+    if(!code)
+        return nullptr;
+    m_blocks.push_back(std::make_unique<Block>(Block{reinterpret_cast<void (*)(Context*)>(code), pc, block.getMaxStart()}));
+    return m_blocks.back().get();
+}
+
+void* Jit::install(const std::vector<uint8_t>& code)
+{
+#if NES_JIT_SUPPORTED
+    if(code.size() > CHUNK_SIZE)
+        return nullptr;
+    if(m_chunkUsed + code.size() > CHUNK_SIZE)
+    {
+        if(m_chunks.size() == MAX_CHUNKS)
+            return nullptr;
+        void* chunk = mmap(nullptr, CHUNK_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(chunk == MAP_FAILED)
+            return nullptr;
+        m_chunks.push_back(static_cast<uint8_t*>(chunk));
+        m_chunkUsed = 0;
+    }
+
+    // never writable and executable at the same time
+    uint8_t* chunk = m_chunks.back();
+    if(mprotect(chunk, CHUNK_SIZE, PROT_READ | PROT_WRITE) != 0)
+        return nullptr;
+    uint8_t* start = chunk + m_chunkUsed;
+    std::memcpy(start, code.data(), code.size());
+    m_chunkUsed = (m_chunkUsed + code.size() + 15) & ~size_t{15};
+    if(mprotect(chunk, CHUNK_SIZE, PROT_READ | PROT_EXEC) != 0)
+        throw std::runtime_error("JIT cannot make code executable");
+    return start;
+#else
+    return nullptr;
+#endif
+}
+
+uint32_t Jit::run(const Block& block, CpuState& state, uint32_t limit, uint32_t& lastStart)
+{
+    Context context;
+    context.pages = m_bus.pages();
+    context.bus = &m_bus;
+    context.a = state.a;
+    context.x = state.x;
+    context.y = state.y;
+    context.sp = state.sp;
+    context.c = state.sr.c;
+    context.v = state.sr.v;
+    context.nz = state.sr.z ? (state.sr.n ? 0x100 : 0) : (state.sr.n ? 0x80 : 1);
+    context.i = state.sr.i;
+    context.d = state.sr.d;
+    context.limit = limit;
+
+    block.code(&context);
+
+    state.pc = context.pc;
+    state.a = context.a;
+    state.x = context.x;
+    state.y = context.y;
+    state.sp = context.sp;
+    state.sr.c = context.c;
+    state.sr.v = context.v;
+    state.sr.z = (context.nz & 0xFF) == 0;
+    state.sr.n = ((context.nz >> 7) ^ (context.nz >> 8)) & 1;
+    state.sr.i = context.i;
+    state.sr.d = context.d;
+    lastStart = context.lastStart;
+    return context.cycles;
+}
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include "include/nes.h"
+#include "include/nesBatch.h"
+
+#include <algorithm>
 
 extern "C"
 {
@@ -7,13 +10,197 @@ extern "C"
         return new Nes(nesFile, btnStateGetter, onNewFrame);
     }
 
+    // frames of the clone arrive in the pixel format of the machine it was cloned from
+    Nes* nes_clone(Nes* nesPtr, uint8_t(*btnStateGetter)(void), void(*onNewFrame)(const void*))
+    {
+        return nesPtr->clone(btnStateGetter, onNewFrame).release();
+    }
+
+    void nes_delete(Nes* nesPtr)
+    {
+        delete nesPtr;
+    }
+
     void nes_start(Nes* nesPtr)
     {
         nesPtr->start();
     }
 
+    // emulates up to the end of the current frame, delivering it
+    void nes_run_frame(Nes* nesPtr)
+    {
+        nesPtr->runFrame();
+    }
+
+    void nes_run_cycles(Nes* nesPtr, uint64_t cycles)
+    {
+        nesPtr->runCycles(cycles);
+    }
+
+    // the runUntil functions return 0 when maxCycles CPU cycles passed first
+    int nes_run_until(Nes* nesPtr, int(*predicate)(void*), void* context, uint64_t maxCycles)
+    {
+        return nesPtr->runUntil([predicate, context]() { return predicate(context) != 0; }, maxCycles);
+    }
+
+    int nes_run_until_pc(Nes* nesPtr, uint16_t pc, uint64_t maxCycles)
+    {
+        return nesPtr->runUntilPc(pc, maxCycles);
+    }
+
+    int nes_run_until_scanline(Nes* nesPtr, int scanline, uint64_t maxCycles)
+    {
+        return nesPtr->runUntilScanline(scanline, maxCycles);
+    }
+
     void nes_reset(Nes* nesPtr)
     {
         nesPtr->reset();
     }
+
+    // format is a VideoOutput::PixelFormat value, frames arrive in that format from then on
+    void nes_set_video_output(Nes* nesPtr, int format, void(*onNewFrame)(const void*))
+    {
+        nesPtr->setVideoOutput(static_cast<VideoOutput::PixelFormat>(format), onNewFrame);
+    }
+
+    void nes_set_headless(Nes* nesPtr, int headless, uint32_t renderInterval)
+    {
+        nesPtr->setHeadless(headless != 0, renderInterval);
+    }
+
+    // mode is a Jit::Mode value, without the backend the interpreter keeps running everything
+    void nes_set_jit(Nes* nesPtr, int mode)
+    {
+        nesPtr->setJit(static_cast<Jit::Mode>(mode));
+    }
+
+    // counts the runs of fused instruction sequences from now on, 0 turns it off
+    void nes_set_fusion_profile(Nes* nesPtr, int enabled)
+    {
+        nesPtr->setFusionProfile(enabled != 0);
+    }
+
+    // copies up to size counts and returns how many sequences there are, none while the
+    // profile is off
+    size_t nes_get_fusion_profile(Nes* nesPtr, fusion::Count* counts, size_t size)
+    {
+        auto profile = nesPtr->getFusionProfile();
+        std::copy_n(profile.begin(), std::min(size, profile.size()), counts);
+        return profile.size();
+    }
+
+    size_t nes_state_size(Nes* nesPtr)
+    {
+        return nesPtr->stateSize();
+    }
+
+    // returns the number of bytes written, 0 when the buffer is too small
+    size_t nes_save_state(Nes* nesPtr, uint8_t* data, size_t size)
+    {
+        try
+        {
+            return nesPtr->saveState(data, size);
+        }
+        catch(const std::exception&)
+        {
+            return 0;
+        }
+    }
+
+    // same as nes_save_state, with only the memory written since the previous snapshot
+    size_t nes_save_state_delta(Nes* nesPtr, uint8_t* data, size_t size)
+    {
+        try
+        {
+            return nesPtr->saveStateDelta(data, size);
+        }
+        catch(const std::exception&)
+        {
+            return 0;
+        }
+    }
+
+    // arenaSize bytes of history, at most maxFrames frames, 0 frames turns it off
+    void nes_set_rewind(Nes* nesPtr, uint32_t maxFrames, size_t arenaSize)
+    {
+        nesPtr->setRewind(maxFrames, arenaSize);
+    }
+
+    // returns the number of frames it went back
+    uint32_t nes_rewind(Nes* nesPtr, uint32_t frames)
+    {
+        return nesPtr->rewind(frames);
+    }
+
+    // frames emulated ahead of the one that is kept, 0 turns it off
+    void nes_set_run_ahead(Nes* nesPtr, uint32_t frames)
+    {
+        nesPtr->setRunAhead(frames);
+    }
+
+    // totals in nanoseconds since run-ahead was set, the average cost is over cost->frames
+    void nes_get_run_ahead_cost(Nes* nesPtr, Nes::RunAheadCost* cost)
+    {
+        *cost = nesPtr->getRunAheadCost();
+    }
+
+    // returns 0 when the state is truncated or belongs to another ROM or version
+    int nes_load_state(Nes* nesPtr, const uint8_t* data, size_t size)
+    {
+        try
+        {
+            nesPtr->loadState(data, size);
+            return 1;
+        }
+        catch(const std::exception&)
+        {
+            return 0;
+        }
+    }
+
+    // count machines stepped by numThreads threads (0 for one per hardware thread), format
+    // is a VideoOutput::PixelFormat value
+    NesBatch* nes_batch_new(const char** nesFiles, size_t count, size_t numThreads, int format)
+    {
+        try
+        {
+            return new NesBatch(std::vector<std::string>(nesFiles, nesFiles + count), numThreads, static_cast<VideoOutput::PixelFormat>(format));
+        }
+        catch(const std::exception&)
+        {
+            return nullptr;
+        }
+    }
+
+    void nes_batch_delete(NesBatch* batchPtr)
+    {
+        delete batchPtr;
+    }
+
+    // one button byte per machine in, one frame of nes_batch_observation_size() bytes per
+    // machine out, returns 0 when a machine failed
+    int nes_batch_step_frame(NesBatch* batchPtr, const uint8_t* inputs, void* observations)
+    {
+        try
+        {
+            batchPtr->stepFrame(inputs, observations);
+            return 1;
+        }
+        catch(const std::exception&)
+        {
+            return 0;
+        }
+    }
+
+    size_t nes_batch_observation_size(NesBatch* batchPtr)
+    {
+        return batchPtr->observationSize();
+    }
+
+    // the machine itself, for the nes_ functions other than nes_start
+    Nes* nes_batch_get(NesBatch* batchPtr, size_t index)
+    {
+        return &(*batchPtr)[index];
+    }
 }
\ No newline at end of file
@@ -0,0 +1,535 @@
+#include "include/lockstep.h"
+#include "include/cpuCore.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// one lane seen as a Cpu, so core::execute can run the opcodes the vector path leaves out
+struct LockstepCpu::Lane
+{
+    LockstepCpu& cpu;
+    size_t lane;
+    CpuState state;
+
+    Lane(LockstepCpu& cpu, size_t lane)
+    : cpu{cpu}
+    , lane{lane}
+    , state{cpu.getState(lane)}
+    {
+
+    }
+
+    CpuState& getState()
+    {
+        return state;
+    }
+
+    uint8_t read(uint16_t address)
+    {
+        if(address < 0x2000)
+            return cpu.m_ram[(address & 0x7FF) * cpu.m_numLanes + lane];
+        if(address >= 0x4020)
+            return cpu.m_prg[address & 0x7FFF];
+        return cpu.m_read ? cpu.m_read(lane, address) : 0;
+    }
+
+    void write(uint16_t address, uint8_t data)
+    {
+        if(address < 0x2000)
+            cpu.m_ram[(address & 0x7FF) * cpu.m_numLanes + lane] = data;
+        else if(address < 0x4020 && cpu.m_write)
+            cpu.m_write(lane, address, data);
+    }
+
+    void push(uint8_t value)
+    {
+        write(0x0100 | state.sp, value);
+        state.sp -= 1;
+        if(state.sp == -1)
+            state.sp = 0xFF;
+    }
+
+    uint8_t pop()
+    {
+        state.sp += 1;
+        return read(0x0100 | state.sp);
+    }
+
+    void store()
+    {
+        cpu.m_pc[lane] = state.pc;
+        cpu.m_a[lane] = state.a;
+        cpu.m_x[lane] = state.x;
+        cpu.m_y[lane] = state.y;
+        cpu.m_sp[lane] = state.sp;
+        cpu.m_n[lane] = state.sr.n;
+        cpu.m_v[lane] = state.sr.v;
+        cpu.m_unused[lane] = state.sr.unused;
+        cpu.m_b[lane] = state.sr.b;
+        cpu.m_d[lane] = state.sr.d;
+        cpu.m_i[lane] = state.sr.i;
+        cpu.m_z[lane] = state.sr.z;
+        cpu.m_c[lane] = state.sr.c;
+    }
+};
+
+double LockstepCpu::Stats::divergence() const
+{
+    uint64_t total = vectorLanes + scalarLanes;
+    return total ? double(scalarLanes) / total : 0.0;
+}
+
+LockstepCpu::LockstepCpu(const std::string& nesFile, size_t numLanes, ReadCallback read, WriteCallback write, std::streambuf* log)
+: m_log{log}
+, m_cartridge{nesFile, m_log}
+, m_prg(0x8000, 0)
+, m_numLanes{numLanes}
+, m_read{std::move(read)}
+, m_write{std::move(write)}
+, m_pc(numLanes, 0)
+, m_a(numLanes, 0)
+, m_x(numLanes, 0)
+, m_y(numLanes, 0)
+, m_sp(numLanes, 0)
+, m_n(numLanes, 0)
+, m_v(numLanes, 0)
+, m_unused(numLanes, 0)
+, m_b(numLanes, 0)
+, m_d(numLanes, 0)
+, m_i(numLanes, 0)
+, m_z(numLanes, 0)
+, m_c(numLanes, 0)
+, m_cycles(numLanes, 0)
+, m_ram(0x800 * numLanes, 0)
+, m_targets(numLanes, 0)
+, m_mask(numLanes, 0)
+, m_operand(numLanes, 0)
+, m_isVectorized{true}
+{
+    if(m_cartridge.getMapperId() != 0)
+        throw std::runtime_error("Lockstep CPU needs mapper 0, mapperId:" + std::to_string(m_cartridge.getMapperId()));
+
+    for(uint32_t address = 0; address < 0x8000; ++address)
+        m_prg[address] = m_cartridge.cpuRead(0x8000 + address);
+    reset();
+}
+
+void LockstepCpu::reset()
+{
+    StatusRegister sr;
+    sr.fromByte(0x07);
+    uint16_t pc = (m_prg[0x7FFD] << 8) | m_prg[0x7FFC];
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+    {
+        Lane cpu{*this, lane};
+        cpu.state.pc = pc;
+        cpu.state.a = 0x00;
+        cpu.state.x = 0x08;
+        cpu.state.y = 0x00;
+        cpu.state.sp = 0xfa;
+        cpu.state.sr = sr;
+        cpu.store();
+        m_cycles[lane] = 8;
+        m_targets[lane] = 8;
+    }
+}
+
+void LockstepCpu::run(uint64_t cycles)
+{
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+        m_targets[lane] = m_cycles[lane] + cycles;
+    while(stepGroup())
+        ;
+}
+
+void LockstepCpu::nmi(size_t lane)
+{
+    Lane cpu{*this, lane};
+    auto& state = cpu.state;
+    cpu.push((state.pc & 0xFF00) >> 8);
+    cpu.push(state.pc & 0xFF);
+
+    auto copy = state.sr;
+    state.sr.unused = 1;
+    state.sr.b = 0;
+    cpu.push(state.sr.toByte());
+    state.sr = copy;
+
+    state.pc = (cpu.read(0xFFFB) << 8) | cpu.read(0xFFFA);
+    state.sr.i = 1;
+    cpu.store();
+    m_cycles[lane] += 7;
+}
+
+void LockstepCpu::irq(size_t lane)
+{
+    Lane cpu{*this, lane};
+    auto& state = cpu.state;
+    cpu.push((state.pc & 0xFF00) >> 8);
+    cpu.push(state.pc & 0xFF);
+    cpu.push(state.sr.toByte());
+
+    state.pc = (cpu.read(0xFFFF) << 8) | cpu.read(0xFFFE);
+    state.sr.i = 1;
+    cpu.store();
+    m_cycles[lane] += 7;
+}
+
+CpuState LockstepCpu::getState(size_t lane) const
+{
+    CpuState state;
+    state.pc = m_pc[lane];
+    state.a = m_a[lane];
+    state.x = m_x[lane];
+    state.y = m_y[lane];
+    state.sp = m_sp[lane];
+    state.sr.n = m_n[lane];
+    state.sr.v = m_v[lane];
+    state.sr.unused = m_unused[lane];
+    state.sr.b = m_b[lane];
+    state.sr.d = m_d[lane];
+    state.sr.i = m_i[lane];
+    state.sr.z = m_z[lane];
+    state.sr.c = m_c[lane];
+    return state;
+}
+
+uint64_t LockstepCpu::getCycles(size_t lane) const
+{
+    return m_cycles[lane];
+}
+
+uint8_t LockstepCpu::readRam(size_t lane, uint16_t address) const
+{
+    return m_ram[(address & 0x7FF) * m_numLanes + lane];
+}
+
+size_t LockstepCpu::size() const
+{
+    return m_numLanes;
+}
+
+void LockstepCpu::setVectorized(bool isVectorized)
+{
+    m_isVectorized = isVectorized;
+}
+
+const LockstepCpu::Stats& LockstepCpu::getStats() const
+{
+    return m_stats;
+}
+
+void LockstepCpu::clearStats()
+{
+    m_stats = Stats{};
+}
+
+uint8_t LockstepCpu::length(Mode mode)
+{
+    return (mode == Mode::ABSOLUTE) ? 3 : 2;
+}
+
+uint8_t LockstepCpu::cycles(Mode mode)
+{
+    switch(mode)
+    {
+        case Mode::IMMEDIATE: return 2;
+        case Mode::ZERO_PAGE: return 3;
+        default: return 4;
+    }
+}
+
+bool LockstepCpu::stepGroup()
+{
+    // the lane furthest behind leads, every other lane at its PC follows
+    size_t leader = m_numLanes;
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+    {
+        if(m_cycles[lane] < m_targets[lane] && (leader == m_numLanes || m_cycles[lane] < m_cycles[leader]))
+            leader = lane;
+    }
+    if(leader == m_numLanes)
+        return false;
+
+    uint16_t pc = m_pc[leader];
+    uint64_t count = 0;
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+    {
+        m_mask[lane] = (m_pc[lane] == pc && m_cycles[lane] < m_targets[lane]) ? 1 : 0;
+        count += m_mask[lane];
+    }
+    m_stats.groups += 1;
+
+    // code in PRG has the same opcode and operands in every lane, code in RAM may not
+    if(m_isVectorized && pc >= 0x4020 && pc <= 0xFFFD && stepVector(pc))
+    {
+        m_stats.vectorLanes += count;
+        return true;
+    }
+
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+    {
+        if(m_mask[lane])
+            stepScalar(lane);
+    }
+    m_stats.scalarLanes += count;
+    return true;
+}
+
+bool LockstepCpu::stepVector(uint16_t pc)
+{
+    switch(m_prg[pc & 0x7FFF])
+    {
+        case 0xA9: return load(m_a, Mode::IMMEDIATE, pc);
+        case 0xA5: return load(m_a, Mode::ZERO_PAGE, pc);
+        case 0xAD: return load(m_a, Mode::ABSOLUTE, pc);
+        case 0xA2: return load(m_x, Mode::IMMEDIATE, pc);
+        case 0xA6: return load(m_x, Mode::ZERO_PAGE, pc);
+        case 0xAE: return load(m_x, Mode::ABSOLUTE, pc);
+        case 0xA0: return load(m_y, Mode::IMMEDIATE, pc);
+        case 0xA4: return load(m_y, Mode::ZERO_PAGE, pc);
+        case 0xAC: return load(m_y, Mode::ABSOLUTE, pc);
+        case 0x85: return store(m_a, Mode::ZERO_PAGE, pc);
+        case 0x8D: return store(m_a, Mode::ABSOLUTE, pc);
+        case 0x86: return store(m_x, Mode::ZERO_PAGE, pc);
+        case 0x8E: return store(m_x, Mode::ABSOLUTE, pc);
+        case 0x84: return store(m_y, Mode::ZERO_PAGE, pc);
+        case 0x8C: return store(m_y, Mode::ABSOLUTE, pc);
+        case 0x09: return logic(0x09, Mode::IMMEDIATE, pc);
+        case 0x05: return logic(0x05, Mode::ZERO_PAGE, pc);
+        case 0x0D: return logic(0x0D, Mode::ABSOLUTE, pc);
+        case 0x29: return logic(0x29, Mode::IMMEDIATE, pc);
+        case 0x25: return logic(0x25, Mode::ZERO_PAGE, pc);
+        case 0x2D: return logic(0x2D, Mode::ABSOLUTE, pc);
+        case 0x49: return logic(0x49, Mode::IMMEDIATE, pc);
+        case 0x45: return logic(0x45, Mode::ZERO_PAGE, pc);
+        case 0x4D: return logic(0x4D, Mode::ABSOLUTE, pc);
+        case 0x69: return adc(Mode::IMMEDIATE, pc);
+        case 0x65: return adc(Mode::ZERO_PAGE, pc);
+        case 0x6D: return adc(Mode::ABSOLUTE, pc);
+        case 0xC9: return compare(m_a, Mode::IMMEDIATE, pc);
+        case 0xC5: return compare(m_a, Mode::ZERO_PAGE, pc);
+        case 0xCD: return compare(m_a, Mode::ABSOLUTE, pc);
+        case 0xE0: return compare(m_x, Mode::IMMEDIATE, pc);
+        case 0xE4: return compare(m_x, Mode::ZERO_PAGE, pc);
+        case 0xEC: return compare(m_x, Mode::ABSOLUTE, pc);
+        case 0xC0: return compare(m_y, Mode::IMMEDIATE, pc);
+        case 0xC4: return compare(m_y, Mode::ZERO_PAGE, pc);
+        case 0xCC: return compare(m_y, Mode::ABSOLUTE, pc);
+        case 0xE6: return modify(1, Mode::ZERO_PAGE, pc);
+        case 0xEE: return modify(1, Mode::ABSOLUTE, pc);
+        case 0xC6: return modify(-1, Mode::ZERO_PAGE, pc);
+        case 0xCE: return modify(-1, Mode::ABSOLUTE, pc);
+        case 0xAA: return transfer(m_x, m_a, 0, pc);
+        case 0x8A: return transfer(m_a, m_x, 0, pc);
+        case 0xA8: return transfer(m_y, m_a, 0, pc);
+        case 0x98: return transfer(m_a, m_y, 0, pc);
+        case 0xE8: return transfer(m_x, m_x, 1, pc);
+        case 0xCA: return transfer(m_x, m_x, -1, pc);
+        case 0xC8: return transfer(m_y, m_y, 1, pc);
+        case 0x88: return transfer(m_y, m_y, -1, pc);
+        case 0x18: return setFlag(m_c, 0, pc);
+        case 0x38: return setFlag(m_c, 1, pc);
+        case 0x58: return setFlag(m_i, 0, pc);
+        case 0x78: return setFlag(m_i, 1, pc);
+        case 0xB8: return setFlag(m_v, 0, pc);
+        case 0xD8: return setFlag(m_d, 0, pc);
+        case 0x10: return branch(m_n, 0, pc);
+        case 0x30: return branch(m_n, 1, pc);
+        case 0x50: return branch(m_v, 0, pc);
+        case 0x70: return branch(m_v, 1, pc);
+        case 0x90: return branch(m_c, 0, pc);
+        case 0xB0: return branch(m_c, 1, pc);
+        case 0xD0: return branch(m_z, 0, pc);
+        case 0xF0: return branch(m_z, 1, pc);
+        case 0x4C:
+            finish(operandAddress(Mode::ABSOLUTE, pc), 3);
+            return true;
+        case 0xEA:
+            finish(pc + 1, 2);
+            return true;
+        default:
+            return false;
+    }
+}
+
+void LockstepCpu::stepScalar(size_t lane)
+{
+    Lane cpu{*this, lane};
+    uint8_t opcode = cpu.read(cpu.state.pc);
+    cpu.state.pc += 1;
+    uint8_t cycles = core::execute(cpu, opcode);
+    cpu.store();
+    m_cycles[lane] += cycles;
+}
+
+uint16_t LockstepCpu::operandAddress(Mode mode, uint16_t pc) const
+{
+    uint8_t ll = m_prg[(pc + 1) & 0x7FFF];
+    switch(mode)
+    {
+        case Mode::IMMEDIATE: return pc + 1;
+        case Mode::ZERO_PAGE: return ll;
+        default: return (m_prg[(pc + 2) & 0x7FFF] << 8) | ll;
+    }
+}
+
+bool LockstepCpu::loadOperand(Mode mode, uint16_t pc)
+{
+    uint16_t address = operandAddress(mode, pc);
+    if(const uint8_t* row = ramRow(address))
+        std::copy(row, row + m_numLanes, m_operand.begin());
+    else if(address >= 0x4020)
+        std::fill(m_operand.begin(), m_operand.end(), m_prg[address & 0x7FFF]);
+    else
+        return false;   // registers are read lane by lane, in order
+    return true;
+}
+
+uint8_t* LockstepCpu::ramRow(uint16_t address)
+{
+    return (address < 0x2000) ? &m_ram[(address & 0x7FF) * m_numLanes] : nullptr;
+}
+
+// the loops below go over every lane and select by the mask so they have no branches
+
+void LockstepCpu::finish(uint16_t pc, uint8_t cycles)
+{
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+    {
+        m_pc[lane] = m_mask[lane] ? pc : m_pc[lane];
+        m_cycles[lane] += m_mask[lane] ? cycles : 0;
+    }
+}
+
+void LockstepCpu::setZn(const uint8_t* value)
+{
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+    {
+        m_z[lane] = m_mask[lane] ? (value[lane] == 0) : m_z[lane];
+        m_n[lane] = m_mask[lane] ? (value[lane] >> 7) : m_n[lane];
+    }
+}
+
+bool LockstepCpu::load(std::vector<uint8_t>& reg, Mode mode, uint16_t pc)
+{
+    if(!loadOperand(mode, pc))
+        return false;
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+        reg[lane] = m_mask[lane] ? m_operand[lane] : reg[lane];
+    setZn(reg.data());
+    finish(pc + length(mode), cycles(mode));
+    return true;
+}
+
+bool LockstepCpu::store(const std::vector<uint8_t>& reg, Mode mode, uint16_t pc)
+{
+    uint16_t address = operandAddress(mode, pc);
+    if(uint8_t* row = ramRow(address))
+    {
+        for(size_t lane = 0; lane < m_numLanes; ++lane)
+            row[lane] = m_mask[lane] ? reg[lane] : row[lane];
+    }
+    else if(address < 0x4020)
+        return false;
+    finish(pc + length(mode), cycles(mode));
+    return true;
+}
+
+bool LockstepCpu::logic(uint8_t opcode, Mode mode, uint16_t pc)
+{
+    if(!loadOperand(mode, pc))
+        return false;
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+    {
+        uint8_t a = m_a[lane];
+        uint8_t result = (opcode < 0x20) ? (a | m_operand[lane]) : (opcode < 0x40) ? (a & m_operand[lane]) : (a ^ m_operand[lane]);
+        m_a[lane] = m_mask[lane] ? result : a;
+    }
+    setZn(m_a.data());
+    finish(pc + length(mode), cycles(mode));
+    return true;
+}
+
+bool LockstepCpu::adc(Mode mode, uint16_t pc)
+{
+    if(!loadOperand(mode, pc))
+        return false;
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+    {
+        uint8_t a = m_a[lane];
+        uint8_t operand = m_operand[lane];
+        uint16_t result = a + operand + m_c[lane];
+        uint8_t isSet = m_mask[lane];
+        m_c[lane] = isSet ? (result > 255) : m_c[lane];
+        m_v[lane] = isSet ? (((a ^ result) & (operand ^ result) & 0x80) >> 7) : m_v[lane];
+        m_a[lane] = isSet ? uint8_t(result) : a;
+    }
+    setZn(m_a.data());
+    finish(pc + length(mode), cycles(mode));
+    return true;
+}
+
+bool LockstepCpu::compare(const std::vector<uint8_t>& reg, Mode mode, uint16_t pc)
+{
+    if(!loadOperand(mode, pc))
+        return false;
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+    {
+        uint8_t result = reg[lane] - m_operand[lane];
+        uint8_t isSet = m_mask[lane];
+        m_n[lane] = isSet ? (result >> 7) : m_n[lane];
+        m_z[lane] = isSet ? (reg[lane] == m_operand[lane]) : m_z[lane];
+        m_c[lane] = isSet ? (reg[lane] >= m_operand[lane]) : m_c[lane];
+    }
+    finish(pc + length(mode), cycles(mode));
+    return true;
+}
+
+bool LockstepCpu::modify(int8_t delta, Mode mode, uint16_t pc)
+{
+    uint8_t* row = ramRow(operandAddress(mode, pc));
+    if(!row)
+        return false;
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+        row[lane] = m_mask[lane] ? uint8_t(row[lane] + delta) : row[lane];
+    setZn(row);
+    finish(pc + length(mode), cycles(mode) + 2);
+    return true;
+}
+
+bool LockstepCpu::transfer(std::vector<uint8_t>& dst, const std::vector<uint8_t>& src, int8_t delta, uint16_t pc)
+{
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+        dst[lane] = m_mask[lane] ? uint8_t(src[lane] + delta) : dst[lane];
+    setZn(dst.data());
+    finish(pc + 1, 2);
+    return true;
+}
+
+bool LockstepCpu::setFlag(std::vector<uint8_t>& flag, uint8_t value, uint16_t pc)
+{
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+        flag[lane] = m_mask[lane] ? value : flag[lane];
+    finish(pc + 1, 2);
+    return true;
+}
+
+bool LockstepCpu::branch(const std::vector<uint8_t>& flag, uint8_t value, uint16_t pc)
+{
+    // target and cost are the same for every lane, only whether it is taken differs
+    uint8_t offset = m_prg[(pc + 1) & 0x7FFF];
+    uint16_t next = pc + 2;
+    uint16_t target = next + int8_t(offset);
+    // like core::Relative, a backward branch compares pages with the address of the offset
+    uint16_t from = (offset & 0x80) ? pc + 1 : next;
+    uint8_t takenCycles = ((target & 0xFF00) != (from & 0xFF00)) ? 4 : 3;
+
+    for(size_t lane = 0; lane < m_numLanes; ++lane)
+    {
+        uint8_t isTaken = flag[lane] == value;
+        m_pc[lane] = m_mask[lane] ? (isTaken ? target : next) : m_pc[lane];
+        m_cycles[lane] += m_mask[lane] ? (isTaken ? takenCycles : 2) : 0;
+    }
+    return true;
+}
\ No newline at end of file
@@ -1,12 +1,12 @@
 #include "include/mapper000.h"
+#include "include/memoryMap.h"
 
 
-Mapper000::Mapper000(std::vector<uint8_t> prg, uint8_t numPrgBlocks, std::vector<uint8_t> chr)
+Mapper000::Mapper000(RomSpan prg, uint8_t numPrgBlocks, RomSpan chr)
 : m_prg{std::move(prg)}
 , m_numBlocks{numPrgBlocks}
-, m_chr{chr}
 {
-
+    setChrMemory(chr);
 }
 
 uint16_t Mapper000::cpuRead(uint16_t address)
@@ -21,10 +21,16 @@ void Mapper000::cpuWrite(uint16_t address, uint8_t data)
 
 uint16_t Mapper000::ppuRead(uint16_t address)
 {
-    return m_chr[address];
+    return readChr(address);
 }
 
 void Mapper000::ppuWrite(uint16_t address, uint8_t data)
 {
-    m_chr[address] = data;
+    writeChr(address, data);
+}
+
+void Mapper000::updateMemoryMap()
+{
+    if(m_memoryMap)
+        m_memoryMap->mapMemory(0x8000, 0xFFFF, m_prg.data(), (m_numBlocks > 1) ? 0x8000 : 0x4000);
 }
\ No newline at end of file
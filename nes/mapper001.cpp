@@ -1,9 +1,11 @@
 #include "include/mapper001.h"
+#include "include/memoryMap.h"
 
-Mapper001::Mapper001(std::vector<uint8_t> prg, uint8_t numPrgBlocks, std::vector<uint8_t> chr, uint8_t numChr)
+#include <algorithm>
+
+Mapper001::Mapper001(RomSpan prg, uint8_t numPrgBlocks, RomSpan chr, uint8_t numChr)
 : m_prg{std::move(prg)}
 , m_numBlocks{numPrgBlocks}
-, m_chr{chr}
 , m_sr{0x10}
 , m_writeCounter{5}
 , m_ctrlData{0x1C}
@@ -21,8 +23,9 @@ Mapper001::Mapper001(std::vector<uint8_t> prg, uint8_t numPrgBlocks, std::vector
 , m_numChrBanks{numChr}
 
 , m_ram(8192, 0)
+, m_ramDirty{}
 {
-
+    setChrMemory(chr);
 }
 
 uint16_t Mapper001::cpuRead(uint16_t address)
@@ -62,6 +65,12 @@ uint16_t Mapper001::cpuRead(uint16_t address)
 
 void Mapper001::cpuWrite(uint16_t address, uint8_t data)
 {
+    if(address >= 0x6000 && address <= 0x7FFF)
+    {
+        m_ram[address & 0x1FFF] = data;
+        m_ramDirty[(address & 0x1FFF) >> 8] = 1;
+    }
+
     if(address >= 0x8000 && address <= 0xFFFF)
     {
         if((data & 0x80) > 0)
@@ -86,6 +95,8 @@ void Mapper001::cpuWrite(uint16_t address, uint8_t data)
                 m_writeCounter = 0;
             }
         }
+        updateMemoryMap();
+        updateChrMap();
     }
 }
 
@@ -95,22 +106,9 @@ uint16_t Mapper001::ppuRead(uint16_t address)
     {
         if(m_numChrBanks == 0)
             return address;
-        else
-        {
-            if(m_chrSwitchMode == 1)
-            {
-                // 4k banks
-                if(address >= 0x0000 && address <= 0x0fff)
-                    return m_chr[(m_numChrBank0 * 0x1000) | (address & 0x0fff)];
-                if(address >= 0x1000 && address <= 0x1fff)
-                    return m_chr[(m_numChrBank1 * 0x1000) | (address & 0x0fff)];
-            }
-            else
-            {
-                // 8k banks
-                return m_chr[(m_numChrBank8k * 0x2000) | (address & 0x1fff)];
-            }
-        }
+
+        const uint8_t* bank = chrBank(address);
+        return bank ? bank[address & 0x3FF] : 0x00;
     }
     return 0x00;
 }
@@ -127,6 +125,14 @@ void Mapper001::internalWrite(uint16_t address, uint8_t data)
         m_chrSwitchMode = ((data & 0b10000) >> 4);
         m_bankMode = (data & 0b01100) >> 2;
         m_ctrlData = (data & 0x1f);
+
+        switch(data & 0b00011)
+        {
+            case 0: setMirroring(Mirroring::SINGLE_SCREEN_A); break;
+            case 1: setMirroring(Mirroring::SINGLE_SCREEN_B); break;
+            case 2: setMirroring(Mirroring::VERTICAL); break;
+            case 3: setMirroring(Mirroring::HORIZONTAL); break;
+        }
     }
 
     if(address >= 0xA000 && address <= 0xBFFF)
@@ -166,4 +172,75 @@ void Mapper001::internalWrite(uint16_t address, uint8_t data)
             m_numBank32k = ((data & 0b1110) >> 1);
         }
     }
+}
+
+void Mapper001::updateMemoryMap()
+{
+    if(!m_memoryMap)
+        return;
+
+    m_memoryMap->mapMemory(0x6000, 0x7FFF, m_ram.data(), 0x2000, true, m_ramDirty.data());
+
+    auto mode =  (m_ctrlData >> 2) & 0x3;
+    if(mode == 2 || mode == 3)
+    {
+        uint32_t low = (mode == 3) ? m_numBank16k : 0;
+        uint32_t high = (mode == 3) ? m_maxNumBank16k : m_numBank16k;
+        m_memoryMap->mapMemory(0x8000, 0xBFFF, m_prg.data() + (low * 0x4000) % m_prg.size(), 0x4000);
+        m_memoryMap->mapMemory(0xC000, 0xFFFF, m_prg.data() + (high * 0x4000) % m_prg.size(), 0x4000);
+    }
+    else
+    {
+        uint32_t size = std::min<uint32_t>(m_prg.size(), 0x8000);
+        m_memoryMap->mapMemory(0x8000, 0xFFFF, m_prg.data() + (m_numBank32k * 0x8000) % m_prg.size(), size);
+    }
+}
+
+void Mapper001::updateChrMap()
+{
+    // CHR-RAM is read through ppuRead
+    if(m_numChrBanks == 0)
+        return;
+
+    for(uint8_t page = 0; page < 8; ++page)
+    {
+        if(m_chrSwitchMode == 1)
+            mapChr(page, ((page < 4 ? m_numChrBank0 : m_numChrBank1) * 0x1000) + ((page & 0x3) * 0x400));
+        else
+            mapChr(page, (m_numChrBank8k * 0x2000) + (page * 0x400));
+    }
+}
+
+void Mapper001::saveRegisters(StateWriter& state) const
+{
+    state.writePages(m_ram.data(), m_ramDirty.data(), m_ramDirty.size());
+    state.write(m_sr);
+    state.write(m_writeCounter);
+    state.write(m_ctrlData);
+    state.write(m_bankMode);
+    state.write(m_chrBankMode);
+    state.write(m_selectedPrgBank);
+    state.write(m_numBank16k);
+    state.write(m_numBank32k);
+    state.write(m_numChrBank0);
+    state.write(m_numChrBank1);
+    state.write(m_numChrBank8k);
+    state.write(m_chrSwitchMode);
+}
+
+void Mapper001::loadRegisters(StateReader& state)
+{
+    state.readPages(m_ram.data(), m_ramDirty.data(), m_ramDirty.size());
+    state.read(m_sr);
+    state.read(m_writeCounter);
+    state.read(m_ctrlData);
+    state.read(m_bankMode);
+    state.read(m_chrBankMode);
+    state.read(m_selectedPrgBank);
+    state.read(m_numBank16k);
+    state.read(m_numBank32k);
+    state.read(m_numChrBank0);
+    state.read(m_numChrBank1);
+    state.read(m_numChrBank8k);
+    state.read(m_chrSwitchMode);
 }
\ No newline at end of file
@@ -1,12 +1,12 @@
 #include "include/mapper002.h"
+#include "include/memoryMap.h"
 
-Mapper002::Mapper002(std::vector<uint8_t> prg, uint8_t numPrgBlocks, std::vector<uint8_t> chr)
+Mapper002::Mapper002(RomSpan prg, uint8_t numPrgBlocks, RomSpan chr)
 : m_prg{std::move(prg)}
 , m_numBlocks{numPrgBlocks}
-, m_chr{chr}
 , m_selectedBank{0x0000}
 {
-
+    setChrMemory(chr);
 }
 
 uint16_t Mapper002::cpuRead(uint16_t address)
@@ -21,15 +21,37 @@ uint16_t Mapper002::cpuRead(uint16_t address)
 void Mapper002::cpuWrite(uint16_t address, uint8_t data)
 {
     if(address >= 0x8000 && address <= 0xffff)
+    {
         m_selectedBank = data & 0xF;
+        updateMemoryMap();
+    }
 }
 
 uint16_t Mapper002::ppuRead(uint16_t address)
 {
-    return m_chr[address];
+    return readChr(address);
 }
 
 void Mapper002::ppuWrite(uint16_t address, uint8_t data)
 {
-    m_chr[address] = data;
+    writeChr(address, data);
+}
+
+void Mapper002::updateMemoryMap()
+{
+    if(!m_memoryMap)
+        return;
+
+    m_memoryMap->mapMemory(0x8000, 0xBFFF, m_prg.data() + (m_selectedBank * 0x4000) % m_prg.size(), 0x4000);
+    m_memoryMap->mapMemory(0xC000, 0xFFFF, m_prg.data() + (m_numBlocks - 1) * 0x4000, 0x4000);
+}
+
+void Mapper002::saveRegisters(StateWriter& state) const
+{
+    state.write(m_selectedBank);
+}
+
+void Mapper002::loadRegisters(StateReader& state)
+{
+    state.read(m_selectedBank);
 }
\ No newline at end of file
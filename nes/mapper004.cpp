@@ -1,12 +1,14 @@
 #include "include/mapper004.h"
+#include "include/memoryMap.h"
 #include <iostream>
 
-Mapper004::Mapper004(std::vector<uint8_t> prg, uint8_t numPrgBlocks, std::vector<uint8_t> chr, uint8_t numChr)
-: m_prg{std::move(prg)}
+Mapper004::Mapper004(RomSpan prg, uint8_t numPrgBlocks, RomSpan chr, uint8_t numChr, std::ostream& log)
+: m_log{log}
+, m_prg{std::move(prg)}
 , m_numBlocks{uint8_t(numPrgBlocks*(uint8_t)2)}
-, m_chr{chr}
 , m_numChrBanks{numChr}
 , m_ram(8192, 0)
+, m_ramDirty{}
 
 , m_prgMode{0}
 , m_chrMode{0}
@@ -18,7 +20,8 @@ Mapper004::Mapper004(std::vector<uint8_t> prg, uint8_t numPrgBlocks, std::vector
 , m_r{}
 {
     m_r.fill(0);
-    std::cout << "numBlocks:" << int(m_numBlocks) << std::endl;
+    setChrMemory(chr);
+    m_log << "numBlocks:" << int(m_numBlocks) << std::endl;
 }
 
 uint16_t Mapper004::cpuRead(uint16_t address)
@@ -70,14 +73,21 @@ uint16_t Mapper004::cpuRead(uint16_t address)
 
 void Mapper004::cpuWrite(uint16_t address, uint8_t data)
 {
-    std::cout << std::hex << "addr:0x" << address << "    data:0x" << data << std::endl;
-    if(address >= 0x8000 && address <= 0x9ffe && ((address & 0x1) == 0))
+    m_log << std::hex << "addr:0x" << address << "    data:0x" << data << std::endl;
+    if(address >= 0x6000 && address <= 0x7FFF)
+    {
+        m_ram[address & 0x1FFF] = data;
+        m_ramDirty[(address & 0x1FFF) >> 8] = 1;
+    }
+    else if(address >= 0x8000 && address <= 0x9ffe && ((address & 0x1) == 0))
     {
         //bank select
         m_bankRegisterSelect = data & 0x7;
         m_prgMode = (data & 0x40) >> 6;
         m_chrMode = (data & 0x80) >> 7;
-        std::cout << "PRG mode:" << int(m_prgMode) << std::endl;
+        m_log << "PRG mode:" << int(m_prgMode) << std::endl;
+        updateMemoryMap();
+        updateChrMap();
     }
     else if(address >= 0x8001 && address <= 0x9fff && ((address & 0x1) == 1))
     {
@@ -93,8 +103,16 @@ void Mapper004::cpuWrite(uint16_t address, uint8_t data)
         {
             m_r[m_bankRegisterSelect] = data;
         }
-        std::cout << "select register: " << int(m_bankRegisterSelect) << "   val:" << int(data) << std::endl;
+        m_log << "select register: " << int(m_bankRegisterSelect) << "   val:" << int(data) << std::endl;
         //m_r[m_bankRegisterSelect] &= 0x7;
+        updateMemoryMap();
+        updateChrMap();
+    }
+    else if(address >= 0xa000 && address <= 0xbffe && ((address & 0x1) == 0))
+    {
+        // hard wired four screen boards ignore it
+        if(m_mirroring != Mirroring::FOUR_SCREEN)
+            setMirroring((data & 0x1) ? Mirroring::HORIZONTAL : Mirroring::VERTICAL);
     }
     else if(address >= 0xc000 && address <= 0xdffe && ((address & 0x1) == 0) )
     {
@@ -117,78 +135,9 @@ void Mapper004::cpuWrite(uint16_t address, uint8_t data)
 
 uint16_t Mapper004::ppuRead(uint16_t address)
 {
-    if(m_chrMode == 0)
-    {
-        if(address >= 0x0000 && address <= 0x03ff)
-        {
-            return m_chr[(m_r[0] * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x0400 && address <= 0x07ff)
-        {
-            return m_chr[((m_r[0]+1) * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x0800 && address <= 0x0bff)
-        {
-            return m_chr[(m_r[1] * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x0c00 && address <= 0x0fff)
-        {
-            return m_chr[((m_r[1]+1) * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x1000 && address <= 0x13ff)
-        {
-            return m_chr[(m_r[2] * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x1400 && address <= 0x17ff)
-        {
-            return m_chr[(m_r[3] * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x1800 && address <= 0x1bff)
-        {
-            return m_chr[(m_r[4] * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x1c00 && address <= 0x1fff)
-        {
-            return m_chr[(m_r[5] * 0x400) + (address & 0x3ff)];
-        }
-    }
-    else
-    {
-        if(address >= 0x0000 && address <= 0x03ff)
-        {
-            return m_chr[(m_r[2] * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x0400 && address <= 0x07ff)
-        {
-            return m_chr[(m_r[3] * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x0800 && address <= 0x0bff)
-        {
-            return m_chr[(m_r[4] * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x0c00 && address <= 0x0fff)
-        {
-            return m_chr[(m_r[5] * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x1000 && address <= 0x13ff)
-        {
-            return m_chr[(m_r[0] * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x1400 && address <= 0x17ff)
-        {
-            return m_chr[((m_r[0]+1) * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x1800 && address <= 0x1bff)
-        {
-            return m_chr[(m_r[1] * 0x400) + (address & 0x3ff)];
-        }
-        else if(address >= 0x1c00 && address <= 0x1fff)
-        {
-            return m_chr[((m_r[1]+1) * 0x400) + (address & 0x3ff)];
-        }
-    }
-
-    return 0x00;
+    // the windows are set up by updateChrMap on bank register writes
+    const uint8_t* bank = chrBank(address);
+    return (bank && address < 0x2000) ? bank[address & 0x3FF] : 0x00;
 }
 
 void Mapper004::ppuWrite(uint16_t address, uint8_t data)
@@ -221,4 +170,57 @@ bool Mapper004::isIrqActive()
 void Mapper004::clearIrq()
 {
     m_irqActive = false;
+}
+
+bool Mapper004::hasScanlineCounter()
+{
+    return true;
+}
+
+void Mapper004::updateMemoryMap()
+{
+    if(!m_memoryMap)
+        return;
+
+    m_memoryMap->mapMemory(0x6000, 0x7FFF, m_ram.data(), 0x2000, true, m_ramDirty.data());
+
+    auto bank = [this](uint32_t num) { return m_prg.data() + (num * 0x2000) % m_prg.size(); };
+    m_memoryMap->mapMemory(0x8000, 0x9FFF, bank(m_prgMode == 0 ? m_r[6] : m_numBlocks - 2), 0x2000);
+    m_memoryMap->mapMemory(0xA000, 0xBFFF, bank(m_r[7]), 0x2000);
+    m_memoryMap->mapMemory(0xC000, 0xDFFF, bank(m_prgMode == 0 ? m_numBlocks - 2 : m_r[6]), 0x2000);
+    m_memoryMap->mapMemory(0xE000, 0xFFFF, bank(m_numBlocks - 1), 0x2000);
+}
+
+void Mapper004::updateChrMap()
+{
+    // two 2kB banks and four 1kB banks, chr mode swaps the pattern table halves
+    std::array<uint32_t, 8> banks{m_r[0], m_r[0] + 1u, m_r[1], m_r[1] + 1u, m_r[2], m_r[3], m_r[4], m_r[5]};
+    for(uint8_t page = 0; page < 8; ++page)
+        mapChr(page, banks[(page + (m_chrMode == 0 ? 0 : 4)) & 0x7] * 0x400);
+}
+
+void Mapper004::saveRegisters(StateWriter& state) const
+{
+    state.writePages(m_ram.data(), m_ramDirty.data(), m_ramDirty.size());
+    state.write(m_prgMode);
+    state.write(m_chrMode);
+    state.write(m_bankRegisterSelect);
+    state.write(m_irqCounter);
+    state.write(m_irqReloadValue);
+    state.write(m_irqEnabled);
+    state.write(m_irqActive);
+    state.write(m_r);
+}
+
+void Mapper004::loadRegisters(StateReader& state)
+{
+    state.readPages(m_ram.data(), m_ramDirty.data(), m_ramDirty.size());
+    state.read(m_prgMode);
+    state.read(m_chrMode);
+    state.read(m_bankRegisterSelect);
+    state.read(m_irqCounter);
+    state.read(m_irqReloadValue);
+    state.read(m_irqEnabled);
+    state.read(m_irqActive);
+    state.read(m_r);
 }
\ No newline at end of file
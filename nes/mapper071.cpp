@@ -1,12 +1,12 @@
 #include "include/mapper071.h"
+#include "include/memoryMap.h"
 
-Mapper071::Mapper071(std::vector<uint8_t> prg, uint8_t numPrgBlocks, std::vector<uint8_t> chr)
+Mapper071::Mapper071(RomSpan prg, uint8_t numPrgBlocks, RomSpan chr)
 : m_prg{std::move(prg)}
 , m_numBlocks{numPrgBlocks}
-, m_chr{chr}
 , m_selectedBank{0x0000}
 {
-
+    setChrMemory(chr);
 }
 
 uint16_t Mapper071::cpuRead(uint16_t address)
@@ -28,15 +28,35 @@ void Mapper071::cpuWrite(uint16_t address, uint8_t data)
     if(address >= 0xC000 && address <= 0xffff)
     {
         m_selectedBank = (data & 0xF) & (m_numBlocks - 1);
+        updateMemoryMap();
     }
 }
 
 uint16_t Mapper071::ppuRead(uint16_t address)
 {
-    return m_chr[address];
+    return readChr(address);
 }
 
 void Mapper071::ppuWrite(uint16_t address, uint8_t data)
 {
-    m_chr[address] = data;
+    writeChr(address, data);
+}
+
+void Mapper071::updateMemoryMap()
+{
+    if(!m_memoryMap)
+        return;
+
+    m_memoryMap->mapMemory(0x8000, 0xBFFF, m_prg.data() + (m_selectedBank * 0x4000) % m_prg.size(), 0x4000);
+    m_memoryMap->mapMemory(0xC000, 0xFFFF, m_prg.data() + (m_numBlocks - 1) * 0x4000, 0x4000);
+}
+
+void Mapper071::saveRegisters(StateWriter& state) const
+{
+    state.write(m_selectedBank);
+}
+
+void Mapper071::loadRegisters(StateReader& state)
+{
+    state.read(m_selectedBank);
 }
\ No newline at end of file
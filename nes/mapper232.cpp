@@ -1,13 +1,13 @@
 #include "include/mapper232.h"
+#include "include/memoryMap.h"
 
-Mapper232::Mapper232(std::vector<uint8_t> prg, uint8_t numPrgBlocks, std::vector<uint8_t> chr)
+Mapper232::Mapper232(RomSpan prg, uint8_t numPrgBlocks, RomSpan chr)
 : m_prg{std::move(prg)}
 , m_numBlocks{numPrgBlocks}
-, m_chr{chr}
 , m_selectedOuterBank{0x0000}
 , m_selectedInnerBank{0x0000}
 {
-
+    setChrMemory(chr);
 }
 
 uint16_t Mapper232::cpuRead(uint16_t address)
@@ -25,14 +25,37 @@ void Mapper232::cpuWrite(uint16_t address, uint8_t data)
         m_selectedOuterBank = ((data & 0x18) >> 3) & 0x3;
     if(address >= 0xC000 && address <= 0xffff)
         m_selectedInnerBank = (data & 0xF) & 0x3;
+    updateMemoryMap();
 }
 
 uint16_t Mapper232::ppuRead(uint16_t address)
 {
-    return m_chr[address];
+    return readChr(address);
 }
 
 void Mapper232::ppuWrite(uint16_t address, uint8_t data)
 {
-    m_chr[address] = data;
+    writeChr(address, data);
+}
+
+void Mapper232::updateMemoryMap()
+{
+    if(!m_memoryMap)
+        return;
+
+    uint32_t outer = m_selectedOuterBank * 0x10000;
+    m_memoryMap->mapMemory(0x8000, 0xBFFF, m_prg.data() + (outer + m_selectedInnerBank * 0x4000) % m_prg.size(), 0x4000);
+    m_memoryMap->mapMemory(0xC000, 0xFFFF, m_prg.data() + (outer + 3 * 0x4000) % m_prg.size(), 0x4000);
+}
+
+void Mapper232::saveRegisters(StateWriter& state) const
+{
+    state.write(m_selectedOuterBank);
+    state.write(m_selectedInnerBank);
+}
+
+void Mapper232::loadRegisters(StateReader& state)
+{
+    state.read(m_selectedOuterBank);
+    state.read(m_selectedInnerBank);
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "include/memoryMap.h"
+
+MemoryMap::MemoryMap()
+: m_dirtySink{0}
+{
+    clear();
+}
+
+void MemoryMap::mapDevice(uint8_t page, Device* device)
+{
+    m_pages[page].device = device;
+}
+
+void MemoryMap::mapRegister(uint16_t address, Device* device)
+{
+    auto& page = m_pages[address >> 8];
+    if(page.registers == nullptr)
+    {
+        m_registers.push_back(std::make_unique<std::array<Device*, 256>>());
+        m_registers.back()->fill(nullptr);
+        page.registers = m_registers.back()->data();
+    }
+    page.device = nullptr;
+    page.registers[address & 0xFF] = device;
+}
+
+void MemoryMap::mapMemory(uint16_t first, uint16_t last, uint8_t* data, uint32_t size, bool writable, uint8_t* dirty)
+{
+    // size smaller than the window mirrors the data, e.g. 2kB RAM over $0000-$1FFF
+    for(uint32_t page = first >> 8; page <= (last >> 8u); ++page)
+    {
+        uint32_t offset = ((page << 8) - first) % size;
+        m_pages[page].read = data + offset;
+        m_pages[page].write = writable ? data + offset : nullptr;
+        m_pages[page].dirty = dirty ? dirty + (offset >> 8) : &m_dirtySink;
+    }
+}
+
+void MemoryMap::mapMemory(uint16_t first, uint16_t last, const uint8_t* data, uint32_t size)
+{
+    // read-only, e.g. PRG-ROM shared with other instances
+    for(uint32_t page = first >> 8; page <= (last >> 8u); ++page)
+    {
+        uint32_t offset = ((page << 8) - first) % size;
+        m_pages[page].read = data + offset;
+        m_pages[page].write = nullptr;
+        m_pages[page].dirty = &m_dirtySink;
+    }
+}
+
+void MemoryMap::unmapMemory(uint16_t first, uint16_t last)
+{
+    for(uint32_t page = first >> 8; page <= (last >> 8u); ++page)
+    {
+        m_pages[page].read = nullptr;
+        m_pages[page].write = nullptr;
+    }
+}
+
+void MemoryMap::clear()
+{
+    m_pages.fill({nullptr, nullptr, &m_dirtySink, nullptr, nullptr});
+    m_registers.clear();
+}
\ No newline at end of file
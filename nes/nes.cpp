@@ -1,119 +1,538 @@
 #include "include/nes.h"
+#include "include/precompiled.h"
 
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <limits>
 
-Nes::Nes(const std::string& nesFile, std::function<uint8_t()> btnStateGetter, std::function<void(const uint32_t*)> frameUpdate)
-: m_controller{btnStateGetter}
-, m_cartridge{nesFile}
-, m_ppu{m_cartridge, frameUpdate}
-, m_cpu{m_bus, m_controller, m_ppu}
+namespace
+{
+    constexpr uint32_t STATE_MAGIC = 0x5353454E;    // "NESS"
+    constexpr uint32_t STATE_VERSION = 2;
+}
+
+Nes::Nes(const std::string& nesFile, std::function<uint8_t()> btnStateGetter, std::function<void(const uint32_t*)> frameUpdate, std::streambuf* log)
+: Nes{RomImage::load(nesFile), std::move(btnStateGetter), std::move(frameUpdate), log, nullptr}
+{
+
+}
+
+Nes::Nes(std::shared_ptr<const RomImage> image, std::function<uint8_t()> btnStateGetter, std::function<void(const uint32_t*)> frameUpdate, std::streambuf* log, const Nes* parent)
+: m_log{log}
+, m_controller{btnStateGetter}
+, m_cartridge{std::move(image), m_log}
+, m_ppu{m_cartridge, [this](const uint8_t* frame) { m_isFrameDone = true; m_isFrameReady = frame != nullptr; }, m_log}
+, m_videoOutput{m_ppu.getPalette(), VideoOutput::PixelFormat::XRGB8888, [frameUpdate](const void* frame) { frameUpdate(static_cast<const uint32_t*>(frame)); }}
+, m_cpu{m_bus, m_controller, m_ppu, m_log}
+, m_apu{m_log}
 , m_numOfCycles{1}
 , m_writeComplete{false}
 , m_dmaData{0x00}
 , m_dmaOffset{0x00}
 , m_dummyDma{true}
+, m_cpuDot{3}
+, m_localEndDot{std::numeric_limits<uint64_t>::max()}
+, m_isFrameDone{false}
+, m_isFrameReady{false}
+, m_runAhead{0}
+, m_runAheadCost{}
 {
-    m_bus.connect(m_cartridge);
-    m_bus.connect(m_ram);
-    m_bus.connect(m_ppu);
-    m_bus.connect(m_apu);
-    m_bus.connect(m_controller);
+    if(parent)
+        m_bus.connect({m_cartridge, m_ram, m_ppu, m_apu, m_controller}, parent->m_bus);
+    else
+    {
+        m_bus.connect(m_cartridge);
+        m_bus.connect(m_ram);
+        m_bus.connect(m_ppu);
+        m_bus.connect(m_apu);
+        m_bus.connect(m_controller);
+    }
+
+    m_cartridge.setCpuWriteCallback([this]() { m_ppu.sync(); });
+    m_cartridge.setMirroringCallback([this](Cartridge::Mirroring mirroring) { m_ppu.setMirroring(mirroring); });
+    m_cpu.setPrecompiled(m_cartridge.getRomImage()->data(), precompiled::find(m_cartridge.getRomHash()));
 }
 
 void Nes::start()
 {
-    uint64_t i = 0;
+    while(true)
+        runFrame();
+}
+
+void Nes::runFrame()
+{
+    while(!advance());
+}
+
+void Nes::runCycles(uint64_t cycles)
+{
+    uint64_t endDot = m_cpuDot + 3 * cycles;
+    m_localEndDot = endDot;
+    while(m_cpuDot < endDot)
+        advance();
+    m_localEndDot = std::numeric_limits<uint64_t>::max();
+}
+
+bool Nes::runUntil(const std::function<bool()>& predicate, uint64_t maxCycles)
+{
+    // the predicate sees every instruction
+    uint64_t endDot = m_cpuDot + 3 * maxCycles;
+    m_localEndDot = 0;
+    bool isDone = false;
+    while(!isDone && m_cpuDot < endDot)
+    {
+        advance();
+        isDone = predicate();
+    }
+    m_localEndDot = std::numeric_limits<uint64_t>::max();
+    return isDone;
+}
+
+bool Nes::runUntilPc(uint16_t pc, uint64_t maxCycles)
+{
+    // instructions run on their first cycle, so the one at pc has not run yet
+    return runUntil([this, pc]() { return m_cpu.getState().pc == pc; }, maxCycles);
+}
+
+bool Nes::runUntilScanline(int scanline, uint64_t maxCycles)
+{
+    // the PPU is brought up to date after each step, which gives up drawing whole lines at once
+    int previous = m_ppu.getScanline();
+    return runUntil([this, scanline, &previous]() {
+        m_ppu.sync();
+        bool isEntered = previous != scanline && m_ppu.getScanline() == scanline;
+        previous = m_ppu.getScanline();
+        return isEntered;
+    }, maxCycles);
+}
+
+bool Nes::advance()
+{
+    step();
+    if(!m_isFrameDone)
+        return false;
+    endFrame();
+    return true;
+}
+
+void Nes::step()
+{
+    // the CPU only touches the bus on a few of its cycles and the PPU is synced
+    // lazily when the CPU observes it, or by itself on dots that may raise an
+    // interrupt or finish a frame
+    uint64_t cpuDot = m_bus.isDmaRequested() ? m_cpuDot : m_cpuDot + 3 * m_cpu.cyclesToNextAction();
+    uint64_t ppuDot = m_ppu.nextEventDot();
+    uint64_t dot = std::min(cpuDot, ppuDot);
+
+    m_ppu.setCurrentDot(dot);
+    if(dot == ppuDot)
+        m_ppu.sync();
+
+    uint64_t idleUntil = std::min(dot, cpuDot - 1);
+    if(idleUntil >= m_cpuDot)
+    {
+        uint8_t cycles = (idleUntil - m_cpuDot) / 3 + 1;
+        m_cpu.idle(cycles);
+        m_cpuDot += 3 * cycles;
+    }
+
+    if(dot == cpuDot)
+    {
+        clockCpu();
+        m_cpuDot += 3;
+    }
+
+    pollInterrupts();
+    m_numOfCycles = dot + 1;
+
+    if(dot == cpuDot)
+        runLocalCode();
+}
+
+void Nes::runLocalCode()
+{
+    // instructions that only touch RAM and ROM cannot be seen by the PPU, the APU or a mapper
+    // and cannot raise an interrupt, so up to the next PPU event they run one after the
+    // other without syncing or polling anything in between. A finished frame is handed
+    // over first.
+    if(m_isFrameDone || m_bus.isDmaRequested() || m_ppu.isNmiRaised() || m_cartridge.isIrqActive())
+        return;
 
+    uint64_t endDot = std::min(m_ppu.nextEventDot(), m_localEndDot);
+    bool isJumpBack = false;
     while(true)
     {
-    //while(i < 8000000)
-        m_ppu.clock();
-        //m_apu.clock();
-        if(m_numOfCycles % 3 == 0)
+        uint8_t cycles = m_cpu.cyclesToNextAction();
+        uint64_t dot = m_cpuDot + 3 * cycles;
+        if(dot >= endDot)
+            return;
+
+        // an idle loop, a compiled block or a fused sequence runs several instructions, dot
+        // is where the last one started
+        uint32_t lastStart;
+        uint64_t limit = std::min<uint64_t>((endDot - dot - 1) / 3, UINT32_MAX);
+        uint16_t pc = m_cpu.getState().pc;
+        if((isJumpBack && runIdleLoop(dot, endDot, lastStart)) || m_cpu.runCompiled(limit, lastStart) || m_cpu.runFused(limit, lastStart))
+            dot += 3 * uint64_t{lastStart};
+        else if(m_cpu.isNextLocal())
+        {
+            m_cpu.idle(cycles);
+            m_cpu.clock();
+        }
+        else
+            return;
+
+        m_cpuDot = dot + 3;
+        m_numOfCycles = dot + 1;
+        isJumpBack = m_cpu.getState().pc <= pc;
+    }
+}
+
+bool Nes::runIdleLoop(uint64_t dot, uint64_t endDot, uint32_t& lastStart)
+{
+    // A loop waiting for the NMI handler or a PPUSTATUS flag, every round after the first one
+    // does the same until the next PPU event or the next dot the flags may change on. The PPU
+    // is brought up to the start of the loop to find that dot, its reads are done there.
+    bool isStatusRead = false;
+    if(!m_cpu.isNextIdleLoop(isStatusRead))
+        return false;
+    if(isStatusRead)
+    {
+        m_ppu.setCurrentDot(dot);
+        m_ppu.sync();
+        endDot = std::min(endDot, m_ppu.nextStatusDot());
+        if(dot >= endDot)
+            return false;
+    }
+    uint64_t limit = std::min<uint64_t>((endDot - dot - 1) / 3, UINT32_MAX);
+    return m_cpu.runIdleLoop(limit, lastStart);
+}
+
+void Nes::emulateFrame()
+{
+    m_isFrameDone = false;
+    while(!m_isFrameDone)
+        step();
+}
+
+void Nes::endFrame()
+{
+    // runs once the step that finished the frame is done, so the callback may save or load a state
+    auto frameEnd = std::chrono::steady_clock::now();
+    m_isFrameDone = false;
+    if(m_rewind)
+    {
+        StateWriter state{m_rewind->nextState(), m_rewind->stateSize(), STATE_KEEP_DIRTY | STATE_NO_PICTURE};
+        saveState(state);
+        m_rewind->push();
+    }
+    if(m_runAhead > 0)
+    {
+        m_runAheadCost.frameNs += std::chrono::duration_cast<std::chrono::nanoseconds>(frameEnd - m_frameStart).count();
+        runAhead();
+    }
+    if(m_isFrameReady)
+    {
+        m_isFrameReady = false;
+        m_videoOutput.present(m_ppu.getScreenData().data());
+    }
+    m_frameStart = std::chrono::steady_clock::now();
+}
+
+void Nes::runAhead()
+{
+    // the frames ahead see the same input as the one just emulated, only the last one is
+    // drawn and it stays in the frame buffer once the machine is back where it was
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    StateWriter snapshot{m_runAheadState.data(), m_runAheadState.size(), STATE_KEEP_DIRTY | STATE_NO_PICTURE};
+    saveState(snapshot);
+    auto saved = Clock::now();
+
+    for(uint32_t frame = 1; frame <= m_runAhead; ++frame)
+    {
+        m_ppu.setRendering(frame == m_runAhead);
+        emulateFrame();
+    }
+    m_isFrameDone = false;
+    auto ahead = Clock::now();
+
+    StateReader restore{m_runAheadState.data(), m_runAheadState.size(), STATE_KEEP_DIRTY};
+    loadState(restore);
+    m_ppu.setRendering(false);
+    auto restored = Clock::now();
+
+    m_runAheadCost.frames += 1;
+    m_runAheadCost.snapshotNs += std::chrono::duration_cast<std::chrono::nanoseconds>(saved - start).count();
+    m_runAheadCost.aheadNs += std::chrono::duration_cast<std::chrono::nanoseconds>(ahead - saved).count();
+    m_runAheadCost.restoreNs += std::chrono::duration_cast<std::chrono::nanoseconds>(restored - ahead).count();
+}
+
+void Nes::clockCpu()
+{
+    if(m_bus.isDmaRequested())
+    {
+        // before start we have to wait 1/2 idle cycles
+        if(m_dummyDma)
+        {
+            if(m_cpu.getClockTicks() % 2 == 0)
+                m_dummyDma = false;
+            else
+                m_cpu.increaseClockTicks(1);
+        }
+        else
         {
-            if(m_bus.isDmaRequested())
+            if(m_cpu.getClockTicks() % 2 == 0)
             {
-                // before start we have to wait 1/2 idle cycles
-                if(m_dummyDma)
-                {
-                    if(m_cpu.getClockTicks() % 2 == 0)
-                        m_dummyDma = false;
-                    else
-                        m_cpu.increaseClockTicks(1);
-                }
-                else
+                m_dmaData = m_cpu.read(((m_bus.getHighByte() << 8) | m_dmaOffset));
+            }
+            else
+            {
+                m_ppu.writeOamData(m_dmaOffset, m_dmaData);
+                m_dmaOffset += 1;
+                if(m_dmaOffset > 0xff)
                 {
-                    if(m_cpu.getClockTicks() % 2 == 0)
-                    {
-                        m_dmaData = m_cpu.read(((m_bus.getHighByte() << 8) | m_dmaOffset));
-                    }
-                    else
-                    {
-                        m_ppu.writeOamData(m_dmaOffset, m_dmaData);
-                        m_dmaOffset += 1;
-                        if(m_dmaOffset > 0xff)
-                        {
-                            m_bus.clearDmaRequest();
-                            m_writeComplete = false;
-                            m_dmaOffset = 0x00;
-                            m_dummyDma = true;
-                            m_cpu.increaseClockTicks(1);
-                        }
-                    }
+                    m_bus.clearDmaRequest();
+                    m_writeComplete = false;
+                    m_dmaOffset = 0x00;
+                    m_dummyDma = true;
                     m_cpu.increaseClockTicks(1);
                 }
             }
-            else
-                m_cpu.clock();
+            m_cpu.increaseClockTicks(1);
         }
+        return;
+    }
 
-        
-        if(m_ppu.isNmiRaised() && (m_cpu.cyclesLeft() != 0) && !m_ppu.m_raiseNmiNextIns)
-        {
-            m_cpu.nmi();
-            if(m_cpu.isPrintEnbled())
-            {
-                std::ofstream fh("log.txt", std::ios::app);
-                fh << "[NMI - Cycle: " << std::to_string(m_cpu.getClockTicks()-1) << "]\r\n";
-                fh.close();
-            }
-            m_ppu.clearNmi();
-        }
-        if(m_ppu.isNmiRaised() && (m_cpu.cyclesLeft() == 0) && m_ppu.m_raiseNmiNextIns)
-        {
-            m_ppu.m_raiseNmiNextIns = false;
-        }
+    // the dots before a fetch are the ones with no cycles left, that is where
+    // an NMI raised by a $2000 write gets armed for after the next instruction
+    if(m_ppu.isNmiRaised() && (m_cpu.cyclesLeft() == 0) && m_ppu.m_raiseNmiNextIns)
+        m_ppu.m_raiseNmiNextIns = false;
 
-        if(m_cartridge.isIrqActive())
-        {
-            m_cartridge.clearIrq();
-            m_cpu.irq();
-        }
-        /*
-        if(m_apu.irqRaised())
+    m_cpu.clock();
+}
+
+void Nes::pollInterrupts()
+{
+    if(m_ppu.isNmiRaised() && (m_cpu.cyclesLeft() != 0) && !m_ppu.m_raiseNmiNextIns)
+    {
+        m_cpu.nmi();
+        if(m_cpu.isPrintEnbled())
         {
-            m_cpu.irq();
+            m_cpu.trace("[NMI - Cycle: " + std::to_string(m_cpu.getClockTicks()-1) + "]\r\n");
         }
-        if(m_apu.dmcIrqRaised())
+        m_ppu.clearNmi();
+    }
+    if(m_ppu.isNmiRaised() && (m_cpu.cyclesLeft() == 0) && m_ppu.m_raiseNmiNextIns)
+    {
+        m_ppu.m_raiseNmiNextIns = false;
+    }
+
+    if(m_cartridge.isIrqActive())
+    {
+        m_cartridge.clearIrq();
+        m_cpu.irq();
+    }
+    /*
+    if(m_apu.irqRaised())
+    {
+        m_cpu.irq();
+    }
+    if(m_apu.dmcIrqRaised())
+    {
+        m_cpu.irq();
+        if(m_cpu.isPrintEnbled())
         {
-            m_cpu.irq();
-            if(m_cpu.isPrintEnbled())
-            {
-                std::ofstream fh("log.txt", std::ios::app);
-                fh << "[IRQ - Cycle: " << std::to_string(m_cpu.getClockTicks()-1) << "]\r\n";
-                fh.close();
-            }
+            m_cpu.trace("[IRQ - Cycle: " + std::to_string(m_cpu.getClockTicks()-1) + "]\r\n");
         }
-        */
-
-        m_numOfCycles += 1;
-        i+=1;
     }
+    */
 }
 
 void Nes::reset()
 {
     m_cpu.reset();
     m_ppu.reset();
+}
+
+void Nes::setVideoOutput(VideoOutput::PixelFormat format, std::function<void(const void*)> frameUpdate)
+{
+    m_videoOutput = VideoOutput{m_ppu.getPalette(), format, frameUpdate};
+}
+
+void Nes::setLog(std::streambuf* log)
+{
+    m_log.rdbuf(log);
+    m_log.clear();
+}
+
+void Nes::setTraceFile(const std::string& path)
+{
+    m_cpu.setTraceFile(path);
+}
+
+void Nes::setHeadless(bool headless, uint32_t renderInterval)
+{
+    // headless frames keep the timing, status flags and mapper IRQs but draw nothing,
+    // every renderInterval-th frame is still rendered and delivered (never when 0)
+    m_ppu.setRenderInterval(headless ? renderInterval : 1);
+}
+
+void Nes::setJit(Jit::Mode mode)
+{
+    m_cpu.setJitMode(mode);
+}
+
+void Nes::setFusionProfile(bool enabled)
+{
+    m_cpu.setFusionProfile(enabled);
+}
+
+std::vector<fusion::Count> Nes::getFusionProfile() const
+{
+    return m_cpu.getFusionProfile();
+}
+
+std::unique_ptr<Nes> Nes::clone(std::function<uint8_t()> btnStateGetter, std::function<void(const void*)> frameUpdate)
+{
+    // the child is built quietly from the mapped image and takes over a full snapshot, the
+    // pages written since the last snapshot of this machine stay flagged for its next delta
+    std::unique_ptr<Nes> child{new Nes(m_cartridge.getRomImage(), std::move(btnStateGetter), nullptr, nullptr, this)};
+    child->setLog(m_log.rdbuf());
+    child->setVideoOutput(m_videoOutput.getFormat(), std::move(frameUpdate));
+    child->m_ppu.setRenderInterval(m_ppu.getRenderInterval());
+    child->setJit(m_cpu.getJitMode());
+
+    if(m_cloneState.empty())
+        m_cloneState.resize(stateSize());
+    StateWriter state{m_cloneState.data(), m_cloneState.size(), STATE_KEEP_DIRTY};
+    saveState(state);
+    StateReader copy{m_cloneState.data(), m_cloneState.size()};
+    child->loadState(copy);
+    return child;
+}
+
+void Nes::setRewind(uint32_t maxFrames, size_t arenaSize)
+{
+    m_rewind.reset();
+    if(maxFrames > 0)
+        m_rewind = std::make_unique<Rewind>(stateSize(), arenaSize, maxFrames);
+}
+
+uint32_t Nes::rewind(uint32_t frames)
+{
+    if(!m_rewind)
+        return 0;
+    uint32_t steps = m_rewind->stepBack(frames);
+    if(steps > 0)
+    {
+        // pages changed by going back are flagged for the next delta
+        StateReader state{m_rewind->state(), m_rewind->stateSize(), STATE_KEEP_DIRTY};
+        loadState(state);
+    }
+    return steps;
+}
+
+void Nes::setRunAhead(uint32_t frames)
+{
+    m_runAhead = frames;
+    m_runAheadCost = RunAheadCost{};
+    m_runAheadState.assign(frames > 0 ? stateSize() : 0, 0);
+    m_frameStart = std::chrono::steady_clock::now();
+}
+
+const Nes::RunAheadCost& Nes::getRunAheadCost() const
+{
+    return m_runAheadCost;
+}
+
+size_t Nes::stateSize()
+{
+    StateWriter state{nullptr, 0};
+    saveState(state);
+    return state.size();
+}
+
+size_t Nes::saveState(uint8_t* data, size_t size)
+{
+    StateWriter state{data, size};
+    saveState(state);
+    return state.size();
+}
+
+size_t Nes::saveStateDelta(uint8_t* data, size_t size)
+{
+    StateWriter state{data, size, STATE_DELTA};
+    saveState(state);
+    return state.size();
+}
+
+void Nes::saveState(StateWriter& state)
+{
+    state.write(STATE_MAGIC);
+    state.write(STATE_VERSION);
+    state.write(m_cartridge.getRomHash());
+    size_t sizeOffset = state.size();
+    state.write(uint64_t{0});
+    state.write(state.isDelta());
+
+    m_cpu.saveState(state);
+    m_ppu.saveState(state);
+    m_ram.saveState(state);
+    m_apu.saveState(state);
+    m_controller.saveState(state);
+    m_bus.saveState(state);
+    m_cartridge.saveState(state);
+
+    state.write(m_numOfCycles);
+    state.write(m_writeComplete);
+    state.write(m_dmaData);
+    state.write(m_dmaOffset);
+    state.write(m_dummyDma);
+    state.write(m_cpuDot);
+
+    state.rewrite(sizeOffset, uint64_t{state.size()});
+}
+
+void Nes::loadState(const uint8_t* data, size_t size)
+{
+    StateReader state{data, size};
+    loadState(state);
+}
+
+void Nes::loadState(StateReader& state)
+{
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t romHash = 0;
+    uint64_t totalSize = 0;
+    bool isDelta = false;
+    state.read(magic);
+    state.read(version);
+    state.read(romHash);
+    state.read(totalSize);
+    state.read(isDelta);
+    if(magic != STATE_MAGIC || version != STATE_VERSION)
+        throw std::runtime_error("Nes::loadState() Unsupported state version:" + std::to_string(version));
+    if(romHash != m_cartridge.getRomHash())
+        throw std::runtime_error("Nes::loadState() State is for another ROM");
+    if(state.size() < totalSize)
+        throw std::runtime_error("Nes::loadState() Truncated state, size:" + std::to_string(state.size()));
+
+    m_cpu.loadState(state);
+    m_ppu.loadState(state);
+    m_ram.loadState(state);
+    m_apu.loadState(state);
+    m_controller.loadState(state);
+    m_bus.loadState(state);
+    m_cartridge.loadState(state);
+
+    state.read(m_numOfCycles);
+    state.read(m_writeComplete);
+    state.read(m_dmaData);
+    state.read(m_dmaOffset);
+    state.read(m_dummyDma);
+    state.read(m_cpuDot);
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "include/nesBatch.h"
+
+#include <cstring>
+#include <algorithm>
+
+NesBatch::NesBatch(const std::vector<std::string>& nesFiles, size_t numThreads, VideoOutput::PixelFormat format)
+: m_inputs(nesFiles.size(), 0)
+, m_observations{nullptr}
+, m_observationSize{256 * 240 * size_t{VideoOutput::bytesPerPixel(format)}}
+, m_generation{0}
+, m_remaining{0}
+, m_isStopping{false}
+{
+    for(size_t i = 0; i < nesFiles.size(); ++i)
+    {
+        auto nes = std::make_unique<Nes>(nesFiles[i], [this, i]() { return m_inputs[i]; }, nullptr, nullptr);
+        nes->setVideoOutput(format, [this, i](const void* frame) {
+            std::memcpy(m_observations + i * m_observationSize, frame, m_observationSize);
+        });
+        nes->reset();
+        m_machines.push_back(std::move(nes));
+    }
+
+    if(numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    numThreads = std::max<size_t>(1, std::min(numThreads, m_machines.size()));
+    for(size_t i = 0; i < numThreads; ++i)
+        m_workers.push_back(std::make_unique<Worker>());
+    for(size_t i = 0; i < numThreads; ++i)
+        m_threads.emplace_back(&NesBatch::run, this, i);
+}
+
+NesBatch::~NesBatch()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_isStopping = true;
+    }
+    m_start.notify_all();
+    for(auto& thread : m_threads)
+        thread.join();
+}
+
+void NesBatch::stepFrame(const uint8_t* inputs, void* observations)
+{
+    if(m_machines.empty())
+        return;
+
+    std::copy(inputs, inputs + m_machines.size(), m_inputs.begin());
+    m_observations = static_cast<uint8_t*>(observations);
+
+    // set before the queues are filled, a thread still looking for work from the previous
+    // frame may already pick up a machine
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_remaining = m_machines.size();
+        m_error = nullptr;
+    }
+    for(size_t worker = 0; worker < m_workers.size(); ++worker)
+    {
+        std::lock_guard<std::mutex> lock{m_workers[worker]->mutex};
+        size_t first = worker * m_machines.size() / m_workers.size();
+        size_t last = (worker + 1) * m_machines.size() / m_workers.size();
+        for(size_t machine = first; machine < last; ++machine)
+            m_workers[worker]->queue.push_back(machine);
+    }
+
+    std::unique_lock<std::mutex> lock{m_mutex};
+    ++m_generation;
+    m_start.notify_all();
+    m_done.wait(lock, [this]() { return m_remaining == 0; });
+    if(m_error)
+        std::rethrow_exception(m_error);
+}
+
+size_t NesBatch::observationSize() const
+{
+    return m_observationSize;
+}
+
+size_t NesBatch::size() const
+{
+    return m_machines.size();
+}
+
+Nes& NesBatch::operator[](size_t index)
+{
+    return *m_machines[index];
+}
+
+void NesBatch::run(size_t worker)
+{
+    uint64_t generation = 0;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock{m_mutex};
+            m_start.wait(lock, [this, generation]() { return m_isStopping || m_generation != generation; });
+            if(m_isStopping)
+                return;
+            generation = m_generation;
+        }
+
+        size_t machine = 0;
+        size_t count = 0;
+        while(next(worker, machine))
+        {
+            try
+            {
+                m_machines[machine]->runFrame();
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock{m_mutex};
+                if(!m_error)
+                    m_error = std::current_exception();
+            }
+            ++count;
+        }
+
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_remaining -= count;
+        if(m_remaining == 0)
+            m_done.notify_one();
+    }
+}
+
+bool NesBatch::next(size_t worker, size_t& machine)
+{
+    // own range from the front, the others from the back
+    for(size_t i = 0; i < m_workers.size(); ++i)
+    {
+        Worker& queue = *m_workers[(worker + i) % m_workers.size()];
+        std::lock_guard<std::mutex> lock{queue.mutex};
+        if(queue.queue.empty())
+            continue;
+        if(i == 0)
+        {
+            machine = queue.queue.front();
+            queue.queue.pop_front();
+        }
+        else
+        {
+            machine = queue.queue.back();
+            queue.queue.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
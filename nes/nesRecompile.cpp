@@ -0,0 +1,33 @@
+#include "include/recompiler.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+// Writes the C++ for the PRG-ROM code of a ROM. Compiled and linked with the core, the blocks
+// run in place of the interpreter for that ROM whenever the JIT is on.
+int main(int argc, char** argv)
+{
+    if(argc != 3)
+    {
+        std::cerr << "usage: nesRecompile game.nes out.cpp" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        Recompiler recompiler{argv[1]};
+        std::ofstream out{argv[2]};
+        if(!out)
+            throw std::runtime_error(std::string("Cannot write ") + argv[2]);
+        recompiler.write(out);
+        std::cout << recompiler.getNumBlocks() << " blocks" << std::endl;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
\ No newline at end of file
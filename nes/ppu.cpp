@@ -3,6 +3,7 @@
 #include <iostream>
 #include <exception>
 #include <sstream>
+#include <algorithm>
 
 Ppuctrl byteToPpuCtrl(uint8_t data)
 {
@@ -155,8 +156,9 @@ bool OamData::flipVertical()
     return (attr & 0x80) > 0;
 }
 
-Ppu::Ppu(Cartridge& cartridge, std::function<void(const uint32_t*)> frameUpdate)
-: m_cartridge{cartridge} 
+Ppu::Ppu(Cartridge& cartridge, std::function<void(const uint8_t*)> frameUpdate, std::ostream& log)
+: m_cartridge{cartridge}
+ , m_log{log}
  , m_cycle{0}, 
  m_scanline{0}, 
  m_isOddFrame{true}, 
@@ -165,15 +167,21 @@ Ppu::Ppu(Cartridge& cartridge, std::function<void(const uint32_t*)> frameUpdate)
  m_status{}, 
  m_currAddr{}, 
  m_tmpAddr{},
- m_th{0x0000, 0x0000},
+ m_nt0{},
+ m_nt1{},
+ m_nt2{},
+ m_nt3{},
+ m_paletteRam{},
+ m_th{0},
  m_paletteIdx{0x0},
  m_backgroundHalf{0},
  m_frameCnt{1},
  m_nextTileId{0},
  m_paletteBaseAddr{0x3F00},
- m_nextTileData{0x0000, 0x0000},
+ m_nextTileData{0x0000},
  m_bgPixel{0x0},
- m_frameData(256*240),
+ m_frameData(256*240, 0x0F),    // black until something is drawn
+ m_frameDirty{},
  m_raiseNmi{false},
  m_lastWrittenData{0x00},
  m_addressLatch{0},
@@ -183,18 +191,26 @@ Ppu::Ppu(Cartridge& cartridge, std::function<void(const uint32_t*)> frameUpdate)
  m_oamAddr{0x00},
  m_secondaryOam{},
  m_numSecondarySprites{0x00},
- m_secondaryOamNumPixelToDraw{{8, 8, 8, 8, 8, 8, 8, 8}},
- m_secondaryOamXCounter{{0, 0, 0, 0, 0, 0, 0, 0}},
  m_secondaryOamAttrBytes{{8, 8, 8, 8, 8, 8, 8, 8}},
- m_sh{TileHelper(0x0000,0x0000), TileHelper(0x0000,0x0000),TileHelper(0x0000,0x0000),TileHelper(0x0000,0x0000),TileHelper(0x0000,0x0000),TileHelper(0x0000,0x0000),TileHelper(0x0000,0x0000),TileHelper(0x0000,0x0000)},
- m_nextAttribDataH{0x0000, 0x0000},
+ m_spriteLine{},
+ m_spriteFront{},
+ m_spriteZero{},
+ m_spriteDot{256},
+ m_isSpriteLineUsed{false},
+ m_isSpriteZeroOnLine{false},
+ m_nextAttribDataH{0},
  m_nextAttribData{0x00},
  m_vblankRead{false},
  m_vblankFlagRead{false},
  m_fineX{0x0}
  , m_raiseNmiNextIns{false}
  , m_frameNum{0x01}
+ , m_dots{0}
+ , m_currentDot{0}
+ , m_nextEventDot{0}
  , m_frameUpdate{frameUpdate}
+ , m_renderInterval{1}
+ , m_isRendering{true}
 {
     /*
     m_palette[0x00] = {84, 84, 84};
@@ -331,8 +347,11 @@ Ppu::Ppu(Cartridge& cartridge, std::function<void(const uint32_t*)> frameUpdate)
     m_palette[0x3E] = 0x000000;
     m_palette[0x3F] = 0x000000;
 
-    std::cout << "m_raiseNmi " << m_raiseNmi << std::endl;
+    m_log << "m_raiseNmi " << m_raiseNmi << std::endl;
 
+    m_nameTableDirty.fill(0);
+    setMirroring(m_cartridge.getMirroring());
+    updateNextEvent();
 }
 
 uint8_t Ppu::readVideoMem(uint16_t address)
@@ -340,29 +359,7 @@ uint8_t Ppu::readVideoMem(uint16_t address)
     address &= 0x3FFF;
     if(address >= 0x2000 && address <= 0x3eff)
     {
-        uint16_t index{static_cast<uint16_t>(address & 0x03ff)};
-        if(m_cartridge.getMirroring() == Cartridge::Mirroring::HORIZONTAL)  // horizontal
-        {
-            if( (address >= 0x2000 && address <= 0x23ff) || (address >= 0x2400 && address <= 0x27ff))
-                return m_nt0[index];
-            else if((address >= 0x2800 && address <= 0x2bff) || (address >= 0x2c00 && address <= 0x2fff))
-                return m_nt1[index];
-            else if( (address >= 0x3000 && address <= 0x33ff) || (address >= 0x3400 && address <= 0x37ff))
-                return m_nt0[index];
-            else if((address >= 0x3800 && address <= 0x3bff) || (address >= 0x3c00 && address <= 0x3eff))
-                return m_nt1[index];
-        }
-        else
-        {
-            if((address >= 0x2000 && address <= 0x23ff) || (address >= 0x2800 && address <= 0x2bff))
-                return m_nt0[index];
-            else if((address >= 0x2400 && address <= 0x27ff) || (address >= 0x2c00 && address <= 0x2fff))
-                return m_nt1[index];
-            else if((address >= 0x3000 && address <= 0x33ff) || (address >= 0x3800 && address <= 0x3bff))
-                return m_nt0[index];
-             else if((address >= 0x3400 && address <= 0x37ff) || (address >= 0x3c00 && address <= 0x3eff))
-                return m_nt1[index];               
-        }
+        return m_nameTables[(address >> 10) & 0x3][address & 0x3ff];
     } 
     else if(address >= 0x3f00 && address <= 0x3fff) 
     {
@@ -381,18 +378,19 @@ uint8_t Ppu::readVideoMem(uint16_t address)
         return m_cartridge.ppuRead(address);  // TODO: check it
     }
 
-    std::cout << "readVideoMem address out of range: 0x" << std::hex << address << std::endl;
+    m_log << "readVideoMem address out of range: 0x" << std::hex << address << std::endl;
     return 0x0000;
 }
 
-TileRow Ppu::getTileData(uint8_t tileNum, uint8_t row, uint8_t half)
+uint16_t Ppu::getTileData(uint8_t tileNum, uint8_t row, uint8_t half, bool flip)
 {
-    uint16_t lowerIdx{static_cast<uint16_t>((16 * tileNum) + row)};
-    uint16_t upperIdx{static_cast<uint16_t>(lowerIdx + 8)};
-    if(half == 0)   // left
-        return {m_cartridge.ppuRead(lowerIdx), m_cartridge.ppuRead(upperIdx)};
-    else           // right - background
-        return {m_cartridge.ppuRead(lowerIdx | 0x1000), m_cartridge.ppuRead(upperIdx | 0x1000)};
+    uint16_t address = ((half == 0) ? 0x0000 : 0x1000) | (tileNum << 4);
+    const uint16_t* rows = m_cartridge.tileRows(address);
+    if(rows)
+        return rows[(row & 0x7) + (flip ? 8 : 0)];
+
+    // the mapper has no decoded tiles, both bit planes are read and decoded here
+    return TileCache::decodeRow(m_cartridge.ppuRead(address + row), m_cartridge.ppuRead(address + row + 8), flip);
 }
 
 void Ppu::getPaletteIdx()
@@ -415,7 +413,6 @@ void Ppu::clearSecondaryOam()
 void Ppu::fillSecondaryOam(int y)
 {
     m_numSecondarySprites = 0;
-    m_secondaryOamNumPixelToDraw.fill(0);
     uint8_t n = (m_ctrl.spriteSize == 1) ? 16 : 8;
     
     for(int i =0; i < 64; ++i)
@@ -425,9 +422,7 @@ void Ppu::fillSecondaryOam(int y)
             if(m_numSecondarySprites < 8)
             {
                 m_secondaryOam[m_numSecondarySprites] = m_oam[i];
-                m_secondaryOamXCounter[m_numSecondarySprites] = m_oam[i].x + 1;
                 m_secondaryOamAttrBytes[m_numSecondarySprites] = m_oam[i].attr;
-                m_secondaryOamNumPixelToDraw[m_numSecondarySprites] = 8;
             }
             m_numSecondarySprites += 1;
             if(m_numSecondarySprites >= 8)
@@ -440,44 +435,60 @@ void Ppu::fillSecondaryOam(int y)
     }
 }
 
-void Ppu::decrementSpriteXCounters()
+void Ppu::drawSpritePixel()
 {
-    for(int i =0; i < m_numSecondarySprites; ++i )
+    // one step of the sprite x counters, the line buffer says which sprite pixel it lands on
+    if(m_spriteDot >= 256)
+        return;
+    uint16_t step = m_spriteDot++;
+    if(m_spriteLine[step] == 0)
+        return;
+
+    // dot 0 of the first line has no pixel
+    int pixel = (m_cycle - 1) + (256 * m_scanline);
+    if(m_bgPixel == 0)
     {
-        if(m_secondaryOamXCounter[i] > 0)
-            m_secondaryOamXCounter[i] -= 1;
-        if(m_secondaryOamXCounter[i] == 0 && m_secondaryOamNumPixelToDraw[i] > 0)
+        if(!m_isRendering)
+            return;
+        uint8_t sprite = m_spriteLine[step];
+        uint8_t idx = (sprite & 0x3) ? readVideoMem(0x3F10 + (sprite & 0xF)) : readVideoMem(0x3F00);
+        if(pixel >= 0)
         {
-            uint8_t color = m_sh[i].shift();
-
-            uint8_t pallete_idx = m_secondaryOam[i].palette();
-            uint8_t idx = (readVideoMem(0x3F10 + (pallete_idx << 2) + color)) & 0x3f;
-
-            uint8_t priority = (m_secondaryOamAttrBytes[i] & 0x20) >> 5;
-
-            if(m_bgPixel == 0 && color == 0)
-            {
-                idx = (readVideoMem(0x3F00) & 0x3f);
-                m_frameData[(m_cycle - 1) + (256 * m_scanline)] = m_palette[idx];
-            }
-            else if(m_bgPixel == 0 && color != 0)
-                m_frameData[(m_cycle - 1) + (256 * m_scanline)] = m_palette[idx];
-            else if(m_bgPixel != 0 && color != 0 && priority == 0)
-                m_frameData[(m_cycle - 1) + (256 * m_scanline)] = m_palette[idx];
-
-            m_secondaryOamNumPixelToDraw[i] -= 1;
-
-            if(!m_status.spriteZeroHit && m_oam[0].tile_num == m_secondaryOam[i].tile_num && color != 0 && m_bgPixel != 0)
-            {
-                m_status.spriteZeroHit = true;
-            }
+            writePixel(pixel, idx & 0x3f);
+        }
+    }
+    else
+    {
+        uint8_t sprite = m_spriteFront[step];
+        if(sprite != 0 && pixel >= 0 && m_isRendering)
+        {
+            writePixel(pixel, readVideoMem(0x3F10 + (sprite & 0xF)) & 0x3f);
         }
+
+        if(m_spriteZero[step])
+            m_status.spriteZeroHit = true;
     }
 }
 
-void Ppu::fillSpritesShiftRegisters(int y)
+void Ppu::fillSpriteLine(int y)
 {
-    for(int i=0; i<8; ++i)
+    // decodes the sprites found for the next line into per step buffers. A sprite starts drawing
+    // on step x, for each step the last sprite over it wins the same way it did when every sprite
+    // wrote the pixel in turn.
+    if(m_isSpriteLineUsed)
+    {
+        m_spriteLine.fill(0);
+        m_spriteFront.fill(0);
+        m_spriteZero.fill(0);
+    }
+    m_isSpriteLineUsed = m_numSecondarySprites > 0;
+    m_isSpriteZeroOnLine = false;
+    m_spriteDot = 0;
+
+    // headless frames only need the sprite 0 hit, the last line is drawn on the first line of the next frame
+    bool isFull = m_isRendering || y == 239;
+
+    for(int i = 0; i < m_numSecondarySprites; ++i)
     {
         OamData sprite = m_secondaryOam[i];
         uint8_t row = y - sprite.y;
@@ -500,30 +511,44 @@ void Ppu::fillSpritesShiftRegisters(int y)
             row = 7 - row;
         }
 
-        TileRow tr = getTileData(tile_num, row, half);
-        
-        if(sprite.flipHorizontally())
+        uint16_t pixels = getTileData(tile_num, row, half, sprite.flipHorizontally());
+        uint8_t palette = 0x80 | (sprite.palette() << 2);
+        bool front = (m_secondaryOamAttrBytes[i] & 0x20) == 0;
+        bool zero = m_oam[0].tile_num == sprite.tile_num;
+        if(!isFull && !zero)
+            continue;
+
+        // the x counter is loaded with x + 1 in 8 bits, a sprite at 255 starts right away
+        uint16_t firstStep = (sprite.x == 255) ? 0 : sprite.x;
+        for(uint16_t step = firstStep, p = 0; step < 256 && p < 8; ++step, ++p)
         {
-            tr.lower = reverseBits(tr.lower);
-            tr.upper = reverseBits(tr.upper);
+            uint8_t color = (pixels >> (14 - 2 * p)) & 0x3;
+            m_spriteLine[step] = palette | color;
+            if(color != 0 && front)
+                m_spriteFront[step] = palette | color;
+            if(color != 0 && zero)
+            {
+                m_spriteZero[step] = 1;
+                m_isSpriteZeroOnLine = true;
+            }
         }
-
-        uint16_t l = uint16_t(tr.lower) << 8;
-        uint16_t u = uint16_t(tr.upper) << 8;
-
-        m_sh[i].writeLower(l);
-        m_sh[i].writeUpper(u);
     }
 }
 
 
-const std::vector<uint32_t>& Ppu::getScreenData()
+const std::vector<uint8_t>& Ppu::getScreenData()
 {
     return m_frameData;
 }
 
+const std::array<uint32_t, 64>& Ppu::getPalette()
+{
+    return m_palette;
+}
+
 void Ppu::cpuWrite(uint16_t address, uint8_t data)
 {
+    sync();
     address &= 0x7;
     if(address == 0x0)
     {
@@ -539,17 +564,19 @@ void Ppu::cpuWrite(uint16_t address, uint8_t data)
 
         if( m_status.verticalBlank && m_ctrl.generateNmi && !oldNmi)
         {
-            std::cout << "PPU write 0x2000 generate NMI now\r\n";
+            m_log << "PPU write 0x2000 generate NMI now\r\n";
             m_raiseNmi = true;
             m_raiseNmiNextIns = true;
         }
 
+        updateNextEvent();
         return;
     }
     else if(address == 0x1)
     {
         m_lastWrittenData = data;
         m_mask = byteToPpuMask(data);
+        updateNextEvent();
         return;
     }
     else if(address == 0x3)
@@ -602,27 +629,9 @@ void Ppu::cpuWrite(uint16_t address, uint8_t data)
         m_lastWrittenData = data;
         if(m_currAddr.vramAddr >= 0x2000 && m_currAddr.vramAddr <= 0x3eff)
         {
-            uint16_t index = m_currAddr.vramAddr & 0x3ff;
-            if(m_cartridge.getMirroring() == Cartridge::Mirroring::HORIZONTAL)
-            {
-                if(m_currAddr.vramAddr >= 0x2000 && m_currAddr.vramAddr <= 0x23ff)
-                    m_nt0[index] = data;
-                else if(m_currAddr.vramAddr >= 0x2400 && m_currAddr.vramAddr <= 0x27ff)
-                    m_nt0[index] = data;
-                else if(m_currAddr.vramAddr >= 0x2800 && m_currAddr.vramAddr <= 0x2bff)
-                    m_nt1[index] = data;
-                else if(m_currAddr.vramAddr >= 0x2c00 && m_currAddr.vramAddr <= 0x2fff)
-                    m_nt1[index] = data;
-            }
-            else
-                if(m_currAddr.vramAddr >= 0x2000 && m_currAddr.vramAddr <= 0x23ff)
-                    m_nt0[index] = data;
-                else if(m_currAddr.vramAddr >= 0x2400 && m_currAddr.vramAddr <= 0x27ff)
-                    m_nt1[index] = data;
-                else if(m_currAddr.vramAddr >= 0x2800 && m_currAddr.vramAddr <= 0x2bff)
-                    m_nt0[index] = data;
-                else if(m_currAddr.vramAddr >= 0x2c00 && m_currAddr.vramAddr <= 0x2fff)
-                    m_nt1[index] = data;
+            uint8_t table = (m_currAddr.vramAddr >> 10) & 0x3;
+            m_nameTables[table][m_currAddr.vramAddr & 0x3ff] = data;
+            m_nameTableDirty[(m_nameTableIndex[table] << 2) | ((m_currAddr.vramAddr & 0x3ff) >> 8)] = 1;
         }
         else if(m_currAddr.vramAddr >= 0x3f00 && m_currAddr.vramAddr <= 0x3fff)
         {
@@ -640,17 +649,18 @@ void Ppu::cpuWrite(uint16_t address, uint8_t data)
         else if(m_currAddr.vramAddr >= 0 && m_currAddr.vramAddr <= 0x1fff)
             m_cartridge.ppuWrite(m_currAddr.vramAddr, data);
         else
-            std::cout << "ppu::write() Eception, unhandled vram addr: " << m_currAddr.vramAddr << " data: " << int(data) << std::endl;
+            m_log << "ppu::write() Eception, unhandled vram addr: " << m_currAddr.vramAddr << " data: " << int(data) << std::endl;
 
         m_currAddr.vramAddr += m_ctrl.vramAddressIncrement;
     }
     else
-        std::cout << "ppu::write() Exception, unhandled address: " << address << " data: " << int(data) << std::endl;
+        m_log << "ppu::write() Exception, unhandled address: " << address << " data: " << int(data) << std::endl;
 }
 
 
 uint8_t Ppu::cpuRead(uint16_t address)
 {
+    sync();
     address &= 0x7;
     if(address == 0x2)
     {
@@ -704,8 +714,7 @@ uint8_t Ppu::cpuRead(uint16_t address)
         }
         else if(adr >= 0x3f00 && adr <= 0x3fff)
         {
-            uint8_t index = adr & 0x3ff;
-            m_readBuffer = m_nt1[index];
+            m_readBuffer = m_nameTables[3][adr & 0x3ff];
             uint8_t addr = adr & 0x001F;
             if(addr == 0x0010)
                 addr = 0x0000;
@@ -731,13 +740,15 @@ uint8_t Ppu::cpuRead(uint16_t address)
         return val;
     }
     
-    std::cout << "Ppu::read() Exception, unhandled address: 0x" << std::hex << address << std::endl;
+    m_log << "Ppu::read() Exception, unhandled address: 0x" << std::hex << address << std::endl;
     return 0x00;
 }
 
 void Ppu::reset()
 {
+    sync();
     m_cycle = 24;
+    updateNextEvent();
 }
 
 bool Ppu::isAddressInRange(uint16_t address) const
@@ -752,8 +763,10 @@ bool Ppu::isNmiRaised()
 
 void Ppu::clearNmi()
 {
+    sync();
     m_raiseNmi = false;
     m_cycle += 21;
+    updateNextEvent();
 }
 
 bool Ppu::bgRenderingEnabled()
@@ -763,12 +776,13 @@ bool Ppu::bgRenderingEnabled()
 
 void Ppu::writeOamData(uint8_t address, uint8_t data)
 {
+        sync();
         uint8_t idx = address/4;
         uint8_t param_idx = address % 4;
 
         if(idx >= m_oam.size())
         {
-            std::cout << "out of range" << std::endl;
+            m_log << "out of range" << std::endl;
         }
 
         if(param_idx == 0)
@@ -788,7 +802,7 @@ uint8_t Ppu::readOamData(uint8_t address)
 
     if(idx >= m_oam.size())
     {
-        std::cout << "readOamData(), out of range" << std::endl;
+        m_log << "readOamData(), out of range" << std::endl;
     }
 
     if(param_idx == 0)
@@ -800,20 +814,64 @@ uint8_t Ppu::readOamData(uint8_t address)
     else if(param_idx == 3)
         return m_oam[idx].x;
 
-    std::cout << "read OAM should not happen..." << std::endl;
+    m_log << "read OAM should not happen..." << std::endl;
     return 0x0;
 }
 
 uint16_t Ppu::getCycle()
 {
+    sync();
     return m_cycle;
 }
 
 int Ppu::getScanline()
 {
+    sync();
     return m_scanline;
 }
 
+void Ppu::fetchBackground()
+{
+    uint8_t r = m_cycle % 8;
+    if(r == 2)
+    {
+        m_nextTileId = readVideoMem(m_currAddr.getVramAddress());
+    }
+
+    else if(r == 4)
+    {
+        uint16_t addr = m_currAddr.baseNameTable | 0x3c0 | (m_currAddr.tileX >> 2) | ((m_currAddr.tileY >> 2) << 3);
+
+        uint8_t attrData = readVideoMem(addr);
+
+        if(m_currAddr.tileY & 0x02)
+            attrData >>= 4;
+        if( m_currAddr.tileX & 0x02)
+            attrData >>= 2;
+        attrData &= 0x03;
+        m_nextAttribData = attrData;
+        m_paletteIdx = attrData;
+        m_paletteBaseAddr = 0x3F00 + (m_paletteIdx << 2);
+    }
+    // performcne improvement, read tile data at once
+    //else if( m_cycle % 8 == 6:
+    //    self.next_tile_low, u1 = self.cardridge.get_tile_data(self.next_tile_id, m_currAddr.fine_y,
+    //                                                          self.background_half)
+
+    else if(r == 0)
+    {
+        m_nextTileData = getTileData(m_nextTileId, m_currAddr.fineY, m_backgroundHalf, false);
+        m_currAddr.incrementTileX();
+    }
+    else if( r == 1 && m_cycle > 1)
+    {
+        m_th.writeLow(m_nextTileData);
+
+        // the attribute is repeated for each of the 8 pixels
+        m_nextAttribDataH.writeLow(0x5555 * (m_nextAttribData & 0x3));
+    }
+}
+
 void Ppu::clock() 
 {
     if (m_scanline == -1) 
@@ -850,11 +908,10 @@ void Ppu::clock()
             uint8_t secondTileId = readVideoMem(m_currAddr.getVramAddress());
             m_currAddr.incrementTileX();
 
-            TileRow tr1 = getTileData(firstTileId, m_currAddr.fineY,  m_backgroundHalf);
-            TileRow tr2 = getTileData(secondTileId, m_currAddr.fineY, m_backgroundHalf);
+            uint16_t firstTile = getTileData(firstTileId, m_currAddr.fineY,  m_backgroundHalf, false);
+            uint16_t secondTile = getTileData(secondTileId, m_currAddr.fineY, m_backgroundHalf, false);
 
-            m_th.writeLower((tr1.lower << 8) | tr2.lower);
-            m_th.writeUpper((tr1.upper << 8) | tr2.upper);
+            m_th.write((uint32_t(firstTile) << 16) | secondTile);
         }
     } // end scanline -1
     // visible scanline section
@@ -867,55 +924,17 @@ void Ppu::clock()
 
             else if((m_cycle >= 1 && m_cycle <= 256) || (m_cycle >= 321 && m_cycle <= 337))
             {
-                uint8_t r = m_cycle % 8;
-                if(r == 2)
-                {
-                    m_nextTileId = readVideoMem(m_currAddr.getVramAddress());
-                }
-
-                else if(r == 4)
-                {
-                    uint16_t addr = m_currAddr.baseNameTable | 0x3c0 | (m_currAddr.tileX >> 2) | ((m_currAddr.tileY >> 2) << 3);
-
-                    uint8_t attrData = readVideoMem(addr);
-
-                    if(m_currAddr.tileY & 0x02)
-                        attrData >>= 4;
-                    if( m_currAddr.tileX & 0x02)
-                        attrData >>= 2;
-                    attrData &= 0x03;
-                    m_nextAttribData = attrData;
-                    m_paletteIdx = attrData;
-                    m_paletteBaseAddr = 0x3F00 + (m_paletteIdx << 2);
-                }
-                // performcne improvement, read tile data at once
-                //else if( m_cycle % 8 == 6:
-                //    self.next_tile_low, u1 = self.cardridge.get_tile_data(self.next_tile_id, m_currAddr.fine_y,
-                //                                                          self.background_half)
-
-                else if(r == 0)
-                {
-                    m_nextTileData = getTileData(m_nextTileId, m_currAddr.fineY, m_backgroundHalf);
-                    m_currAddr.incrementTileX();
-                }
-                else if( r == 1 && m_cycle > 1)
-                {
-                    m_th.writeLowerL(m_nextTileData.lower);
-                    m_th.writeUpperL(m_nextTileData.upper);
-
-                    m_nextAttribDataH.writeLowerL((m_nextAttribData & 0x1) ? 0xFF : 0x00);
-                    m_nextAttribDataH.writeUpperL((m_nextAttribData & 0x2) ? 0xFF : 0x00);
-                }
+                fetchBackground();
             }
             if(m_cycle >=1 && m_cycle <= 336)
             {
                 m_bgPixel = m_th.shiftBitSelect(m_fineX);
                 m_paletteIdx = m_nextAttribDataH.shiftBitSelect(m_fineX);
-                if(m_cycle >=1 && m_cycle <= 256)
+                if(m_cycle >=1 && m_cycle <= 256 && m_isRendering)
                 {
                     uint8_t idx = (readVideoMem(0x3F00 + (m_paletteIdx << 2) + m_bgPixel)) & 0x3f;
 
-                    m_frameData[(m_cycle - 1) + m_scanline*256] = m_palette[idx];
+                    writePixel((m_cycle - 1) + m_scanline*256, idx);
                 }
             }
             if(m_cycle == 256)
@@ -935,13 +954,13 @@ void Ppu::clock()
         if(m_mask.showSprites)
         {
             if(m_cycle>=0 && m_cycle <= 255)
-                decrementSpriteXCounters();
+                drawSpritePixel();
             else if( m_cycle == 1)
                 clearSecondaryOam();
             else if( m_cycle == 256)
                 fillSecondaryOam(m_scanline);
             else if( m_cycle == 257)
-                fillSpritesShiftRegisters(m_scanline);
+                fillSpriteLine(m_scanline);
         }
     }
     else if(m_scanline == 240 && m_cycle == 0)
@@ -987,14 +1006,440 @@ void Ppu::clock()
             m_scanline = -1;
             m_isOddFrame = !m_isOddFrame;
             ++m_frameNum;
-            m_frameUpdate(m_frameData.data());
+            // called for every frame, without the picture when it was not drawn
+            m_frameUpdate(m_isRendering ? m_frameData.data() : nullptr);
+            m_isRendering = m_renderInterval != 0 && m_frameNum % m_renderInterval == 0;
+        }
+    }
+}
+
+void Ppu::setMirroring(Cartridge::Mirroring mirroring)
+{
+    switch(mirroring)
+    {
+        case Cartridge::Mirroring::HORIZONTAL:
+            m_nameTableIndex = {0, 0, 1, 1};
+            break;
+        case Cartridge::Mirroring::VERTICAL:
+            m_nameTableIndex = {0, 1, 0, 1};
+            break;
+        case Cartridge::Mirroring::SINGLE_SCREEN_A:
+            m_nameTableIndex = {0, 0, 0, 0};
+            break;
+        case Cartridge::Mirroring::SINGLE_SCREEN_B:
+            m_nameTableIndex = {1, 1, 1, 1};
+            break;
+        case Cartridge::Mirroring::FOUR_SCREEN:
+            m_nameTableIndex = {0, 1, 2, 3};
+            break;
+    }
+
+    std::array<uint8_t*, 4> nameTables{m_nt0.data(), m_nt1.data(), m_nt2.data(), m_nt3.data()};
+    for(uint8_t i = 0; i < 4; ++i)
+        m_nameTables[i] = nameTables[m_nameTableIndex[i]];
+}
+
+void Ppu::setRenderInterval(uint32_t interval)
+{
+    // takes effect from the next frame so a delivered frame is always rendered in full
+    m_renderInterval = interval;
+}
+
+uint32_t Ppu::getRenderInterval() const
+{
+    return m_renderInterval;
+}
+
+void Ppu::setRendering(bool isRendering)
+{
+    // overrides the render interval for the frame that just started, only valid at a frame boundary
+    m_isRendering = isRendering;
+}
+
+void Ppu::saveState(StateWriter& state) const
+{
+    // the nametable pointers follow the mirroring restored with the mapper, the render interval is a setting
+    state.write(m_raiseNmiNextIns);
+    state.write(m_cycle);
+    state.write(m_scanline);
+    state.write(m_isOddFrame);
+    state.write(m_ctrl);
+    state.write(m_mask);
+    state.write(m_status);
+    state.write(m_currAddr);
+    state.write(m_tmpAddr);
+    state.writePages(m_nt0.data(), &m_nameTableDirty[0], 4);
+    state.writePages(m_nt1.data(), &m_nameTableDirty[4], 4);
+    state.writePages(m_nt2.data(), &m_nameTableDirty[8], 4);
+    state.writePages(m_nt3.data(), &m_nameTableDirty[12], 4);
+    state.write(m_paletteRam);
+    state.write(m_th);
+    state.write(m_paletteIdx);
+    state.write(m_backgroundHalf);
+    state.write(m_frameCnt);
+    state.write(m_nextTileId);
+    state.write(m_paletteBaseAddr);
+    state.write(m_nextTileData);
+    state.write(m_bgPixel);
+    state.write(m_raiseNmi);
+    state.write(m_lastWrittenData);
+    state.write(m_addressLatch);
+    state.write(m_readBuffer);
+    state.write(m_ppuAddr);
+    state.write(m_oam);
+    state.write(m_oamAddr);
+    state.write(m_secondaryOam);
+    state.write(m_numSecondarySprites);
+    state.write(m_secondaryOamAttrBytes);
+    state.write(m_spriteLine);
+    state.write(m_spriteFront);
+    state.write(m_spriteZero);
+    state.write(m_spriteDot);
+    state.write(m_isSpriteLineUsed);
+    state.write(m_isSpriteZeroOnLine);
+    state.write(m_nextAttribDataH);
+    state.write(m_nextAttribData);
+    state.write(m_vblankRead);
+    state.write(m_vblankFlagRead);
+    state.write(m_fineX);
+    state.write(m_frameNum);
+    state.write(m_dots);
+    state.write(m_currentDot);
+    state.write(m_nextEventDot);
+    state.write(m_isRendering);
+    state.writePages(m_frameData.data(), m_frameDirty.data(), m_frameDirty.size(), state.hasPicture());
+}
+
+void Ppu::loadState(StateReader& state)
+{
+    state.read(m_raiseNmiNextIns);
+    state.read(m_cycle);
+    state.read(m_scanline);
+    state.read(m_isOddFrame);
+    state.read(m_ctrl);
+    state.read(m_mask);
+    state.read(m_status);
+    state.read(m_currAddr);
+    state.read(m_tmpAddr);
+    state.readPages(m_nt0.data(), &m_nameTableDirty[0], 4);
+    state.readPages(m_nt1.data(), &m_nameTableDirty[4], 4);
+    state.readPages(m_nt2.data(), &m_nameTableDirty[8], 4);
+    state.readPages(m_nt3.data(), &m_nameTableDirty[12], 4);
+    state.read(m_paletteRam);
+    state.read(m_th);
+    state.read(m_paletteIdx);
+    state.read(m_backgroundHalf);
+    state.read(m_frameCnt);
+    state.read(m_nextTileId);
+    state.read(m_paletteBaseAddr);
+    state.read(m_nextTileData);
+    state.read(m_bgPixel);
+    state.read(m_raiseNmi);
+    state.read(m_lastWrittenData);
+    state.read(m_addressLatch);
+    state.read(m_readBuffer);
+    state.read(m_ppuAddr);
+    state.read(m_oam);
+    state.read(m_oamAddr);
+    state.read(m_secondaryOam);
+    state.read(m_numSecondarySprites);
+    state.read(m_secondaryOamAttrBytes);
+    state.read(m_spriteLine);
+    state.read(m_spriteFront);
+    state.read(m_spriteZero);
+    state.read(m_spriteDot);
+    state.read(m_isSpriteLineUsed);
+    state.read(m_isSpriteZeroOnLine);
+    state.read(m_nextAttribDataH);
+    state.read(m_nextAttribData);
+    state.read(m_vblankRead);
+    state.read(m_vblankFlagRead);
+    state.read(m_fineX);
+    state.read(m_frameNum);
+    state.read(m_dots);
+    state.read(m_currentDot);
+    state.read(m_nextEventDot);
+    state.read(m_isRendering);
+    state.readPages(m_frameData.data(), m_frameDirty.data(), m_frameDirty.size());
+}
+
+void Ppu::setCurrentDot(uint64_t dot)
+{
+    m_currentDot = dot;
+}
+
+void Ppu::sync()
+{
+    while(m_dots < m_currentDot)
+    {
+        uint64_t dots = m_currentDot - m_dots;
+        if(m_cycle == 0 && m_scanline >= 0 && m_scanline <= 239 && (m_mask.showBackground || m_mask.showSprites))
+        {
+            // the whole visible part of the line is behind the CPU, nothing can change it midway
+            uint16_t numDots = (m_scanline == 0 && m_isOddFrame && m_mask.showBackground) ? 256 : 257;
+            if(dots >= numDots)
+            {
+                renderScanline();
+                m_dots += numDots;
+                continue;
+            }
+        }
+        else if(m_cycle > 340)
+        {
+            // cycle was pushed past the end of the line, nothing happens until it wraps around
+            uint32_t numDots = std::min<uint64_t>(dots, 0x10000 - m_cycle);
+            m_cycle += numDots;
+            m_dots += numDots;
+            continue;
+        }
+        else if(m_cycle < 340 && isLineIdle())
+        {
+            uint16_t numDots = std::min<uint64_t>(dots, 340 - m_cycle);
+            m_cycle += numDots;
+            m_dots += numDots;
+            continue;
+        }
+
+        // clock dot by dot up to the end of the line so the next one can take a fast path
+        uint64_t lineEnd = m_dots + std::min<uint64_t>(dots, 341 - m_cycle);
+        while(m_dots < lineEnd)
+        {
+            clock();
+            ++m_dots;
+        }
+    }
+
+    if(m_dots >= m_nextEventDot)
+        updateNextEvent();
+}
+
+uint64_t Ppu::nextEventDot()
+{
+    return m_nextEventDot;
+}
+
+void Ppu::updateNextEvent()
+{
+    // walk forward line by line to the next dot that can raise NMI, clock the
+    // mapper scanline counter or finish the frame
+    int scanline = m_scanline;
+    uint32_t cycle = m_cycle;
+    bool isOddFrame = m_isOddFrame;
+    bool countScanlines = (m_mask.showBackground || m_mask.showSprites) && m_cartridge.hasScanlineCounter();
+    uint32_t counterCycle = (m_ctrl.backgroundPatternTableAddress == 0x0000) ? 259 : 323;
+    uint64_t dots = 0;
+
+    while(true)
+    {
+        if(cycle > 340)
+        {
+            // cycle was pushed past the end of the line, it wraps around without a new line
+            dots += 0x10000 - cycle;
+            cycle = 0;
+        }
+
+        if(scanline == 0 && cycle == 0 && isOddFrame && m_mask.showBackground)
+            cycle = 1;
+
+        uint32_t eventCycle = 0;
+        if(scanline == 241)
+            eventCycle = 1;
+        else if(scanline == 260)
+            eventCycle = 340;
+        else if(countScanlines && scanline < 240)
+            eventCycle = counterCycle;
+
+        if(eventCycle != 0 && cycle <= eventCycle)
+        {
+            m_nextEventDot = m_dots + dots + (eventCycle - cycle) + 1;
+            return;
+        }
+
+        dots += 341 - cycle;
+        cycle = 0;
+        scanline += 1;
+        if(scanline == 261)
+        {
+            scanline = -1;
+            isOddFrame = !isOddFrame;
         }
     }
 }
 
+uint64_t Ppu::nextStatusDot()
+{
+    // A read clears vblank and the address latch. Reads around the start of vblank race it,
+    // the sprite flags are set on the lines sprite 0 or more than 8 sprites are on and cleared
+    // on the pre-render line. Walks forward line by line like updateNextEvent.
+    if(m_status.verticalBlank || m_addressLatch != 0)
+        return m_dots;
+
+    bool isRendering = m_mask.showBackground || m_mask.showSprites;
+    bool checkOverflow = isRendering && m_mask.showSprites && !m_status.spriteOverflow;
+    bool checkZeroHit = isRendering && m_mask.showSprites && !m_status.spriteZeroHit;
+
+    // sprites in range of each line as fillSecondaryOam sees them, and the ones with the tile
+    // of sprite 0, the line after is the one they are drawn on
+    std::array<int16_t, 257> sprites{};
+    std::array<int16_t, 257> zeroSprites{};
+    if(checkOverflow || checkZeroHit)
+    {
+        uint8_t height = (m_ctrl.spriteSize == 1) ? 16 : 8;
+        for(const auto& sprite : m_oam)
+        {
+            int last = std::min(sprite.y + height, 256);
+            sprites[sprite.y] += 1;
+            sprites[last] -= 1;
+            if(sprite.tile_num == m_oam[0].tile_num)
+            {
+                zeroSprites[sprite.y] += 1;
+                zeroSprites[last] -= 1;
+            }
+        }
+        for(size_t y = 1; y < sprites.size(); ++y)
+        {
+            sprites[y] += sprites[y - 1];
+            zeroSprites[y] += zeroSprites[y - 1];
+        }
+    }
+
+    int scanline = m_scanline;
+    uint32_t cycle = m_cycle;
+    bool isOddFrame = m_isOddFrame;
+    bool isLineBuffered = true;     // the sprite line buffer is for the next line drawn
+    uint64_t dots = 0;
+
+    while(true)
+    {
+        if(cycle > 340)
+        {
+            dots += 0x10000 - cycle;
+            cycle = 0;
+        }
+
+        if(scanline == 0 && cycle == 0 && isOddFrame && m_mask.showBackground)
+            cycle = 1;
+
+        uint64_t dot = m_dots + dots;
+        if(scanline == -1 && cycle <= 1 && (m_status.spriteZeroHit || m_status.spriteOverflow))
+            return dot + (1 - cycle) + 1;
+        if(isRendering && scanline >= 0 && scanline <= 239 && cycle <= 256)
+        {
+            bool isZeroOnLine = zeroSprites[(scanline == 0) ? 239 : scanline - 1] > 0 || (isLineBuffered && m_isSpriteZeroOnLine);
+            if((checkZeroHit && isZeroOnLine) || (checkOverflow && sprites[scanline] >= 8))
+                return dot;
+            isLineBuffered = false;
+        }
+        if(scanline == 240)
+            return dot + (332 - std::min<uint32_t>(cycle, 332));
+        if(scanline == 241 && cycle <= 1)
+            return dot;
+        if(scanline == 260 && m_status.spriteZeroHit)
+            return dot + (332 - std::min<uint32_t>(cycle, 332));
+
+        dots += 341 - cycle;
+        cycle = 0;
+        scanline += 1;
+        if(scanline == 261)
+        {
+            scanline = -1;
+            isOddFrame = !isOddFrame;
+        }
+    }
+}
+
+// a line is only flagged when a pixel changes, most of a frame is drawn again unchanged
+inline void Ppu::writePixel(uint32_t pixel, uint8_t idx)
+{
+    m_frameDirty[pixel >> 8] |= m_frameData[pixel] != idx;
+    m_frameData[pixel] = idx;
+}
+
+void Ppu::renderScanline()
+{
+    // dots 0-256 of a visible line in one go, gives the same result as clocking them one by one
+    uint16_t firstDot = (m_scanline == 0 && m_isOddFrame && m_mask.showBackground) ? 1 : 0;
+    std::array<uint8_t, 257> bgPixels;
+    bgPixels.fill(m_bgPixel);
+
+    bool isSpriteZeroHitPossible = m_mask.showSprites && m_isSpriteZeroOnLine && m_spriteDot < 256;
+
+    if(m_mask.showBackground && (m_isRendering || isSpriteZeroHitPossible))
+    {
+        std::array<uint8_t, 16> colors;
+        for(uint8_t i = 0; i < 16; ++i)
+            colors[i] = readVideoMem(0x3F00 + i) & 0x3f;
+
+        uint32_t line = m_scanline * 256;
+        for(m_cycle = 1; m_cycle <= 256; ++m_cycle)
+        {
+            fetchBackground();
+            m_bgPixel = m_th.shiftBitSelect(m_fineX);
+            m_paletteIdx = m_nextAttribDataH.shiftBitSelect(m_fineX);
+            if(m_isRendering)
+                writePixel(line + m_cycle - 1, colors[(m_paletteIdx << 2) + m_bgPixel]);
+            bgPixels[m_cycle] = m_bgPixel;
+        }
+        m_currAddr.incrementTileY();
+    }
+    else if(m_mask.showBackground)
+    {
+        // headless, the pixels are not needed. Only the vram address moves, and the
+        // last two tiles are fetched as they are still in the shifters after dot 256.
+        for(m_cycle = 8; m_cycle <= 240; m_cycle += 8)
+            m_currAddr.incrementTileX();
+        for(m_cycle = 241; m_cycle <= 256; ++m_cycle)
+        {
+            fetchBackground();
+            m_bgPixel = m_th.shiftBitSelect(m_fineX);
+            m_paletteIdx = m_nextAttribDataH.shiftBitSelect(m_fineX);
+        }
+        m_currAddr.incrementTileY();
+    }
+
+    if(m_mask.showSprites && !m_isRendering && !isSpriteZeroHitPossible)
+    {
+        m_spriteDot = std::min<uint16_t>(256, m_spriteDot + 256 - firstDot);
+        fillSecondaryOam(m_scanline);
+    }
+    else if(m_mask.showSprites)
+    {
+        std::array<uint8_t, 16> colors;
+        for(uint8_t i = 0; i < 16; ++i)
+            colors[i] = readVideoMem(0x3F10 + i) & 0x3f;
+        uint8_t backdrop = readVideoMem(0x3F00) & 0x3f;
+
+        // merge the sprite line buffer with the background row
+        for(uint16_t dot = firstDot; dot <= 255 && m_spriteDot < 256; ++dot)
+        {
+            uint16_t step = m_spriteDot++;
+            uint8_t sprite = (bgPixels[dot] == 0) ? m_spriteLine[step] : m_spriteFront[step];
+            int pixel = (dot - 1) + (256 * m_scanline);
+            if(sprite != 0 && pixel >= 0 && m_isRendering)
+            {
+                writePixel(pixel, (sprite & 0x3) ? colors[sprite & 0xF] : backdrop);
+            }
+
+            if(bgPixels[dot] != 0 && m_spriteZero[step])
+                m_status.spriteZeroHit = true;
+        }
+        fillSecondaryOam(m_scanline);
+    }
+
+    m_cycle = 257;
+}
+
+bool Ppu::isLineIdle()
+{
+    // nothing but the cycle counter moves until the last dot of the line
+    if(m_scanline >= 242 || (m_scanline == 241 && m_cycle > 1) || (m_scanline == 240 && m_cycle > 0))
+        return true;
+    return m_scanline >= 0 && m_scanline <= 239 && !m_mask.showBackground && !m_mask.showSprites;
+}
+
 void Ppu::debug()
 {
-    std::cout << "NameTable 0\r\n";
+    m_log << "NameTable 0\r\n";
     uint16_t i = 0;
     std::string s;
     for(auto& e : m_nt0)
@@ -1006,12 +1451,12 @@ void Ppu::debug()
         i+=1;
         if(i==32)
         {
-            std::cout << s << "\r\n";
+            m_log << s << "\r\n";
             s = "";
             i=0;
         }
     }
-    std::cout << "NameTable 1\r\n";
+    m_log << "NameTable 1\r\n";
     i = 0;
     s = "";
     for(auto& e : m_nt1)
@@ -1023,7 +1468,7 @@ void Ppu::debug()
         i+=1;
         if(i==32)
         {
-            std::cout << s << "\r\n";
+            m_log << s << "\r\n";
             s = "";
             i=0;
         }
@@ -0,0 +1,27 @@
+#include "include/precompiled.h"
+
+#include <vector>
+
+namespace
+{
+    // filled before main, a function so it exists whatever order the files are initialised in
+    std::vector<const PrecompiledRom*>& roms()
+    {
+        static std::vector<const PrecompiledRom*> roms;
+        return roms;
+    }
+}
+
+bool precompiled::add(const PrecompiledRom& rom)
+{
+    roms().push_back(&rom);
+    return true;
+}
+
+const PrecompiledRom* precompiled::find(uint64_t hash)
+{
+    for(auto rom : roms())
+        if(rom->hash == hash)
+            return rom;
+    return nullptr;
+}
\ No newline at end of file
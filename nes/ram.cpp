@@ -1,10 +1,12 @@
 #include "include/ram.h"
 #include "include/utils.h"
+#include "include/memoryMap.h"
 
 #include <iostream>
 
 Ram::Ram()
 : m_data(0x1FFF, 0)
+, m_dirty{}
 {
 }
 
@@ -25,9 +27,25 @@ void Ram::cpuWrite(uint16_t address, uint8_t data)
         //std::cout << "write:" << toHex(data,2) << std::endl;
     }
     m_data[address & 0x07FF] = data;
+    m_dirty[(address & 0x07FF) >> 8] = 1;
 }
 
 bool Ram::isAddressInRange(uint16_t address) const
 {
     return address >= 0x0000 && address <= 0x1FFF;
+}
+
+void Ram::attach(MemoryMap& memoryMap)
+{
+    memoryMap.mapMemory(0x0000, 0x1FFF, m_data.data(), 0x0800, true, m_dirty.data());
+}
+
+void Ram::saveState(StateWriter& state) const
+{
+    state.writePages(m_data.data(), m_dirty.data(), m_dirty.size());
+}
+
+void Ram::loadState(StateReader& state)
+{
+    state.readPages(m_data.data(), m_dirty.data(), m_dirty.size());
 }
\ No newline at end of file
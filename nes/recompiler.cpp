@@ -0,0 +1,414 @@
+#include "include/recompiler.h"
+
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    using Kind = CodeBlock::Kind;
+    using Mode = CodeBlock::Mode;
+
+    std::string hex(uint64_t value, int width)
+    {
+        std::ostringstream out;
+        out << "0x" << std::uppercase << std::hex << std::setw(width) << std::setfill('0') << value;
+        return out.str();
+    }
+
+    std::string name(uint32_t offset, uint16_t pc)
+    {
+        return "block_" + hex(offset, 5).substr(2) + "_" + hex(pc, 4).substr(2);
+    }
+
+    std::string reg(int reg)
+    {
+        constexpr const char* NAMES[] = {"m.a", "m.x", "m.y"};
+        return NAMES[reg];
+    }
+
+    // C++ that runs the instructions of a block the way the JIT translates them
+    class Writer
+    {
+        public:
+            Writer(std::ostream& out, const CodeBlock& block)
+            : m_out{out}
+            , m_block{block}
+            , m_loops{false}
+            {
+                if(block.canLoop())
+                    for(const auto& op : block.getOps())
+                        if((op.info.kind == Kind::JMP && op.operand == block.getPc()) || (op.info.kind == Kind::BRANCH && op.target == block.getPc()))
+                            m_loops = true;
+            }
+
+            void write(const std::string& name)
+            {
+                const auto& ops = m_block.getOps();
+                m_out << "    void " << name << "(Jit::Context* context)\n";
+                m_out << "    {\n";
+                m_out << "        precompiled::Machine m{context};\n";
+                if(m_loops)
+                    m_out << "    start:\n";
+                for(size_t i = 0; i < ops.size(); ++i)
+                {
+                    if(i + 1 == ops.size())
+                        line("m.last();");
+                    line("m.cycles += " + std::to_string(ops[i].info.cycles) + ";");
+                    instruction(ops[i]);
+                }
+                if(!CodeBlock::isExit(ops.back().info.kind))
+                    exit(m_block.getEnd());
+                m_out << "    }\n\n";
+            }
+
+        private:
+            std::ostream& m_out;
+            const CodeBlock& m_block;
+            bool m_loops;
+
+            void line(const std::string& code, int depth = 0)
+            {
+                m_out << std::string(8 + 4 * depth, ' ') << code << "\n";
+            }
+
+            void exit(uint16_t pc, int depth = 0)
+            {
+                line("m.exit(" + hex(pc, 4) + ");", depth);
+                line("return;", depth);
+            }
+
+            void jumpTo(uint16_t target, int depth = 0)
+            {
+                if(m_loops && target == m_block.getPc())
+                {
+                    line("if(m.fits(" + std::to_string(m_block.getMaxStart()) + "))", depth);
+                    line("goto start;", depth + 1);
+                }
+                exit(target, depth);
+            }
+
+            static bool isRam(const CodeBlock::Op& op)
+            {
+                switch(op.info.mode)
+                {
+                    case Mode::ZERO_PAGE:
+                    case Mode::ZERO_PAGE_X:
+                    case Mode::ZERO_PAGE_Y:
+                        return true;
+                    case Mode::ABSOLUTE_X:
+                    case Mode::ABSOLUTE_Y:
+                        return op.operand + 0xFF < 0x2000;
+                    default:
+                        return op.operand < 0x2000;
+                }
+            }
+
+            static std::string address(const CodeBlock::Op& op)
+            {
+                switch(op.info.mode)
+                {
+                    case Mode::ZERO_PAGE_X:
+                        return "m.zeroPage(" + hex(op.operand, 2) + ", m.x)";
+                    case Mode::ZERO_PAGE_Y:
+                        return "m.zeroPage(" + hex(op.operand, 2) + ", m.y)";
+                    case Mode::ABSOLUTE_X:
+                        return "m.absolute(" + hex(op.operand, 4) + ", m.x, " + (op.info.extraCycle ? "true" : "false") + ")";
+                    case Mode::ABSOLUTE_Y:
+                        return "m.absolute(" + hex(op.operand, 4) + ", m.y, " + (op.info.extraCycle ? "true" : "false") + ")";
+                    default:
+                        return hex(op.operand, 4);
+                }
+            }
+
+            static std::string read(const CodeBlock::Op& op, const std::string& address)
+            {
+                return (isRam(op) ? "m.readRam(" : "m.read(") + address + ")";
+            }
+
+            static std::string fetch(const CodeBlock::Op& op)
+            {
+                if(op.info.mode == Mode::IMMEDIATE)
+                    return hex(op.operand, 2);
+                if(op.info.mode == Mode::ACCUMULATOR)
+                    return "m.a";
+                return read(op, address(op));
+            }
+
+            // a read-modify-write through the Machine operation of that name, which sets NZ
+            void modify(const CodeBlock::Op& op, const std::string& operation)
+            {
+                if(op.info.mode == Mode::ACCUMULATOR)
+                {
+                    line("m.a = m." + operation + "(m.a);");
+                    return;
+                }
+                line("{");
+                line("uint16_t address = " + address(op) + ";", 1);
+                line("m.write(address, m." + operation + "(" + read(op, "address") + "));", 1);
+                line("}");
+            }
+
+            void instruction(const CodeBlock::Op& op)
+            {
+                const auto& info = op.info;
+                switch(info.kind)
+                {
+                    case Kind::LOAD:
+                        line(reg(info.reg) + " = " + fetch(op) + ";");
+                        line("m.nz = " + reg(info.reg) + ";");
+                        break;
+                    case Kind::STORE:
+                        line("m.write(" + address(op) + ", " + reg(info.reg) + ");");
+                        break;
+                    case Kind::AND:
+                    case Kind::ORA:
+                    case Kind::EOR:
+                        line(std::string("m.a ") + (info.kind == Kind::AND ? "&" : info.kind == Kind::ORA ? "|" : "^") + "= " + fetch(op) + ";");
+                        line("m.nz = m.a;");
+                        break;
+                    case Kind::ADC:
+                        line("m.adc(" + fetch(op) + ");");
+                        break;
+                    case Kind::SBC:
+                        line("m.sbc(" + fetch(op) + ");");
+                        break;
+                    case Kind::CMP:
+                        line("m.compare(" + reg(info.reg) + ", " + fetch(op) + ");");
+                        break;
+                    case Kind::INC:
+                        modify(op, "inc");
+                        break;
+                    case Kind::DEC:
+                        modify(op, "dec");
+                        break;
+                    case Kind::ASL:
+                        modify(op, "asl");
+                        break;
+                    case Kind::LSR:
+                        modify(op, "lsr");
+                        break;
+                    case Kind::ROL:
+                        modify(op, "rol");
+                        break;
+                    case Kind::ROR:
+                        modify(op, "ror");
+                        break;
+                    case Kind::STEP:
+                        line(reg(info.reg) + " = (" + reg(info.reg) + (info.value > 0 ? " + 1" : " - 1") + ") & 0xFF;");
+                        line("m.nz = " + reg(info.reg) + ";");
+                        break;
+                    case Kind::TRANSFER:
+                        line(reg(info.reg) + " = " + reg(info.value) + ";");
+                        line("m.nz = " + reg(info.reg) + ";");
+                        break;
+                    case Kind::TSX:
+                        line("m.x = m.sp & 0xFF;");
+                        line("m.nz = m.x;");
+                        break;
+                    case Kind::TXS:
+                        line("m.sp = m.x;");
+                        break;
+                    case Kind::FLAG:
+                        flag(info.reg, info.value);
+                        break;
+                    case Kind::NOP:
+                        break;
+                    case Kind::BRANCH:
+                        line("if(" + condition(info.reg, info.value) + ")");
+                        line("{");
+                        line("m.cycles += " + std::to_string(op.takenCycles - info.cycles) + ";", 1);
+                        jumpTo(op.target, 1);
+                        line("}");
+                        exit(op.pc + 2);
+                        break;
+                    case Kind::JMP:
+                        jumpTo(op.operand);
+                        break;
+                    case Kind::JSR:
+                        line("m.push(" + hex((op.pc + 2) >> 8, 2) + ");");
+                        line("m.push(" + hex((op.pc + 2) & 0xFF, 2) + ");");
+                        exit(op.operand);
+                        break;
+                    case Kind::RTS:
+                        line("{");
+                        line("uint8_t low = m.pop();", 1);
+                        line("uint8_t high = m.pop();", 1);
+                        line("m.exit(uint16_t(((high << 8) | low) + 1));", 1);
+                        line("return;", 1);
+                        line("}");
+                        break;
+                    case Kind::PHA:
+                        line("m.push(m.a);");
+                        break;
+                    case Kind::PLA:
+                        line("m.a = m.pop();");
+                        line("m.nz = m.a;");
+                        break;
+                    default:
+                        throw std::runtime_error("Recompiler cannot translate the block at " + hex(m_block.getPc(), 4));
+                }
+            }
+
+            void flag(int flag, int value)
+            {
+                switch(flag)
+                {
+                    case CodeBlock::FLAG_C:
+                        line("m.c = " + std::to_string(value) + ";");
+                        break;
+                    case CodeBlock::FLAG_V:
+                        line("m.v = " + std::to_string(value) + ";");
+                        break;
+                    case CodeBlock::FLAG_I:
+                        line("m.setI(" + std::to_string(value) + ");");
+                        break;
+                    default:
+                        line("m.setD(" + std::to_string(value) + ");");
+                        break;
+                }
+            }
+
+            static std::string condition(int flag, int value)
+            {
+                std::string is;
+                switch(flag)
+                {
+                    case CodeBlock::FLAG_N:
+                        is = "m.n()";
+                        break;
+                    case CodeBlock::FLAG_Z:
+                        is = "m.z()";
+                        break;
+                    case CodeBlock::FLAG_C:
+                        is = "m.c";
+                        break;
+                    default:
+                        is = "m.v";
+                        break;
+                }
+                return value ? is : "!" + is;
+            }
+    };
+}
+
+Recompiler::Recompiler(const std::string& nesFile)
+: m_image{RomImage::load(nesFile)}
+{
+    RomSpan data = m_image->data();
+    if(data.size() < 16)
+        throw std::runtime_error("Invalid nes file, size:" + std::to_string(data.size()));
+
+    m_prgStart = (data[6] & 0x4) ? 16 + 512 : 16;
+    m_prgSize = 16384 * data[4];
+    m_mapperId = ((data[7] >> 4) << 4) | (data[6] >> 4);
+    if(m_prgSize == 0 || m_prgStart + m_prgSize > data.size())
+        throw std::runtime_error("Invalid nes file, PRG-ROM does not fit:" + std::to_string(m_prgSize));
+
+    walk();
+}
+
+void Recompiler::walk()
+{
+    std::vector<Location> pending;
+    Location vectors{m_prgStart + m_prgSize - 0x4000, 0xFFFA};
+    for(uint32_t vector = 0xFFFA; vector < 0x10000; vector += 2)
+        follow(vectors, byte(vectors, vector) | (byte(vectors, vector + 1) << 8), pending);
+
+    std::set<std::pair<uint32_t, uint16_t>> seen;
+    while(!pending.empty())
+    {
+        Location at = pending.back();
+        pending.pop_back();
+        if(!seen.insert({at.base, at.pc}).second)
+            continue;
+
+        // the last instruction decides where the flow goes, the interpreter runs it when the
+        // block could not start with it
+        CodeBlock block{at.pc, page(at), m_decodeCache};
+        Location last = at;
+        if(!block.empty())
+        {
+            last.pc = block.getOps().back().pc;
+            m_blocks.emplace(std::make_pair(at.base + (at.pc & 0x3FFF), at.pc), std::move(block));
+        }
+
+        const auto& op = m_decodeCache.find(last.pc, page(last));
+        uint16_t operand = byte(last, last.pc + 1) | (byte(last, last.pc + 2) << 8);
+        switch(op.opcode)
+        {
+            case 0x00:  // BRK
+            case 0x40:  // RTI
+            case 0x60:  // RTS
+            case 0x6C:  // JMP (ind)
+                break;
+            case 0x4C:
+                follow(last, operand, pending);
+                break;
+            case 0x20:
+                follow(last, operand, pending);
+                follow(last, last.pc + 3, pending);
+                break;
+            default:
+                if((op.opcode & 0x1F) == 0x10)
+                {
+                    follow(last, last.pc + 2 + int8_t(operand & 0xFF), pending);
+                    follow(last, last.pc + 2, pending);
+                }
+                else if(op.length > 1 || op.isLocal)   // not an opcode the CPU knows
+                    follow(last, last.pc + op.length, pending);
+                break;
+        }
+    }
+}
+
+void Recompiler::follow(const Location& from, uint16_t target, std::vector<Location>& pending) const
+{
+    uint32_t lastBank = m_prgStart + m_prgSize - 0x4000;
+    if(target < 0x8000)
+        return;
+    if(m_prgSize == 0x4000)
+        pending.push_back({m_prgStart, target});
+    else if(m_mapperId == 0)
+        pending.push_back({m_prgStart + (target & 0x4000), target});
+    else if(target >= 0xC000)
+        pending.push_back({lastBank, target});
+    else if(from.pc >= 0x8000 && from.pc < 0xC000)
+        pending.push_back({from.base, target});
+    else
+        for(uint32_t base = m_prgStart; base <= lastBank; base += 0x4000)
+            pending.push_back({base, target});
+}
+
+const uint8_t* Recompiler::page(const Location& at) const
+{
+    return m_image->data().data() + at.base + (at.pc & 0x3F00);
+}
+
+uint8_t Recompiler::byte(const Location& at, uint16_t pc) const
+{
+    return m_image->data()[at.base + (pc & 0x3FFF)];
+}
+
+void Recompiler::write(std::ostream& out) const
+{
+    out << "// Generated by nesRecompile, do not edit\n";
+    out << "#include \"include/precompiled.h\"\n\n";
+    out << "namespace\n{\n";
+    for(const auto& [key, block] : m_blocks)
+        Writer{out, block}.write(name(key.first, key.second));
+
+    out << "    const PrecompiledBlock BLOCKS[] = {\n";
+    for(const auto& [key, block] : m_blocks)
+        out << "        {" << hex(key.first, 5) << ", {&" << name(key.first, key.second) << ", " << hex(key.second, 4) << ", " << block.getMaxStart() << "}},\n";
+    out << "    };\n\n";
+    out << "    const PrecompiledRom ROM{" << hex(m_image->hash(), 16) << "ULL, BLOCKS, " << m_blocks.size() << "};\n";
+    out << "    const bool registered = precompiled::add(ROM);\n";
+    out << "}\n";
+}
+
+size_t Recompiler::getNumBlocks() const
+{
+    return m_blocks.size();
+}
\ No newline at end of file
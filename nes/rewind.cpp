@@ -0,0 +1,153 @@
+#include "include/rewind.h"
+
+#include <cstring>
+#include <utility>
+
+// a record is a sequence of runs, each a uint16_t count of unchanged words, a uint16_t
+// count of changed words and the XOR of those
+Rewind::Rewind(size_t stateSize, size_t arenaSize, uint32_t maxFrames)
+: m_stateSize{stateSize}
+, m_numWords{(stateSize + 7) / 8}
+, m_arena(arenaSize)
+, m_records(maxFrames)
+, m_first{0}
+, m_count{0}
+, m_head{0}
+, m_state(m_numWords, 0)
+, m_next(m_numWords, 0)
+, m_encoded(m_numWords * 8 + (m_numWords / 2 + 2) * 4)
+, m_hasState{false}
+{
+
+}
+
+uint8_t* Rewind::nextState()
+{
+    return reinterpret_cast<uint8_t*>(m_next.data());
+}
+
+void Rewind::push()
+{
+    if(m_hasState && !m_records.empty())
+        store(encode());
+    std::swap(m_state, m_next);
+    m_hasState = true;
+}
+
+uint32_t Rewind::stepBack(uint32_t frames)
+{
+    uint32_t steps = 0;
+    for(; steps < frames && m_count > 0; ++steps)
+    {
+        const Record& record = m_records[(m_first + m_count - 1) % m_records.size()];
+        decode(record);
+        m_head = record.offset;
+        --m_count;
+    }
+    return steps;
+}
+
+const uint8_t* Rewind::state() const
+{
+    return reinterpret_cast<const uint8_t*>(m_state.data());
+}
+
+size_t Rewind::stateSize() const
+{
+    return m_stateSize;
+}
+
+uint32_t Rewind::numFrames() const
+{
+    return m_count;
+}
+
+size_t Rewind::encode()
+{
+    // the XOR of the next snapshot with the newest one, which goes back a frame once applied
+    uint8_t* out = m_encoded.data();
+    size_t word = 0;
+    while(word < m_numWords)
+    {
+        uint16_t same = 0;
+        while(word < m_numWords && same < 0xFFFF && m_state[word] == m_next[word])
+        {
+            ++word;
+            ++same;
+        }
+
+        uint16_t changed = 0;
+        uint8_t* run = out + 4;
+        while(word < m_numWords && changed < 0xFFFF && m_state[word] != m_next[word])
+        {
+            uint64_t diff = m_state[word] ^ m_next[word];
+            std::memcpy(run, &diff, 8);
+            run += 8;
+            ++word;
+            ++changed;
+        }
+
+        std::memcpy(out, &same, 2);
+        std::memcpy(out + 2, &changed, 2);
+        out = run;
+    }
+    return out - m_encoded.data();
+}
+
+void Rewind::decode(const Record& record)
+{
+    const uint8_t* in = &m_arena[record.offset];
+    const uint8_t* end = in + record.size;
+    size_t word = 0;
+    while(in < end)
+    {
+        uint16_t same;
+        uint16_t changed;
+        std::memcpy(&same, in, 2);
+        std::memcpy(&changed, in + 2, 2);
+        in += 4;
+        word += same;
+        for(uint16_t i = 0; i < changed; ++i, ++word, in += 8)
+        {
+            uint64_t diff;
+            std::memcpy(&diff, in, 8);
+            m_state[word] ^= diff;
+        }
+    }
+}
+
+void Rewind::store(size_t size)
+{
+    if(size > m_arena.size())
+    {
+        // the history cannot go back past this frame
+        while(m_count > 0)
+            dropOldest();
+        m_head = 0;
+        return;
+    }
+
+    size_t offset = m_head;
+    if(offset + size > m_arena.size())
+    {
+        // wraps around, everything past the head is older than what is at the start
+        while(m_count > 0 && m_records[m_first].offset >= m_head)
+            dropOldest();
+        offset = 0;
+    }
+    while(m_count > 0 && m_records[m_first].offset < offset + size && offset < m_records[m_first].offset + m_records[m_first].size)
+        dropOldest();
+    if(m_count == m_records.size())
+        dropOldest();
+
+    std::memcpy(&m_arena[offset], m_encoded.data(), size);
+    m_records[(m_first + m_count) % m_records.size()] = Record{offset, size};
+    ++m_count;
+    m_head = offset + size;
+}
+
+void Rewind::dropOldest()
+{
+    m_first = (m_first + 1) % m_records.size();
+    --m_count;
+}
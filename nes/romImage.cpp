@@ -0,0 +1,89 @@
+#include "include/romImage.h"
+
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+RomSpan RomSpan::sub(uint32_t offset, uint32_t size) const
+{
+    if(offset > m_size || size > m_size - offset)
+        throw std::runtime_error("RomSpan::sub() Out of range, offset:" + std::to_string(offset) + " size:" + std::to_string(size));
+    return RomSpan{m_data + offset, size};
+}
+
+RomImage::RomImage(void* mapping, size_t size)
+: m_mapping{mapping}
+, m_size{size}
+, m_hash{14695981039346656037ull}
+{
+    // FNV-1a
+    const uint8_t* data = static_cast<const uint8_t*>(m_mapping);
+    for(size_t i = 0; i < m_size; ++i)
+    {
+        m_hash ^= data[i];
+        m_hash *= 1099511628211ull;
+    }
+}
+
+RomImage::~RomImage()
+{
+    munmap(m_mapping, m_size);
+}
+
+std::shared_ptr<const RomImage> RomImage::load(const std::string& filePath)
+{
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("RomImage::load() File does not exists:" + filePath);
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error("RomImage::load() Empty file:" + filePath);
+    }
+
+    void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+        throw std::runtime_error("RomImage::load() Failed to map file:" + filePath);
+
+    std::shared_ptr<const RomImage> image{new RomImage(mapping, st.st_size)};
+
+    static std::mutex mutex;
+    static std::unordered_map<uint64_t, std::weak_ptr<const RomImage>> images;
+
+    std::lock_guard<std::mutex> lock{mutex};
+    for(auto it = images.begin(); it != images.end();)
+    {
+        if(it->second.expired())
+            it = images.erase(it);
+        else
+            ++it;
+    }
+
+    // the new mapping is dropped when the same content is already loaded
+    auto& entry = images[image->hash()];
+    auto loaded = entry.lock();
+    if(loaded && loaded->m_size == image->m_size && std::memcmp(loaded->m_mapping, image->m_mapping, image->m_size) == 0)
+        return loaded;
+    if(!loaded)
+        entry = image;
+    return image;
+}
+
+RomSpan RomImage::data() const
+{
+    return RomSpan{static_cast<const uint8_t*>(m_mapping), static_cast<uint32_t>(m_size)};
+}
+
+uint64_t RomImage::hash() const
+{
+    return m_hash;
+}
\ No newline at end of file
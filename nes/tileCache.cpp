@@ -0,0 +1,76 @@
+#include "include/tileCache.h"
+
+#include <map>
+#include <mutex>
+
+TileCache::TileCache(RomSpan chr)
+: m_rows(chr.size(), 0)
+, m_size{static_cast<uint32_t>(chr.size())}
+, m_isShared{false}
+{
+    for(uint32_t offset = 0; offset < m_size; offset += 16)
+    {
+        for(uint32_t row = 0; row < 8; ++row)
+            decode(offset + row, chr);
+    }
+}
+
+std::shared_ptr<TileCache> TileCache::shared(std::shared_ptr<const RomImage> image, RomSpan chr)
+{
+    // images are unique per content, so the CHR location identifies the data
+    static std::mutex mutex;
+    static std::map<std::pair<const uint8_t*, uint32_t>, std::weak_ptr<TileCache>> caches;
+
+    std::lock_guard<std::mutex> lock{mutex};
+    for(auto it = caches.begin(); it != caches.end();)
+    {
+        if(it->second.expired())
+            it = caches.erase(it);
+        else
+            ++it;
+    }
+
+    auto& cache = caches[{chr.data(), chr.size()}];
+    auto tileCache = cache.lock();
+    if(!tileCache)
+    {
+        tileCache = std::make_shared<TileCache>(chr);
+        tileCache->m_isShared = true;
+        tileCache->m_image = std::move(image);
+        cache = tileCache;
+    }
+    return tileCache;
+}
+
+uint16_t TileCache::decodeRow(uint8_t lower, uint8_t upper, bool flip)
+{
+    uint16_t pixels = 0;
+    for(int i = 0; i < 8; ++i)
+    {
+        int bit = flip ? i : 7 - i;
+        uint16_t pixel = (((upper >> bit) & 0x1) << 1) | ((lower >> bit) & 0x1);
+        pixels |= pixel << (14 - 2 * i);
+    }
+    return pixels;
+}
+
+void TileCache::write(uint32_t offset, RomSpan chr)
+{
+    // both bit planes of the row are needed, so the whole row is decoded again
+    decode(offset, chr);
+}
+
+bool TileCache::isShared() const
+{
+    return m_isShared;
+}
+
+void TileCache::decode(uint32_t offset, RomSpan chr)
+{
+    uint32_t tile = offset & ~0xFu;
+    uint32_t row = offset & 0x7;
+    uint8_t lower = chr[tile + row];
+    uint8_t upper = chr[tile + row + 8];
+    m_rows[tile + row] = decodeRow(lower, upper, false);
+    m_rows[tile + row + 8] = decodeRow(lower, upper, true);
+}
\ No newline at end of file
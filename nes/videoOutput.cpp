@@ -0,0 +1,99 @@
+#include "include/videoOutput.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+VideoOutput::VideoOutput(const std::array<uint32_t, 64>& palette, PixelFormat format, std::function<void(const void*)> frameUpdate)
+: m_format{format}
+, m_frameUpdate{frameUpdate}
+, m_lut{}
+, m_frame((256 * 240 * bytesPerPixel(format) + 3) / 4)
+{
+    for(uint8_t i = 0; i < 64; ++i)
+    {
+        uint8_t r = (palette[i] >> 16) & 0xFF;
+        uint8_t g = (palette[i] >> 8) & 0xFF;
+        uint8_t b = palette[i] & 0xFF;
+        uint16_t rgb565 = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+
+        switch(format)
+        {
+            case PixelFormat::INDEXED:
+                m_lut[i] = {i, 0, 0, 0};
+                break;
+            case PixelFormat::XRGB8888:
+                std::memcpy(m_lut[i].data(), &palette[i], 4);
+                break;
+            case PixelFormat::RGBA8888:
+                m_lut[i] = {r, g, b, 0xFF};
+                break;
+            case PixelFormat::BGRA8888:
+                m_lut[i] = {b, g, r, 0xFF};
+                break;
+            case PixelFormat::RGB565:
+                std::memcpy(m_lut[i].data(), &rgb565, 2);
+                break;
+            case PixelFormat::GRAYSCALE:
+                m_lut[i] = {static_cast<uint8_t>((r * 77 + g * 150 + b * 29) >> 8), 0, 0, 0};
+                break;
+        }
+    }
+}
+
+void VideoOutput::present(const uint8_t* indices)
+{
+    if(!m_frameUpdate)
+        return;
+
+    switch(bytesPerPixel(m_format))
+    {
+        case 1:
+            if(m_format == PixelFormat::INDEXED)
+            {
+                // already in the consumer's format
+                m_frameUpdate(indices);
+                return;
+            }
+            convert<1>(indices);
+            break;
+        case 2:
+            convert<2>(indices);
+            break;
+        case 4:
+            convert<4>(indices);
+            break;
+    }
+    m_frameUpdate(m_frame.data());
+}
+
+VideoOutput::PixelFormat VideoOutput::getFormat() const
+{
+    return m_format;
+}
+
+uint8_t VideoOutput::bytesPerPixel(PixelFormat format)
+{
+    switch(format)
+    {
+        case PixelFormat::INDEXED:
+        case PixelFormat::GRAYSCALE:
+            return 1;
+        case PixelFormat::RGB565:
+            return 2;
+        case PixelFormat::XRGB8888:
+        case PixelFormat::RGBA8888:
+        case PixelFormat::BGRA8888:
+            return 4;
+    }
+    throw std::runtime_error("Unknown pixel format:" + std::to_string(static_cast<int>(format)));
+}
+
+template<uint8_t N>
+void VideoOutput::convert(const uint8_t* indices)
+{
+    // one table lookup per pixel over the whole frame, the loop has no branches so it vectorizes
+    uint8_t* out = reinterpret_cast<uint8_t*>(m_frame.data());
+    for(uint32_t i = 0; i < 256 * 240; ++i)
+        std::memcpy(out + i * N, m_lut[indices[i] & 0x3F].data(), N);
+}
\ No newline at end of file